@@ -0,0 +1,185 @@
+#include "arena_chart.h"
+#include "mermaid_reader.h"
+#include <algorithm>
+#include <new>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+// Finds key, inserting a default value (constructed in the map's arena) if it
+// is missing, without materializing a key for the lookup
+template <typename Map>
+typename Map::iterator findOrInsert(Map& map, std::string_view key, bool* inserted = nullptr) {
+    auto it = map.lower_bound(key);
+    bool missing = it == map.end() || it->first != key;
+    if (missing) {
+        it = map.emplace_hint(it, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+    }
+    if (inserted) *inserted = missing;
+    return it;
+}
+
+template <typename List>
+std::vector<std::string> toStrings(const List& list) {
+    std::vector<std::string> out;
+    out.reserve(list.size());
+    for (const auto& item : list) out.emplace_back(item);
+    return out;
+}
+
+} // namespace
+
+ArenaChart::ArenaChart(size_t initialBlockSize, std::pmr::memory_resource* upstream)
+    : arena(std::make_unique<std::pmr::monotonic_buffer_resource>(std::max<size_t>(initialBlockSize, 1), upstream)) {
+    void* memory = arena->allocate(sizeof(Contents), alignof(Contents));
+    contents = new (memory) Contents(allocator_type(arena.get()));
+}
+
+ArenaChart::ArenaChart(ArenaChart&& other) noexcept
+    : direction(other.direction), arena(std::move(other.arena)), contents(std::exchange(other.contents, nullptr)) {}
+
+ArenaChart& ArenaChart::operator=(ArenaChart&& other) noexcept {
+    if (this != &other) {
+        direction = other.direction;
+        arena = std::move(other.arena);
+        contents = std::exchange(other.contents, nullptr);
+    }
+    return *this;
+}
+
+void ArenaChart::addNode(std::string_view id, std::string_view label, std::string_view style) {
+    if (!label.empty()) {
+        findOrInsert(contents->nameToId, label)->second = id;
+    }
+    Node& node = findOrInsert(contents->nodes, id)->second;
+    node.id = id;
+    node.label = label;
+    node.style = style;
+}
+
+void ArenaChart::addConnection(std::string_view from, std::string_view to,
+                               std::string_view label, std::string_view style) {
+    findOrInsert(contents->predecessors, to)->second.emplace_back(from);
+    findOrInsert(contents->successors, from)->second.emplace_back(to);
+    Connection& conn = contents->connections.emplace_back();
+    conn.from = from;
+    conn.to = to;
+    conn.label = label;
+    conn.style = style;
+}
+
+void ArenaChart::addClass(std::string_view className, std::string_view definition) {
+    findOrInsert(contents->classDefinitions, className)->second = definition;
+}
+
+void ArenaChart::addNodeClass(std::string_view nodeId, std::string_view className) {
+    findOrInsert(contents->nodeClasses, nodeId)->second.emplace_back(className);
+}
+
+void ArenaChart::addSubgraph(std::string_view id, std::string_view label) {
+    SubGraph& subgraph = findOrInsert(contents->subgraphs, id)->second;
+    subgraph.id = id;
+    subgraph.label = label;
+    subgraph.style.clear();
+    subgraph.nodeIds.clear();
+    subgraph.subgraphIds.clear();
+}
+
+void ArenaChart::addNodeToSubgraph(std::string_view nodeId, std::string_view subgraphId) {
+    auto it = contents->subgraphs.find(subgraphId);
+    if (it != contents->subgraphs.end() && contents->nodes.find(nodeId) != contents->nodes.end()) {
+        it->second.nodeIds.emplace(nodeId);
+    }
+}
+
+void ArenaChart::setNodeLabel(std::string_view id, std::string_view label) {
+    auto it = contents->nodes.find(id);
+    if (it != contents->nodes.end()) {
+        it->second.label = label;
+    }
+}
+
+ArenaChart ArenaChart::parse(std::string_view content, size_t initialBlockSize, std::pmr::memory_resource* upstream) {
+    ArenaChart chart(initialBlockSize, upstream);
+
+    // First sighting of an id creates the node; later references only
+    // relabel it, exactly as in MermaidParser::parseContent
+    auto addNode = [&](std::string_view id, std::string_view label, std::string_view subgraph) {
+        if (chart.contents->nodes.find(id) == chart.contents->nodes.end()) {
+            chart.addNode(id, label);
+            if (!subgraph.empty()) {
+                chart.addNodeToSubgraph(id, subgraph);
+            }
+        } else if (!label.empty()) {
+            chart.setNodeLabel(id, label);
+        }
+    };
+
+    MermaidReader reader(content);
+    MermaidEvent event;
+    while (reader.next(&event)) {
+        switch (event.type) {
+        case MermaidEvent::Type::Flowchart:
+            chart.direction = event.direction;
+            break;
+        case MermaidEvent::Type::Node:
+            addNode(event.id, event.label, event.subgraph);
+            break;
+        case MermaidEvent::Type::Edge:
+            chart.addConnection(event.id, event.target, event.label, event.style);
+            break;
+        case MermaidEvent::Type::SubgraphBegin:
+            chart.addSubgraph(event.id, event.label);
+            break;
+        case MermaidEvent::Type::SubgraphEnd:
+            break;
+        case MermaidEvent::Type::ClassDef:
+            chart.addClass(event.className, event.label);
+            break;
+        case MermaidEvent::Type::Class:
+            chart.addNodeClass(event.id, event.className);
+            break;
+        }
+    }
+    return chart;
+}
+
+Chart ArenaChart::toChart() const {
+    Chart chart;
+    chart.direction = direction;
+    for (const auto& [id, node] : contents->nodes) {
+        chart.nodes.emplace_hint(chart.nodes.end(), id, ::Node(std::string(node.id), std::string(node.label),
+                                                               std::string(node.style)));
+    }
+    for (const auto& [name, id] : contents->nameToId) {
+        chart.nameToId.emplace_hint(chart.nameToId.end(), name, id);
+    }
+    chart.connections.reserve(contents->connections.size());
+    for (const auto& conn : contents->connections) {
+        chart.connections.emplace_back(std::string(conn.from), std::string(conn.to), std::string(conn.label),
+                                       std::string(conn.style));
+    }
+    for (const auto& [id, list] : contents->predecessors) {
+        chart.predecessors.emplace_hint(chart.predecessors.end(), id, toStrings(list));
+    }
+    for (const auto& [id, list] : contents->successors) {
+        chart.successors.emplace_hint(chart.successors.end(), id, toStrings(list));
+    }
+    for (const auto& [name, definition] : contents->classDefinitions) {
+        chart.classDefinitions.emplace_hint(chart.classDefinitions.end(), name, definition);
+    }
+    for (const auto& [id, list] : contents->nodeClasses) {
+        chart.nodeClasses.emplace_hint(chart.nodeClasses.end(), id, toStrings(list));
+    }
+    for (const auto& [id, subgraph] : contents->subgraphs) {
+        ::SubGraph& copy = chart.subgraphs.emplace_hint(chart.subgraphs.end(), id, ::SubGraph())->second;
+        copy.id = subgraph.id;
+        copy.label = subgraph.label;
+        copy.style = subgraph.style;
+        for (const auto& nodeId : subgraph.nodeIds) copy.nodeIds.emplace_hint(copy.nodeIds.end(), nodeId);
+        for (const auto& childId : subgraph.subgraphIds) copy.subgraphIds.emplace_hint(copy.subgraphIds.end(), childId);
+    }
+    chart.refreshFingerprint();
+    return chart;
+}
@@ -0,0 +1,160 @@
+#ifndef ARENA_CHART_H
+#define ARENA_CHART_H
+
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A Chart whose strings and containers all live in one arena, for
+// parse-and-discard workloads. Every string, map node and vector is carved
+// from a std::pmr::monotonic_buffer_resource that grows in a few large
+// blocks, and the containers themselves are placed in the arena and never
+// destroyed: since they own nothing outside it, dropping the chart releases
+// the blocks in O(1) instead of walking and freeing every element.
+//
+// The members mirror Chart and the add* methods follow the same rules, so
+// ArenaChart::parse(content).toChart() equals MermaidParser::parseContent.
+// There is no maintained fingerprint; convert with toChart() when one is
+// needed. Strings handed out by the accessors are only valid while the
+// ArenaChart is alive.
+class ArenaChart {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    using String = std::pmr::string;
+
+    struct Node {
+        using allocator_type = ArenaChart::allocator_type;
+        String id;
+        String label;
+        String style;
+
+        explicit Node(const allocator_type& alloc = {}) : id(alloc), label(alloc), style(alloc) {}
+        Node(const Node& other, const allocator_type& alloc)
+            : id(other.id, alloc), label(other.label, alloc), style(other.style, alloc) {}
+        Node(Node&& other, const allocator_type& alloc)
+            : id(std::move(other.id), alloc), label(std::move(other.label), alloc), style(std::move(other.style), alloc) {}
+        Node(const Node&) = default;
+        Node(Node&&) = default;
+        Node& operator=(const Node&) = default;
+        Node& operator=(Node&&) = default;
+    };
+
+    struct Connection {
+        using allocator_type = ArenaChart::allocator_type;
+        String from;
+        String to;
+        String label;
+        String style;
+
+        explicit Connection(const allocator_type& alloc = {}) : from(alloc), to(alloc), label(alloc), style(alloc) {}
+        Connection(const Connection& other, const allocator_type& alloc)
+            : from(other.from, alloc), to(other.to, alloc), label(other.label, alloc), style(other.style, alloc) {}
+        Connection(Connection&& other, const allocator_type& alloc)
+            : from(std::move(other.from), alloc), to(std::move(other.to), alloc),
+              label(std::move(other.label), alloc), style(std::move(other.style), alloc) {}
+        Connection(const Connection&) = default;
+        Connection(Connection&&) = default;
+        Connection& operator=(const Connection&) = default;
+        Connection& operator=(Connection&&) = default;
+    };
+
+    struct SubGraph {
+        using allocator_type = ArenaChart::allocator_type;
+        String id;
+        String label;
+        String style;
+        std::pmr::set<String, std::less<>> nodeIds;
+        std::pmr::set<String, std::less<>> subgraphIds;
+
+        explicit SubGraph(const allocator_type& alloc = {})
+            : id(alloc), label(alloc), style(alloc), nodeIds(alloc), subgraphIds(alloc) {}
+        SubGraph(const SubGraph& other, const allocator_type& alloc)
+            : id(other.id, alloc), label(other.label, alloc), style(other.style, alloc),
+              nodeIds(other.nodeIds, alloc), subgraphIds(other.subgraphIds, alloc) {}
+        SubGraph(SubGraph&& other, const allocator_type& alloc)
+            : id(std::move(other.id), alloc), label(std::move(other.label), alloc),
+              style(std::move(other.style), alloc), nodeIds(std::move(other.nodeIds), alloc),
+              subgraphIds(std::move(other.subgraphIds), alloc) {}
+        SubGraph(const SubGraph&) = default;
+        SubGraph(SubGraph&&) = default;
+        SubGraph& operator=(const SubGraph&) = default;
+        SubGraph& operator=(SubGraph&&) = default;
+    };
+
+    using NodeMap = std::pmr::map<String, Node, std::less<>>;
+    using StringMap = std::pmr::map<String, String, std::less<>>;
+    using ListMap = std::pmr::map<String, std::pmr::vector<String>, std::less<>>;
+    using SubgraphMap = std::pmr::map<String, SubGraph, std::less<>>;
+    // A deque grows in fixed chunks; a vector would leave every outgrown
+    // buffer behind in the arena, which never reuses memory
+    using ConnectionList = std::pmr::deque<Connection>;
+
+    static constexpr size_t defaultBlockSize = 64 * 1024;
+
+    Direction direction = Direction::LR;
+
+    // The arena starts with one block of initialBlockSize bytes and takes
+    // further, geometrically larger blocks from upstream as it fills
+    explicit ArenaChart(size_t initialBlockSize = defaultBlockSize,
+                        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    // Moving hands over the arena without touching its contents. A moved-from
+    // ArenaChart owns nothing and may only be assigned to or destroyed.
+    ArenaChart(ArenaChart&& other) noexcept;
+    ArenaChart& operator=(ArenaChart&& other) noexcept;
+    ~ArenaChart() = default;
+
+    // Same grammar and result as MermaidParser::parseContent
+    static ArenaChart parse(std::string_view content, size_t initialBlockSize = defaultBlockSize,
+                            std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    const NodeMap& nodes() const { return contents->nodes; }
+    const StringMap& nameToId() const { return contents->nameToId; }
+    const ConnectionList& connections() const { return contents->connections; }
+    const ListMap& predecessors() const { return contents->predecessors; }
+    const ListMap& successors() const { return contents->successors; }
+    const StringMap& classDefinitions() const { return contents->classDefinitions; }
+    const ListMap& nodeClasses() const { return contents->nodeClasses; }
+    const SubgraphMap& subgraphs() const { return contents->subgraphs; }
+
+    // Same semantics as the Chart methods of the same names
+    void addNode(std::string_view id, std::string_view label = {}, std::string_view style = {});
+    void addConnection(std::string_view from, std::string_view to,
+                       std::string_view label = {}, std::string_view style = {});
+    void addClass(std::string_view className, std::string_view definition);
+    void addNodeClass(std::string_view nodeId, std::string_view className);
+    // Replaces any subgraph with the same id, members included
+    void addSubgraph(std::string_view id, std::string_view label = {});
+    void addNodeToSubgraph(std::string_view nodeId, std::string_view subgraphId);
+    void setNodeLabel(std::string_view id, std::string_view label);
+
+    // Copies everything into an ordinary Chart, fingerprint included
+    Chart toChart() const;
+
+private:
+    struct Contents {
+        explicit Contents(const allocator_type& alloc)
+            : nodes(alloc), nameToId(alloc), connections(alloc), predecessors(alloc), successors(alloc),
+              classDefinitions(alloc), nodeClasses(alloc), subgraphs(alloc) {}
+
+        NodeMap nodes;
+        StringMap nameToId;
+        ConnectionList connections;
+        ListMap predecessors;
+        ListMap successors;
+        StringMap classDefinitions;
+        ListMap nodeClasses;
+        SubgraphMap subgraphs;
+    };
+
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+    Contents* contents = nullptr; // placed in the arena, never destroyed
+};
+
+#endif // ARENA_CHART_H
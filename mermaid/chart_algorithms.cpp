@@ -0,0 +1,438 @@
+#include "chart_algorithms.h"
+#include "parallel_for.h"
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+size_t NodeSet::count() const {
+    size_t total = 0;
+    for (uint64_t word : bits) {
+#ifdef _MSC_VER
+        total += __popcnt64(word);
+#else
+        total += __builtin_popcountll(word);
+#endif
+    }
+    return total;
+}
+
+std::vector<GraphAlgorithms::NodeHandle> GraphAlgorithms::topologicalSort(const ChartGraph& graph) {
+    const size_t n = graph.nodeCount();
+    std::vector<uint32_t> indegree(n);
+    for (NodeHandle node = 0; node < n; ++node) {
+        indegree[node] = static_cast<uint32_t>(graph.predecessors(node).size());
+    }
+
+    // Sources in handle order, then each node as its last predecessor is
+    // placed. The output doubles as the queue.
+    std::vector<NodeHandle> order;
+    order.reserve(n);
+    for (NodeHandle node = 0; node < n; ++node) {
+        if (indegree[node] == 0) order.push_back(node);
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+        for (NodeHandle next : graph.successors(order[head])) {
+            if (--indegree[next] == 0) order.push_back(next);
+        }
+    }
+    return order;
+}
+
+bool GraphAlgorithms::isAcyclic(const ChartGraph& graph) {
+    return topologicalSort(graph).size() == graph.nodeCount();
+}
+
+StronglyConnected GraphAlgorithms::stronglyConnectedComponents(const ChartGraph& graph) {
+    constexpr uint32_t unvisited = UINT32_MAX;
+    const size_t n = graph.nodeCount();
+    StronglyConnected result;
+    result.component.assign(n, unvisited);
+    std::vector<uint32_t> index(n, unvisited);
+    std::vector<uint32_t> lowlink(n);
+    std::vector<NodeHandle> stack;
+
+    // Frame of the simulated recursion: a node and how far through its
+    // successors the walk has got
+    struct Frame {
+        NodeHandle node;
+        uint32_t next;
+    };
+    std::vector<Frame> calls;
+    uint32_t counter = 0;
+
+    for (NodeHandle root = 0; root < n; ++root) {
+        if (index[root] != unvisited) continue;
+        calls.push_back(Frame{root, 0});
+        index[root] = lowlink[root] = counter++;
+        stack.push_back(root);
+
+        while (!calls.empty()) {
+            Frame& frame = calls.back();
+            ChartGraph::Range successors = graph.successors(frame.node);
+            if (frame.next < successors.size()) {
+                NodeHandle next = successors[frame.next++];
+                if (index[next] == unvisited) {
+                    index[next] = lowlink[next] = counter++;
+                    stack.push_back(next);
+                    calls.push_back(Frame{next, 0});
+                } else if (result.component[next] == unvisited) {
+                    // Still on the stack
+                    lowlink[frame.node] = std::min(lowlink[frame.node], index[next]);
+                }
+                continue;
+            }
+
+            NodeHandle node = frame.node;
+            calls.pop_back();
+            if (!calls.empty()) {
+                NodeHandle parent = calls.back().node;
+                lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+            }
+            if (lowlink[node] == index[node]) {
+                NodeHandle member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    result.component[member] = result.count;
+                } while (member != node);
+                ++result.count;
+            }
+        }
+    }
+    return result;
+}
+
+namespace {
+
+// Depth-first flood over one direction of the CSR adjacency
+template <typename Neighbors>
+NodeSet flood(size_t nodeCount, const std::vector<ChartGraph::NodeHandle>& starts, Neighbors&& neighbors) {
+    NodeSet seen(nodeCount);
+    std::vector<ChartGraph::NodeHandle> stack;
+    for (ChartGraph::NodeHandle start : starts) {
+        if (seen.add(start)) stack.push_back(start);
+    }
+    while (!stack.empty()) {
+        ChartGraph::NodeHandle node = stack.back();
+        stack.pop_back();
+        for (ChartGraph::NodeHandle next : neighbors(node)) {
+            if (seen.add(next)) stack.push_back(next);
+        }
+    }
+    return seen;
+}
+
+} // namespace
+
+NodeSet GraphAlgorithms::reachable(const ChartGraph& graph, NodeHandle source) {
+    return reachable(graph, std::vector<NodeHandle>{source});
+}
+
+NodeSet GraphAlgorithms::reachable(const ChartGraph& graph, const std::vector<NodeHandle>& sources) {
+    return flood(graph.nodeCount(), sources, [&](NodeHandle node) { return graph.successors(node); });
+}
+
+NodeSet GraphAlgorithms::reaching(const ChartGraph& graph, const std::vector<NodeHandle>& targets) {
+    return flood(graph.nodeCount(), targets, [&](NodeHandle node) { return graph.predecessors(node); });
+}
+
+namespace {
+
+// Graphs smaller than this are searched on one thread
+const size_t kMinParallelNodes = 1 << 16;
+// Direction switching thresholds from Beamer et al.: go bottom-up when the
+// frontier's out-edges exceed 1/alpha of the unexplored edges, and back
+// top-down when the frontier shrinks below 1/beta of the nodes
+const uint64_t kAlpha = 14;
+const uint64_t kBeta = 24;
+
+using NodeHandle = ChartGraph::NodeHandle;
+
+// One direction of the adjacency: out() is followed, in() searched by the
+// bottom-up steps
+struct Forward {
+    static constexpr bool followsSuccessors = true;
+    const ChartGraph& graph;
+    ChartGraph::Range out(NodeHandle node) const { return graph.successors(node); }
+    ChartGraph::Range in(NodeHandle node) const { return graph.predecessors(node); }
+};
+
+struct Backward {
+    static constexpr bool followsSuccessors = false;
+    const ChartGraph& graph;
+    ChartGraph::Range out(NodeHandle node) const { return graph.predecessors(node); }
+    ChartGraph::Range in(NodeHandle node) const { return graph.successors(node); }
+};
+
+size_t workerCount(unsigned threads, size_t work) {
+    if (threads != 0) return threads;
+    if (work < kMinParallelNodes) return 1;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+template <typename Adjacency>
+NodeSet directionOptimizingBfs(const ChartGraph& graph, NodeHandle source, Adjacency direction, unsigned threads) {
+    const size_t n = graph.nodeCount();
+    const size_t workers = workerCount(threads, n);
+    NodeSet visited(n);
+    NodeSet frontier(n);
+    NodeSet next(n);
+    visited.insert(source);
+
+    std::vector<NodeHandle> queue{source};
+    std::vector<NodeHandle> nextQueue;
+    uint64_t frontierSize = 1;
+    uint64_t frontierEdges = direction.out(source).size();
+    uint64_t edgesLeft = graph.edgeCount();
+    bool bottomUp = false;
+
+    // Per worker totals of a bottom-up step
+    struct StepCount {
+        uint64_t nodes = 0;
+        uint64_t edges = 0;
+    };
+    std::vector<StepCount> counts(workers);
+    const size_t words = visited.words().size();
+    // Started on the first bottom-up step and reused by the later ones
+    WorkerTeam team(workers);
+
+    while (frontierSize > 0) {
+        edgesLeft -= std::min(edgesLeft, frontierEdges);
+        if (!bottomUp && frontierEdges > edgesLeft / kAlpha) {
+            bottomUp = true;
+            frontier.clear();
+            for (NodeHandle node : queue) frontier.insert(node);
+        } else if (bottomUp && frontierSize < n / kBeta) {
+            bottomUp = false;
+            queue.clear();
+            frontier.forEach([&](NodeHandle node) { queue.push_back(node); });
+        }
+
+        if (bottomUp) {
+            // Workers own disjoint word ranges of visited and next, and only
+            // read the frontier
+            team.run([&](size_t worker) {
+                StepCount count;
+                size_t first = words * worker / workers;
+                size_t last = words * (worker + 1) / workers;
+                uint64_t* seen = visited.words().data();
+                uint64_t* found = next.words().data();
+                for (size_t w = first; w < last; ++w) {
+                    found[w] = 0;
+                    uint64_t open = ~seen[w];
+                    if (w + 1 == words && n % 64) open &= (uint64_t(1) << (n % 64)) - 1;
+                    for (; open; open &= open - 1) {
+                        NodeHandle node = static_cast<NodeHandle>(w * 64 + lowestBit(open));
+                        for (NodeHandle parent : direction.in(node)) {
+                            if (frontier.contains(parent)) {
+                                found[w] |= uint64_t(1) << (node & 63);
+                                ++count.nodes;
+                                count.edges += direction.out(node).size();
+                                break;
+                            }
+                        }
+                    }
+                    seen[w] |= found[w];
+                }
+                counts[worker] = count;
+            });
+            std::swap(frontier, next);
+            frontierSize = frontierEdges = 0;
+            for (const auto& count : counts) {
+                frontierSize += count.nodes;
+                frontierEdges += count.edges;
+            }
+        } else {
+            nextQueue.clear();
+            frontierEdges = 0;
+            for (NodeHandle node : queue) {
+                for (NodeHandle child : direction.out(node)) {
+                    if (visited.add(child)) {
+                        nextQueue.push_back(child);
+                        frontierEdges += direction.out(child).size();
+                    }
+                }
+            }
+            queue.swap(nextQueue);
+            frontierSize = queue.size();
+        }
+    }
+    return visited;
+}
+
+// Sets bit lane of result[base + lane] for every node whose mask has it
+void scatterLanes(size_t n, size_t base, size_t lanes, std::vector<NodeSet>& result,
+                  const std::function<uint64_t(NodeHandle)>& maskOf) {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        result[base + lane] = NodeSet(n);
+    }
+    for (NodeHandle node = 0; node < n; ++node) {
+        for (uint64_t lanesSeen = maskOf(node); lanesSeen; lanesSeen &= lanesSeen - 1) {
+            result[base + lowestBit(lanesSeen)].insert(node);
+        }
+    }
+}
+
+// Multi-source BFS: bit i of a node's masks stands for search i of the
+// batch. Touches only what the searches reach.
+template <typename Adjacency>
+void batchBfs(const ChartGraph& graph, const std::vector<NodeHandle>& sources, Adjacency direction,
+              size_t workers, std::vector<NodeSet>& result) {
+    const size_t n = graph.nodeCount();
+    const size_t batches = (sources.size() + 63) / 64;
+    parallelFor(workers, [&](size_t worker) {
+        std::vector<uint64_t> seen(n);
+        std::vector<uint64_t> frontier(n, 0);
+        std::vector<uint64_t> next(n, 0);
+        std::vector<NodeHandle> active;
+        std::vector<NodeHandle> nextActive;
+
+        for (size_t batch = worker; batch < batches; batch += workers) {
+            const size_t base = batch * 64;
+            const size_t lanes = std::min<size_t>(64, sources.size() - base);
+            std::fill(seen.begin(), seen.end(), 0);
+            active.clear();
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                NodeHandle source = sources[base + lane];
+                uint64_t bit = uint64_t(1) << lane;
+                if (!frontier[source]) active.push_back(source);
+                frontier[source] |= bit;
+                seen[source] |= bit;
+            }
+
+            // Each active node passes on the searches that reached it last
+            // step to the children that have not seen them yet
+            while (!active.empty()) {
+                nextActive.clear();
+                for (NodeHandle node : active) {
+                    uint64_t searches = frontier[node];
+                    frontier[node] = 0;
+                    for (NodeHandle child : direction.out(node)) {
+                        uint64_t fresh = searches & ~seen[child];
+                        if (!fresh) continue;
+                        if (!next[child]) nextActive.push_back(child);
+                        next[child] |= fresh;
+                        seen[child] |= fresh;
+                    }
+                }
+                std::swap(frontier, next);
+                active.swap(nextActive);
+            }
+            scatterLanes(n, base, lanes, result, [&](NodeHandle node) { return seen[node]; });
+        }
+    });
+}
+
+// Full batches: one sweep over the condensation per 64 searches. Component
+// masks are pushed along edges in topological order, so every edge is
+// scanned at most once per batch however deep the graph is.
+template <typename Adjacency>
+void batchSweep(const ChartGraph& graph, const std::vector<NodeHandle>& sources, Adjacency direction,
+                size_t workers, std::vector<NodeSet>& result) {
+    const size_t n = graph.nodeCount();
+    const size_t batches = (sources.size() + 63) / 64;
+    StronglyConnected scc = GraphAlgorithms::stronglyConnectedComponents(graph);
+    const uint32_t count = scc.count;
+    const std::vector<uint32_t>& component = scc.component;
+    std::vector<uint32_t> memberStart(count + 1, 0);
+    for (NodeHandle node = 0; node < n; ++node) ++memberStart[component[node] + 1];
+    for (uint32_t c = 0; c < count; ++c) memberStart[c + 1] += memberStart[c];
+    std::vector<NodeHandle> members(n);
+    {
+        std::vector<uint32_t> fill(memberStart.begin(), memberStart.end() - 1);
+        for (NodeHandle node = 0; node < n; ++node) members[fill[component[node]]++] = node;
+    }
+
+    parallelFor(workers, [&](size_t worker) {
+        std::vector<uint64_t> mask(count);
+        for (size_t batch = worker; batch < batches; batch += workers) {
+            const size_t base = batch * 64;
+            const size_t lanes = std::min<size_t>(64, sources.size() - base);
+            std::fill(mask.begin(), mask.end(), 0);
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                mask[component[sources[base + lane]]] |= uint64_t(1) << lane;
+            }
+            // Tarjan numbers components sinks first
+            for (uint32_t step = 0; step < count; ++step) {
+                uint32_t c = Adjacency::followsSuccessors ? count - 1 - step : step;
+                uint64_t searches = mask[c];
+                if (!searches) continue;
+                for (uint32_t m = memberStart[c]; m < memberStart[c + 1]; ++m) {
+                    for (NodeHandle child : direction.out(members[m])) {
+                        mask[component[child]] |= searches;
+                    }
+                }
+            }
+            scatterLanes(n, base, lanes, result, [&](NodeHandle node) { return mask[component[node]]; });
+        }
+    });
+}
+
+template <typename Adjacency>
+std::vector<NodeSet> reachableOfEach(const ChartGraph& graph, const std::vector<NodeHandle>& sources,
+                                     Adjacency direction, unsigned threads) {
+    const size_t batches = (sources.size() + 63) / 64;
+    const size_t workers = std::min(workerCount(threads, graph.nodeCount() * batches), std::max<size_t>(batches, 1));
+    std::vector<NodeSet> result(sources.size());
+    if (sources.size() < 64) {
+        batchBfs(graph, sources, direction, workers, result);
+    } else {
+        batchSweep(graph, sources, direction, workers, result);
+    }
+    return result;
+}
+
+} // namespace
+
+NodeSet GraphAlgorithms::downstream(const ChartGraph& graph, NodeHandle source, unsigned threads) {
+    return directionOptimizingBfs(graph, source, Forward{graph}, threads);
+}
+
+NodeSet GraphAlgorithms::upstream(const ChartGraph& graph, NodeHandle target, unsigned threads) {
+    return directionOptimizingBfs(graph, target, Backward{graph}, threads);
+}
+
+std::vector<NodeSet> GraphAlgorithms::downstreamOfEach(const ChartGraph& graph,
+                                                       const std::vector<NodeHandle>& sources, unsigned threads) {
+    return reachableOfEach(graph, sources, Forward{graph}, threads);
+}
+
+std::vector<NodeSet> GraphAlgorithms::upstreamOfEach(const ChartGraph& graph,
+                                                     const std::vector<NodeHandle>& targets, unsigned threads) {
+    return reachableOfEach(graph, targets, Backward{graph}, threads);
+}
+
+std::vector<uint32_t> GraphAlgorithms::longestPathLengths(const ChartGraph& graph) {
+    std::vector<NodeHandle> order = topologicalSort(graph);
+    if (order.size() != graph.nodeCount()) {
+        throw std::runtime_error("Longest path requires an acyclic graph");
+    }
+    std::vector<uint32_t> length(graph.nodeCount(), 0);
+    for (NodeHandle node : order) {
+        for (NodeHandle next : graph.successors(node)) {
+            length[next] = std::max(length[next], length[node] + 1);
+        }
+    }
+    return length;
+}
+
+std::vector<GraphAlgorithms::NodeHandle> GraphAlgorithms::longestPath(const ChartGraph& graph) {
+    std::vector<uint32_t> length = longestPathLengths(graph);
+    if (length.empty()) return {};
+
+    // Walk back from the end of a longest path through predecessors one
+    // step shorter
+    NodeHandle node = static_cast<NodeHandle>(std::max_element(length.begin(), length.end()) - length.begin());
+    std::vector<NodeHandle> path{node};
+    while (length[node] > 0) {
+        for (NodeHandle previous : graph.predecessors(node)) {
+            if (length[previous] + 1 == length[node]) {
+                node = previous;
+                break;
+            }
+        }
+        path.push_back(node);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
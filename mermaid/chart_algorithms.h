@@ -0,0 +1,123 @@
+#ifndef CHART_ALGORITHMS_H
+#define CHART_ALGORITHMS_H
+
+#include "chart_graph.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit; word must not be zero
+inline unsigned lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+// Packed set of node handles, one bit per node
+class NodeSet {
+public:
+    using NodeHandle = ChartGraph::NodeHandle;
+
+    NodeSet() = default;
+    explicit NodeSet(size_t size) : bits((size + 63) / 64, 0), universe(size) {}
+
+    size_t size() const { return universe; }
+    bool contains(NodeHandle node) const { return (bits[node >> 6] >> (node & 63)) & 1; }
+    void insert(NodeHandle node) { bits[node >> 6] |= uint64_t(1) << (node & 63); }
+    // Inserts node and returns true if it was not already present
+    bool add(NodeHandle node) {
+        uint64_t mask = uint64_t(1) << (node & 63);
+        uint64_t& word = bits[node >> 6];
+        if (word & mask) return false;
+        word |= mask;
+        return true;
+    }
+    void clear() { std::fill(bits.begin(), bits.end(), 0); }
+    size_t count() const;
+
+    // Calls fn(node) for each member in ascending order
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t w = 0; w < bits.size(); ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                fn(static_cast<NodeHandle>(w * 64 + lowestBit(word)));
+            }
+        }
+    }
+
+    std::vector<uint64_t>& words() { return bits; }
+    const std::vector<uint64_t>& words() const { return bits; }
+
+private:
+    std::vector<uint64_t> bits;
+    size_t universe = 0;
+};
+
+// Strongly connected components, numbered in reverse topological order of
+// the condensation: every edge between components goes from a higher
+// number to a lower one
+struct StronglyConnected {
+    std::vector<uint32_t> component; // per node
+    uint32_t count = 0;
+};
+
+// Graph algorithms over the dense handles of a ChartGraph. Build the graph
+// once with ChartGraph(chart) and run any number of queries on it; none of
+// them touch strings.
+class GraphAlgorithms {
+public:
+    using NodeHandle = ChartGraph::NodeHandle;
+
+    // Kahn's algorithm; ties are broken by handle, so the order is
+    // deterministic. Nodes on or downstream of a cycle are left out, so the
+    // result is shorter than nodeCount() exactly when the graph is cyclic.
+    static std::vector<NodeHandle> topologicalSort(const ChartGraph& graph);
+    static bool isAcyclic(const ChartGraph& graph);
+
+    // Tarjan's algorithm with an explicit stack, so deep graphs cannot
+    // overflow the call stack
+    static StronglyConnected stronglyConnectedComponents(const ChartGraph& graph);
+
+    // Everything reachable from the sources, sources included
+    static NodeSet reachable(const ChartGraph& graph, NodeHandle source);
+    static NodeSet reachable(const ChartGraph& graph, const std::vector<NodeHandle>& sources);
+    // Everything that reaches the targets, targets included
+    static NodeSet reaching(const ChartGraph& graph, const std::vector<NodeHandle>& targets);
+
+    // Breadth-first search that switches between top-down steps (expand the
+    // frontier's out-edges) and bottom-up steps (each unvisited node looks
+    // for a parent in the frontier bitset) depending on which touches fewer
+    // edges. Bottom-up steps are split across threads by 64-node words;
+    // threads = 0 uses one per core for graphs large enough to benefit.
+    // The result equals reachable(graph, source).
+    static NodeSet downstream(const ChartGraph& graph, NodeHandle source, unsigned threads = 0);
+    static NodeSet upstream(const ChartGraph& graph, NodeHandle target, unsigned threads = 0);
+
+    // One reachable set per source, answered 64 sources at a time: each
+    // node carries a 64-bit mask of the searches that reached it, so an edge
+    // is scanned once for all of them. A partial batch is a multi-source BFS;
+    // full batches sweep the strongly connected components in topological
+    // order, which costs one pass over the edges per 64 sources however deep
+    // the graph is. Batches run on separate threads.
+    static std::vector<NodeSet> downstreamOfEach(const ChartGraph& graph, const std::vector<NodeHandle>& sources,
+                                                 unsigned threads = 0);
+    static std::vector<NodeSet> upstreamOfEach(const ChartGraph& graph, const std::vector<NodeHandle>& targets,
+                                               unsigned threads = 0);
+
+    // Number of edges on the longest path ending at each node. Throws
+    // std::runtime_error if the graph has a cycle.
+    static std::vector<uint32_t> longestPathLengths(const ChartGraph& graph);
+    // One longest path, as nodes from start to end; empty for an empty graph
+    static std::vector<NodeHandle> longestPath(const ChartGraph& graph);
+};
+
+#endif // CHART_ALGORITHMS_H
@@ -0,0 +1,125 @@
+#include "chart_builder.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// Indices of items in ascending key order; equal keys keep insertion order
+template <typename T, typename Key>
+std::vector<uint32_t> sortedOrder(const std::vector<T>& items, Key key) {
+    std::vector<uint32_t> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return key(items[a]) < key(items[b]);
+    });
+    return order;
+}
+
+// One adjacency map entry per distinct endpoint, created in key order; the
+// vectors are reserved and left empty for the caller to fill
+std::vector<std::vector<std::string>*> createAdjacency(
+    std::map<std::string, std::vector<std::string>, std::less<>>& adjacency,
+    const std::vector<const std::string*>& keys, const std::vector<uint32_t>& keyOrder,
+    const std::vector<uint32_t>& slotOfEdge) {
+    std::vector<uint32_t> degree(keys.size(), 0);
+    for (uint32_t slot : slotOfEdge) ++degree[slot];
+    std::vector<std::vector<std::string>*> lists(keys.size(), nullptr);
+    for (uint32_t slot : keyOrder) {
+        if (!degree[slot]) continue;
+        auto it = adjacency.emplace_hint(adjacency.end(), *keys[slot], std::vector<std::string>());
+        it->second.reserve(degree[slot]);
+        lists[slot] = &it->second;
+    }
+    return lists;
+}
+
+} // namespace
+
+void ChartBuilder::reserve(size_t nodeCount, size_t connectionCount) {
+    nodes.reserve(nodeCount);
+    connections.reserve(connectionCount);
+}
+
+void ChartBuilder::addNodes(std::vector<Node> batch) {
+    if (nodes.empty()) {
+        nodes = std::move(batch);
+        return;
+    }
+    nodes.insert(nodes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+}
+
+void ChartBuilder::addConnections(std::vector<Connection> batch) {
+    if (connections.empty()) {
+        connections = std::move(batch);
+        return;
+    }
+    connections.insert(connections.end(), std::make_move_iterator(batch.begin()),
+                       std::make_move_iterator(batch.end()));
+}
+
+Chart ChartBuilder::build() {
+    Chart chart;
+    chart.direction = direction;
+
+    // nameToId: the last labeled node wins, whether or not it survives below
+    std::vector<uint32_t> labeled;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (!nodes[i].label.empty()) labeled.push_back(i);
+    }
+    std::stable_sort(labeled.begin(), labeled.end(), [&](uint32_t a, uint32_t b) {
+        return nodes[a].label < nodes[b].label;
+    });
+    for (size_t i = 0; i < labeled.size(); ++i) {
+        const Node& node = nodes[labeled[i]];
+        if (i + 1 < labeled.size() && nodes[labeled[i + 1]].label == node.label) continue;
+        chart.nameToId.emplace_hint(chart.nameToId.end(), node.label, node.id);
+    }
+
+    // nodes: the last node with each id wins
+    std::vector<uint32_t> order = sortedOrder(nodes, [](const Node& node) -> const std::string& { return node.id; });
+    for (size_t i = 0; i < order.size(); ++i) {
+        Node& node = nodes[order[i]];
+        if (i + 1 < order.size() && nodes[order[i + 1]].id == node.id) continue;
+        chart.hashNode(node, true);
+        std::string id = node.id;
+        chart.nodes.emplace_hint(chart.nodes.end(), std::move(id), std::move(node));
+    }
+
+    // successors and predecessors: endpoints are grouped by hashing, so only
+    // the distinct ids are sorted, and each list is filled in connection order
+    std::unordered_map<std::string_view, uint32_t> slots;
+    slots.reserve(chart.nodes.size() + connections.size() / 4);
+    std::vector<const std::string*> keys;
+    std::vector<uint32_t> fromSlot(connections.size());
+    std::vector<uint32_t> toSlot(connections.size());
+    auto slotOf = [&](const std::string& id) {
+        auto [it, inserted] = slots.try_emplace(id, static_cast<uint32_t>(keys.size()));
+        if (inserted) keys.push_back(&id);
+        return it->second;
+    };
+    for (size_t i = 0; i < connections.size(); ++i) {
+        fromSlot[i] = slotOf(connections[i].from);
+        toSlot[i] = slotOf(connections[i].to);
+    }
+    std::vector<uint32_t> keyOrder(keys.size());
+    std::iota(keyOrder.begin(), keyOrder.end(), 0);
+    std::sort(keyOrder.begin(), keyOrder.end(), [&](uint32_t a, uint32_t b) { return *keys[a] < *keys[b]; });
+    auto successors = createAdjacency(chart.successors, keys, keyOrder, fromSlot);
+    auto predecessors = createAdjacency(chart.predecessors, keys, keyOrder, toSlot);
+    for (size_t i = 0; i < connections.size(); ++i) {
+        successors[fromSlot[i]]->push_back(connections[i].to);
+        predecessors[toSlot[i]]->push_back(connections[i].from);
+    }
+    for (const auto& conn : connections) {
+        chart.hashConnection(conn, true);
+    }
+    chart.connections = std::move(connections);
+
+    nodes = std::vector<Node>();
+    connections = std::vector<Connection>();
+    return chart;
+}
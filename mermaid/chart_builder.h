@@ -0,0 +1,44 @@
+#ifndef CHART_BUILDER_H
+#define CHART_BUILDER_H
+
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <vector>
+
+// Collects nodes and connections in bulk and produces a finished Chart in
+// one pass. Chart::addConnection does two map insertions per edge and
+// Chart::addNode one or two per node; here the records are only appended,
+// and build() sorts them once and fills every map in key order with
+// emplace_hint, so each insertion is amortized O(1).
+//
+// The result is identical to calling chart.addNode and chart.addConnection
+// in the order the records were added: a repeated node id keeps the last
+// node, nameToId maps each label to the last node that carried it,
+// connections keep their order (duplicates included) and the adjacency
+// lists follow it. Classes and subgraphs can be added to the built Chart
+// as usual.
+class ChartBuilder {
+public:
+    explicit ChartBuilder(Direction direction = Direction::LR) : direction(direction) {}
+
+    void reserve(size_t nodes, size_t connections);
+
+    void addNode(Node node) { nodes.push_back(std::move(node)); }
+    void addConnection(Connection conn) { connections.push_back(std::move(conn)); }
+    // Appends a whole batch; pass an rvalue to move the strings in
+    void addNodes(std::vector<Node> batch);
+    void addConnections(std::vector<Connection> batch);
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t connectionCount() const { return connections.size(); }
+
+    // Leaves the builder empty
+    Chart build();
+
+private:
+    Direction direction;
+    std::vector<Node> nodes;
+    std::vector<Connection> connections;
+};
+
+#endif // CHART_BUILDER_H
@@ -0,0 +1,276 @@
+#include "chart_diff.h"
+#include "edge_key.h"
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Walks two sorted ranges in step, calling onlyFirst, onlySecond or both for
+// each key
+template <typename It, typename Key, typename OnlyFirst, typename OnlySecond, typename Both>
+void mergeWalk(It a, It aEnd, It b, It bEnd, Key key, OnlyFirst onlyFirst, OnlySecond onlySecond, Both both) {
+    while (a != aEnd || b != bEnd) {
+        if (b == bEnd || (a != aEnd && key(*a) < key(*b))) {
+            onlyFirst(*a++);
+        } else if (a == aEnd || key(*b) < key(*a)) {
+            onlySecond(*b++);
+        } else {
+            both(*a++, *b++);
+        }
+    }
+}
+
+template <typename Map, typename OnlyFirst, typename OnlySecond, typename Both>
+void mergeMaps(const Map& a, const Map& b, OnlyFirst onlyFirst, OnlySecond onlySecond, Both both) {
+    mergeWalk(a.begin(), a.end(), b.begin(), b.end(),
+              [](const typename Map::value_type& entry) -> const std::string& { return entry.first; },
+              onlyFirst, onlySecond, both);
+}
+
+// A node's classes as a set, ignoring order and repeats
+std::vector<std::string_view> classSet(const std::vector<std::string>& classes) {
+    std::vector<std::string_view> set(classes.begin(), classes.end());
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    return set;
+}
+
+} // namespace
+
+ChartDiff ChartDiff::compute(const Chart& before, const Chart& after) {
+    ChartDiff diff;
+    diff.directionChanged = before.direction != after.direction;
+    diff.direction = after.direction;
+
+    using NodeEntry = std::pair<const std::string, Node>;
+    mergeMaps(
+        before.nodes, after.nodes, [&](const NodeEntry& entry) { diff.removedNodes.push_back(entry.second); },
+        [&](const NodeEntry& entry) { diff.addedNodes.push_back(entry.second); },
+        [&](const NodeEntry& a, const NodeEntry& b) {
+            if (before.normalizeLabel(a.second.label) != after.normalizeLabel(b.second.label)) {
+                diff.relabeledNodes.push_back(Change{a.first, a.second.label, b.second.label});
+            }
+        });
+
+    // Connections are a multiset: count the old ones, cancel them against
+    // the new ones, and whatever is left over on either side changed
+    std::unordered_map<EdgeKey, size_t, EdgeKeyHash> unmatched;
+    unmatched.reserve(before.connections.size());
+    for (const auto& conn : before.connections) {
+        ++unmatched[EdgeKey::of(conn)];
+    }
+    for (const auto& conn : after.connections) {
+        auto it = unmatched.find(EdgeKey::of(conn));
+        if (it != unmatched.end() && it->second) {
+            --it->second;
+        } else {
+            diff.addedConnections.push_back(conn);
+        }
+    }
+    for (const auto& conn : before.connections) {
+        auto it = unmatched.find(EdgeKey::of(conn));
+        if (it->second) {
+            --it->second;
+            diff.removedConnections.push_back(conn);
+        }
+    }
+
+    using SubgraphEntry = std::pair<const std::string, SubGraph>;
+    mergeMaps(
+        before.subgraphs, after.subgraphs,
+        [&](const SubgraphEntry& entry) { diff.removedSubgraphs.push_back(entry.second); },
+        [&](const SubgraphEntry& entry) { diff.addedSubgraphs.push_back(entry.second); },
+        [&](const SubgraphEntry& a, const SubgraphEntry& b) {
+            const std::string& id = a.first;
+            if (a.second.label != b.second.label) {
+                diff.relabeledSubgraphs.push_back(Change{id, a.second.label, b.second.label});
+            }
+            const auto& x = a.second.nodeIds;
+            const auto& y = b.second.nodeIds;
+            mergeWalk(
+                x.begin(), x.end(), y.begin(), y.end(), [](const std::string& nodeId) -> const std::string& { return nodeId; },
+                [&](const std::string& nodeId) { diff.removedMembers.push_back(Pair{id, nodeId}); },
+                [&](const std::string& nodeId) { diff.addedMembers.push_back(Pair{id, nodeId}); },
+                [](const std::string&, const std::string&) {});
+        });
+
+    using ClassEntry = std::pair<const std::string, std::string>;
+    mergeMaps(
+        before.classDefinitions, after.classDefinitions,
+        [&](const ClassEntry& entry) { diff.removedClasses.push_back(Change{entry.first, entry.second, std::string()}); },
+        [&](const ClassEntry& entry) { diff.addedClasses.push_back(Change{entry.first, std::string(), entry.second}); },
+        [&](const ClassEntry& a, const ClassEntry& b) {
+            if (a.second != b.second && before.normalizeCss(a.second) != after.normalizeCss(b.second)) {
+                diff.changedClasses.push_back(Change{a.first, a.second, b.second});
+            }
+        });
+
+    using NodeClassEntry = std::pair<const std::string, std::vector<std::string>>;
+    auto compareClasses = [&](const std::string& nodeId, const std::vector<std::string>& a,
+                              const std::vector<std::string>& b) {
+        std::vector<std::string_view> x = classSet(a);
+        std::vector<std::string_view> y = classSet(b);
+        mergeWalk(
+            x.begin(), x.end(), y.begin(), y.end(), [](std::string_view name) { return name; },
+            [&](std::string_view name) { diff.removedNodeClasses.push_back(Pair{nodeId, std::string(name)}); },
+            [&](std::string_view name) { diff.addedNodeClasses.push_back(Pair{nodeId, std::string(name)}); },
+            [](std::string_view, std::string_view) {});
+    };
+    const std::vector<std::string> none;
+    mergeMaps(
+        before.nodeClasses, after.nodeClasses,
+        [&](const NodeClassEntry& entry) { compareClasses(entry.first, entry.second, none); },
+        [&](const NodeClassEntry& entry) { compareClasses(entry.first, none, entry.second); },
+        [&](const NodeClassEntry& a, const NodeClassEntry& b) { compareClasses(a.first, a.second, b.second); });
+
+    return diff;
+}
+
+size_t ChartDiff::size() const {
+    return (directionChanged ? 1 : 0) + addedNodes.size() + removedNodes.size() + relabeledNodes.size() +
+           addedConnections.size() + removedConnections.size() + addedSubgraphs.size() +
+           removedSubgraphs.size() + relabeledSubgraphs.size() + addedMembers.size() + removedMembers.size() +
+           addedClasses.size() + removedClasses.size() + changedClasses.size() + addedNodeClasses.size() +
+           removedNodeClasses.size();
+}
+
+void ChartDiff::apply(Chart& chart) const {
+    if (directionChanged) {
+        chart.direction = direction;
+    }
+
+    // Connections: drop the earliest matches in one pass, then rebuild the
+    // adjacency lists of the endpoints involved in another
+    if (!removedConnections.empty()) {
+        std::unordered_map<EdgeKey, size_t, EdgeKeyHash> pending;
+        std::unordered_set<std::string_view> affected;
+        for (const auto& conn : removedConnections) {
+            ++pending[EdgeKey::of(conn)];
+            affected.insert(conn.from);
+            affected.insert(conn.to);
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < chart.connections.size(); ++i) {
+            Connection& conn = chart.connections[i];
+            auto it = pending.find(EdgeKey::of(conn));
+            if (it != pending.end() && it->second) {
+                --it->second;
+                chart.hashConnection(conn, false);
+                continue;
+            }
+            if (kept != i) {
+                chart.connections[kept] = std::move(conn);
+            }
+            ++kept;
+        }
+        chart.connections.resize(kept);
+        if (chart.deduplicate) {
+            chart.indexConnections();
+        }
+
+        for (std::string_view id : affected) {
+            if (auto it = chart.successors.find(id); it != chart.successors.end()) it->second.clear();
+            if (auto it = chart.predecessors.find(id); it != chart.predecessors.end()) it->second.clear();
+        }
+        for (const auto& conn : chart.connections) {
+            if (affected.count(conn.from)) chart.successors[conn.from].push_back(conn.to);
+            if (affected.count(conn.to)) chart.predecessors[conn.to].push_back(conn.from);
+        }
+        for (std::string_view id : affected) {
+            if (auto it = chart.successors.find(id); it != chart.successors.end() && it->second.empty()) {
+                chart.successors.erase(it);
+            }
+            if (auto it = chart.predecessors.find(id); it != chart.predecessors.end() && it->second.empty()) {
+                chart.predecessors.erase(it);
+            }
+        }
+    }
+    for (const auto& conn : addedConnections) {
+        chart.addConnection(conn);
+    }
+
+    if (!removedNodes.empty()) {
+        std::unordered_set<std::string_view> removed;
+        for (const auto& node : removedNodes) {
+            auto it = chart.nodes.find(node.id);
+            if (it == chart.nodes.end()) continue;
+            chart.hashNode(it->second, false);
+            chart.nodes.erase(it);
+            removed.insert(node.id);
+        }
+        for (auto it = chart.nameToId.begin(); it != chart.nameToId.end();) {
+            it = removed.count(it->second) ? chart.nameToId.erase(it) : std::next(it);
+        }
+    }
+    for (const auto& node : addedNodes) {
+        chart.addNode(node);
+    }
+    for (const auto& change : relabeledNodes) {
+        chart.setNodeLabel(change.key, change.after);
+    }
+
+    for (const auto& subgraph : removedSubgraphs) {
+        auto it = chart.subgraphs.find(subgraph.id);
+        if (it == chart.subgraphs.end()) continue;
+        chart.hashSubgraphHeader(it->second, false);
+        for (const auto& nodeId : it->second.nodeIds) {
+            chart.hashSubgraphMember(it->first, nodeId, false);
+        }
+        chart.subgraphs.erase(it);
+    }
+    for (const auto& subgraph : addedSubgraphs) {
+        chart.addSubgraph(subgraph);
+    }
+    for (const auto& change : relabeledSubgraphs) {
+        auto it = chart.subgraphs.find(change.key);
+        if (it == chart.subgraphs.end()) continue;
+        chart.hashSubgraphHeader(it->second, false);
+        it->second.label = change.after;
+        chart.hashSubgraphHeader(it->second, true);
+    }
+    for (const auto& member : removedMembers) {
+        auto it = chart.subgraphs.find(member.first);
+        if (it != chart.subgraphs.end() && it->second.nodeIds.erase(member.second)) {
+            chart.hashSubgraphMember(member.first, member.second, false);
+        }
+    }
+    for (const auto& member : addedMembers) {
+        auto it = chart.subgraphs.find(member.first);
+        if (it != chart.subgraphs.end() && it->second.nodeIds.insert(member.second).second) {
+            chart.hashSubgraphMember(member.first, member.second, true);
+        }
+    }
+
+    for (const auto& change : removedClasses) {
+        auto it = chart.classDefinitions.find(change.key);
+        if (it == chart.classDefinitions.end()) continue;
+        chart.hashClassDefinition(it->first, it->second, false);
+        chart.classDefinitions.erase(it);
+    }
+    for (const auto& change : addedClasses) {
+        chart.addClass(change.key, change.after);
+    }
+    for (const auto& change : changedClasses) {
+        chart.addClass(change.key, change.after);
+    }
+
+    for (const auto& assignment : removedNodeClasses) {
+        auto it = chart.nodeClasses.find(assignment.first);
+        if (it == chart.nodeClasses.end()) continue;
+        auto& classes = it->second;
+        auto end = std::remove(classes.begin(), classes.end(), assignment.second);
+        if (end == classes.end()) continue;
+        chart.hashNodeClass(it->first, assignment.second, false);
+        classes.erase(end, classes.end());
+        if (classes.empty()) {
+            chart.hashNodeClassKey(it->first, false);
+            chart.nodeClasses.erase(it);
+        }
+    }
+    for (const auto& assignment : addedNodeClasses) {
+        chart.addNodeClass(assignment.first, assignment.second);
+    }
+}
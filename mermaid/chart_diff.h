@@ -0,0 +1,71 @@
+#ifndef CHART_DIFF_H
+#define CHART_DIFF_H
+
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// What changed between two versions of a chart, in exactly the terms
+// semanticEquals compares: node labels (ignoring quotes), connections as a
+// multiset of (from, to, label) ignoring arrow style, subgraph labels and
+// membership, class definitions (ignoring CSS spacing) and the set of
+// classes on each node. compute(a, b).empty() == a.semanticEquals(b), and
+// applying the diff to a yields a chart semantically equal to b.
+//
+// Computing a diff is one merge walk over the sorted maps plus one hash
+// pass over the connections, so it is linear in the size of both charts.
+// Every list is minimal: a node whose label changed is one relabel, not a
+// removal and an addition, and a connection that appears twice before and
+// three times after is one addition.
+class ChartDiff {
+public:
+    // A keyed value that exists on both sides but differs
+    struct Change {
+        std::string key;
+        std::string before;
+        std::string after;
+    };
+
+    // A (subgraph, node) membership or a (node, class) assignment
+    struct Pair {
+        std::string first;
+        std::string second;
+
+        bool operator==(const Pair& other) const { return first == other.first && second == other.second; }
+    };
+
+    bool directionChanged = false;
+    Direction direction = Direction::LR; // the new direction
+
+    std::vector<Node> addedNodes;            // in id order
+    std::vector<Node> removedNodes;
+    std::vector<Change> relabeledNodes;      // key is the node id
+    std::vector<Connection> addedConnections;   // with the new chart's style
+    std::vector<Connection> removedConnections;
+    std::vector<SubGraph> addedSubgraphs;       // members included
+    std::vector<SubGraph> removedSubgraphs;
+    std::vector<Change> relabeledSubgraphs;
+    std::vector<Pair> addedMembers;          // (subgraph, node) for subgraphs on both sides
+    std::vector<Pair> removedMembers;
+    std::vector<Change> addedClasses;        // key is the class, after the definition
+    std::vector<Change> removedClasses;      // key is the class, before the definition
+    std::vector<Change> changedClasses;
+    std::vector<Pair> addedNodeClasses;      // (node, class)
+    std::vector<Pair> removedNodeClasses;
+
+    static ChartDiff compute(const Chart& before, const Chart& after);
+
+    bool empty() const { return size() == 0; }
+    // Number of individual edits
+    size_t size() const;
+
+    // Turns the "before" chart into one semantically equal to "after",
+    // keeping adjacency lists and the fingerprint up to date. Removed
+    // connections take the earliest matching ones; removed nodes also drop
+    // the nameToId entries that point at them.
+    void apply(Chart& chart) const;
+};
+
+#endif // CHART_DIFF_H
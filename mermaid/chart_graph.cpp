@@ -0,0 +1,175 @@
+#include "chart_graph.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+// StringInterner implementation
+namespace {
+
+const size_t kMinBlockSize = 64 * 1024;
+
+} // namespace
+
+StringId StringInterner::intern(std::string_view str) {
+    if ((strings.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+    size_t slot = slotFor(str, std::hash<std::string_view>{}(str));
+    if (slots[slot]) {
+        return slots[slot] - 1;
+    }
+
+    if (blockUsed + str.size() > blockSize) {
+        blockSize = std::max(kMinBlockSize, str.size());
+        blocks.emplace_back(new char[blockSize]);
+        blockBytes += blockSize;
+        blockUsed = 0;
+    }
+    char* copy = blocks.empty() ? nullptr : blocks.back().get() + blockUsed;
+    if (!str.empty()) {
+        std::memcpy(copy, str.data(), str.size());
+    }
+    blockUsed += str.size();
+
+    StringId id = static_cast<StringId>(strings.size());
+    strings.emplace_back(copy, str.size());
+    slots[slot] = id + 1;
+    return id;
+}
+
+StringId StringInterner::find(std::string_view str) const {
+    if (slots.empty()) return npos;
+    size_t slot = slotFor(str, std::hash<std::string_view>{}(str));
+    return slots[slot] ? slots[slot] - 1 : npos;
+}
+
+size_t StringInterner::memoryUsage() const {
+    return blockBytes + blocks.capacity() * sizeof(blocks[0]) +
+           strings.capacity() * sizeof(strings[0]) + slots.capacity() * sizeof(slots[0]);
+}
+
+size_t StringInterner::slotFor(std::string_view str, size_t hash) const {
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] && strings[slots[slot] - 1] != str) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void StringInterner::grow() {
+    std::vector<StringId> old(std::max<size_t>(16, slots.size() * 2), 0);
+    old.swap(slots);
+    for (StringId id = 0; id < strings.size(); ++id) {
+        slots[slotFor(strings[id], std::hash<std::string_view>{}(strings[id]))] = id + 1;
+    }
+}
+
+// ChartGraph implementation
+ChartGraph::ChartGraph(const Chart& chart) {
+    ChartGraphBuilder builder;
+    builder.reserve(chart.nodes.size(), chart.connections.size());
+    for (const auto& [id, node] : chart.nodes) {
+        builder.addNode(id, node.label);
+    }
+    for (const auto& conn : chart.connections) {
+        builder.addEdge(conn.from, conn.to, conn.label, conn.style);
+    }
+    *this = builder.build();
+}
+
+ChartGraph::NodeHandle ChartGraph::find(std::string_view id) const {
+    StringId sid = strings.find(id);
+    if (sid == StringInterner::npos || sid >= handleOfString.size()) return npos;
+    return handleOfString[sid];
+}
+
+ChartGraph::Range ChartGraph::successors(NodeHandle node) const {
+    const NodeHandle* base = successorTargets.data();
+    return Range(base + successorOffsets[node], base + successorOffsets[node + 1]);
+}
+
+ChartGraph::Range ChartGraph::predecessors(NodeHandle node) const {
+    const NodeHandle* base = predecessorSources.data();
+    return Range(base + predecessorOffsets[node], base + predecessorOffsets[node + 1]);
+}
+
+ChartGraph::IdRange ChartGraph::successorIds(std::string_view id) const {
+    NodeHandle node = find(id);
+    return IdRange(this, node == npos ? Range(nullptr, nullptr) : successors(node));
+}
+
+ChartGraph::IdRange ChartGraph::predecessorIds(std::string_view id) const {
+    NodeHandle node = find(id);
+    return IdRange(this, node == npos ? Range(nullptr, nullptr) : predecessors(node));
+}
+
+size_t ChartGraph::memoryUsage() const {
+    auto bytes = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+    return strings.memoryUsage() + bytes(nodeIds) + bytes(nodeLabels) + bytes(handleOfString) +
+           bytes(edgeFrom) + bytes(edgeTo) + bytes(edgeLabels) + bytes(edgeStyles) +
+           bytes(successorOffsets) + bytes(successorTargets) +
+           bytes(predecessorOffsets) + bytes(predecessorSources);
+}
+
+// ChartGraphBuilder implementation
+ChartGraphBuilder::NodeHandle ChartGraphBuilder::addNode(std::string_view id, std::string_view label) {
+    StringId sid = graph.strings.intern(id);
+    if (sid >= graph.handleOfString.size()) {
+        graph.handleOfString.resize(graph.strings.size(), ChartGraph::npos);
+    }
+    NodeHandle node = graph.handleOfString[sid];
+    if (node == ChartGraph::npos) {
+        node = static_cast<NodeHandle>(graph.nodeIds.size());
+        graph.handleOfString[sid] = node;
+        graph.nodeIds.push_back(sid);
+        graph.nodeLabels.push_back(graph.strings.intern(label));
+    } else if (!label.empty()) {
+        graph.nodeLabels[node] = graph.strings.intern(label);
+    }
+    return node;
+}
+
+void ChartGraphBuilder::addEdge(std::string_view from, std::string_view to,
+                                std::string_view label, std::string_view style) {
+    NodeHandle fromNode = addNode(from);
+    NodeHandle toNode = addNode(to);
+    graph.edgeFrom.push_back(fromNode);
+    graph.edgeTo.push_back(toNode);
+    graph.edgeLabels.push_back(graph.strings.intern(label));
+    graph.edgeStyles.push_back(graph.strings.intern(style));
+}
+
+void ChartGraphBuilder::reserve(size_t nodes, size_t edges) {
+    graph.nodeIds.reserve(nodes);
+    graph.nodeLabels.reserve(nodes);
+    graph.edgeFrom.reserve(edges);
+    graph.edgeTo.reserve(edges);
+    graph.edgeLabels.reserve(edges);
+    graph.edgeStyles.reserve(edges);
+}
+
+ChartGraph ChartGraphBuilder::build() {
+    ChartGraph result = std::move(graph);
+    graph = ChartGraph();
+    result.handleOfString.resize(result.strings.size(), ChartGraph::npos);
+
+    // Counting sort of the edge list by endpoint keeps connection order
+    // within each neighbor run
+    size_t nodeCount = result.nodeIds.size();
+    size_t edgeCount = result.edgeFrom.size();
+    auto buildCsr = [&](const std::vector<NodeHandle>& keys, const std::vector<NodeHandle>& values,
+                        std::vector<uint32_t>& offsets, std::vector<NodeHandle>& targets) {
+        offsets.assign(nodeCount + 1, 0);
+        for (NodeHandle key : keys) ++offsets[key + 1];
+        for (size_t i = 0; i < nodeCount; ++i) offsets[i + 1] += offsets[i];
+        targets.resize(edgeCount);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t e = 0; e < edgeCount; ++e) {
+            targets[cursor[keys[e]]++] = values[e];
+        }
+    };
+    buildCsr(result.edgeFrom, result.edgeTo, result.successorOffsets, result.successorTargets);
+    buildCsr(result.edgeTo, result.edgeFrom, result.predecessorOffsets, result.predecessorSources);
+    return result;
+}
@@ -0,0 +1,160 @@
+#ifndef CHART_GRAPH_H
+#define CHART_GRAPH_H
+
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Dense handle for an interned string
+using StringId = uint32_t;
+
+// Interns strings into append-only blocks and hands out dense ids. Views
+// returned by str() stay valid for the lifetime of the interner.
+class StringInterner {
+public:
+    static constexpr StringId npos = UINT32_MAX;
+
+    StringId intern(std::string_view str);
+    StringId find(std::string_view str) const;
+    std::string_view str(StringId id) const { return strings[id]; }
+    size_t size() const { return strings.size(); }
+    size_t memoryUsage() const;
+
+private:
+    size_t slotFor(std::string_view str, size_t hash) const;
+    void grow();
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    size_t blockSize = 0;
+    size_t blockBytes = 0;
+    std::vector<std::string_view> strings;
+    std::vector<StringId> slots; // open addressing, id + 1 (0 is empty)
+};
+
+// Compact, immutable graph core for a Chart. Node ids are interned into dense
+// uint32_t handles and adjacency is stored in CSR form (an offset array plus
+// one flat array of neighbor handles per direction). Neighbors keep the order
+// of Chart::connections, so successors(h) lists the same ids, in the same
+// order, as Chart::successors[id]. It is a copy built beside the Chart, not
+// a replacement for the Chart's maps, which keep their own memory.
+class ChartGraph {
+public:
+    using NodeHandle = uint32_t;
+    static constexpr NodeHandle npos = UINT32_MAX;
+
+    // A contiguous run of neighbor handles
+    class Range {
+    public:
+        Range(const NodeHandle* first, const NodeHandle* last) : first(first), last(last) {}
+        const NodeHandle* begin() const { return first; }
+        const NodeHandle* end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+        NodeHandle operator[](size_t i) const { return first[i]; }
+
+    private:
+        const NodeHandle* first;
+        const NodeHandle* last;
+    };
+
+    // Thin view over a Range that yields node ids instead of handles
+    class IdRange {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = std::string_view;
+
+            iterator(const ChartGraph* graph, const NodeHandle* pos) : graph(graph), pos(pos) {}
+            std::string_view operator*() const { return graph->id(*pos); }
+            iterator& operator++() { ++pos; return *this; }
+            bool operator==(const iterator& other) const { return pos == other.pos; }
+            bool operator!=(const iterator& other) const { return pos != other.pos; }
+
+        private:
+            const ChartGraph* graph;
+            const NodeHandle* pos;
+        };
+
+        IdRange(const ChartGraph* graph, Range range) : graph(graph), range(range) {}
+        iterator begin() const { return iterator(graph, range.begin()); }
+        iterator end() const { return iterator(graph, range.end()); }
+        size_t size() const { return range.size(); }
+        bool empty() const { return range.empty(); }
+        std::string_view operator[](size_t i) const { return graph->id(range[i]); }
+
+    private:
+        const ChartGraph* graph;
+        Range range;
+    };
+
+    ChartGraph() = default;
+    explicit ChartGraph(const Chart& chart);
+
+    size_t nodeCount() const { return nodeIds.size(); }
+    size_t edgeCount() const { return edgeFrom.size(); }
+
+    // Returns npos for ids that are not in the graph
+    NodeHandle find(std::string_view id) const;
+    std::string_view id(NodeHandle node) const { return strings.str(nodeIds[node]); }
+    std::string_view label(NodeHandle node) const { return strings.str(nodeLabels[node]); }
+
+    Range successors(NodeHandle node) const;
+    Range predecessors(NodeHandle node) const;
+    IdRange successorIds(std::string_view id) const;
+    IdRange predecessorIds(std::string_view id) const;
+
+    // Edges in Chart::connections order
+    NodeHandle from(size_t edge) const { return edgeFrom[edge]; }
+    NodeHandle to(size_t edge) const { return edgeTo[edge]; }
+    std::string_view edgeLabel(size_t edge) const { return strings.str(edgeLabels[edge]); }
+    std::string_view edgeStyle(size_t edge) const { return strings.str(edgeStyles[edge]); }
+
+    // Bytes owned by the graph, including the string pool
+    size_t memoryUsage() const;
+
+private:
+    friend class ChartGraphBuilder;
+
+    StringInterner strings;
+    std::vector<StringId> nodeIds;
+    std::vector<StringId> nodeLabels;
+    std::vector<NodeHandle> handleOfString; // StringId -> NodeHandle, npos for non-node strings
+    std::vector<NodeHandle> edgeFrom;
+    std::vector<NodeHandle> edgeTo;
+    std::vector<StringId> edgeLabels;
+    std::vector<StringId> edgeStyles;
+    std::vector<uint32_t> successorOffsets;
+    std::vector<NodeHandle> successorTargets;
+    std::vector<uint32_t> predecessorOffsets;
+    std::vector<NodeHandle> predecessorSources;
+};
+
+// Collects nodes and edges without building a Chart first, then freezes them
+// into a ChartGraph. Edge endpoints that were never added as nodes become
+// unlabeled nodes, matching what the parser does.
+class ChartGraphBuilder {
+public:
+    using NodeHandle = ChartGraph::NodeHandle;
+
+    // Adds a node or, for an existing id, replaces its label when non-empty
+    NodeHandle addNode(std::string_view id, std::string_view label = {});
+    void addEdge(std::string_view from, std::string_view to,
+                 std::string_view label = {}, std::string_view style = {});
+    void reserve(size_t nodes, size_t edges);
+
+    ChartGraph build();
+
+private:
+    ChartGraph graph;
+};
+
+#endif // CHART_GRAPH_H
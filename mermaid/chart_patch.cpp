@@ -0,0 +1,298 @@
+#include "chart_patch.h"
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
+
+namespace {
+
+using AdjacencyMap = std::map<std::string, std::vector<std::string>, std::less<>>;
+
+// Removes the last occurrence of value from map[key], and the key once its
+// list is empty
+void eraseLast(AdjacencyMap& map, std::string_view key, std::string_view value) {
+    auto it = map.find(key);
+    if (it == map.end()) return;
+    auto& list = it->second;
+    auto pos = std::find(list.rbegin(), list.rend(), value);
+    if (pos != list.rend()) {
+        list.erase(std::next(pos).base());
+    }
+    if (list.empty()) {
+        map.erase(it);
+    }
+}
+
+void eraseAll(AdjacencyMap& map, std::string_view key, std::string_view value) {
+    auto it = map.find(key);
+    if (it == map.end()) return;
+    auto& list = it->second;
+    list.erase(std::remove(list.begin(), list.end(), value), list.end());
+    if (list.empty()) {
+        map.erase(it);
+    }
+}
+
+void replaceAll(std::vector<std::string>& list, std::string_view from, const std::string& to) {
+    for (auto& item : list) {
+        if (item == from) item = to;
+    }
+}
+
+// Calls fn once per distinct class, the way the fingerprint counts them
+template <typename Fn>
+void forEachDistinct(const std::vector<std::string>& classes, Fn&& fn) {
+    for (size_t i = 0; i < classes.size(); ++i) {
+        if (std::find(classes.begin(), classes.begin() + i, classes[i]) == classes.begin() + i) {
+            fn(classes[i]);
+        }
+    }
+}
+
+} // namespace
+
+void ChartPatch::buildIndex() {
+    // Connections appended behind the patch's back after a commit show up as
+    // a size mismatch; the index is then rebuilt rather than trusted
+    if (indexed && (tombstones || dead.size() == chart.connections.size())) return;
+    incident.clear();
+    incident.reserve(chart.successors.size() + chart.predecessors.size());
+    for (uint32_t i = 0; i < chart.connections.size(); ++i) {
+        const Connection& conn = chart.connections[i];
+        incident[conn.from].push_back(i);
+        if (conn.to != conn.from) {
+            incident[conn.to].push_back(i);
+        }
+    }
+    memberOf.clear();
+    for (const auto& [subgraphId, subgraph] : chart.subgraphs) {
+        for (const auto& nodeId : subgraph.nodeIds) {
+            memberOf[nodeId].push_back(subgraphId);
+        }
+    }
+    dead.assign(chart.connections.size(), false);
+    indexed = true;
+}
+
+bool ChartPatch::known(std::string_view id) const {
+    return chart.nodes.find(id) != chart.nodes.end() || chart.successors.find(id) != chart.successors.end() ||
+           chart.predecessors.find(id) != chart.predecessors.end();
+}
+
+void ChartPatch::kill(uint32_t index) {
+    dead[index] = true;
+    ++tombstones;
+    chart.unindexConnection(index);
+    chart.hashConnection(chart.connections[index], false);
+}
+
+void ChartPatch::maybeCompact() {
+    if (tombstones * 2 >= chart.connections.size()) {
+        commit();
+    }
+}
+
+void ChartPatch::commit() {
+    if (!tombstones) return;
+    // One stable pass drops the tombstones and records where each survivor
+    // went, so the index can be renumbered instead of rebuilt
+    constexpr uint32_t gone = UINT32_MAX;
+    std::vector<uint32_t> moved(chart.connections.size());
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < chart.connections.size(); ++i) {
+        if (dead[i]) {
+            moved[i] = gone;
+            continue;
+        }
+        if (kept != i) {
+            chart.connections[kept] = std::move(chart.connections[i]);
+        }
+        moved[i] = kept++;
+    }
+    chart.connections.resize(kept);
+    for (auto it = incident.begin(); it != incident.end();) {
+        auto& positions = it->second;
+        size_t live = 0;
+        for (uint32_t position : positions) {
+            if (moved[position] != gone) positions[live++] = moved[position];
+        }
+        positions.resize(live);
+        it = positions.empty() ? incident.erase(it) : std::next(it);
+    }
+    dead.assign(kept, false);
+    tombstones = 0;
+    if (chart.deduplicate) {
+        chart.indexConnections();
+    }
+}
+
+bool ChartPatch::removeConnection(std::string_view fromView, std::string_view toView) {
+    buildIndex();
+    // Owned copies: the views may point into the lists this call edits
+    std::string from(fromView);
+    std::string to(toView);
+    auto it = incident.find(from);
+    if (it == incident.end()) return false;
+    const auto& positions = it->second;
+    for (size_t k = positions.size(); k-- > 0;) {
+        uint32_t i = positions[k];
+        const Connection& conn = chart.connections[i];
+        if (!isLive(i) || conn.from != from || conn.to != to) continue;
+        // Lists follow connection order, so the most recent connection is
+        // the last occurrence in each
+        eraseLast(chart.successors, from, to);
+        eraseLast(chart.predecessors, to, from);
+        kill(i);
+        maybeCompact();
+        return true;
+    }
+    return false;
+}
+
+bool ChartPatch::removeNode(std::string_view id) {
+    if (!known(id) && chart.nodeClasses.find(id) == chart.nodeClasses.end()) return false;
+    buildIndex();
+    // Owned copy: id may view a string this call erases
+    std::string key(id);
+
+    auto inc = incident.find(key);
+    if (inc != incident.end()) {
+        // Neighbors whose lists mention id; the views stay valid because
+        // tombstoned connections are not touched until compaction
+        std::unordered_set<std::string_view> targets;
+        std::unordered_set<std::string_view> sources;
+        for (uint32_t i : inc->second) {
+            if (!isLive(i)) continue;
+            const Connection& conn = chart.connections[i];
+            if (conn.from == key && conn.to != key) targets.insert(conn.to);
+            if (conn.to == key && conn.from != key) sources.insert(conn.from);
+            kill(i);
+        }
+        for (std::string_view target : targets) eraseAll(chart.predecessors, target, key);
+        for (std::string_view source : sources) eraseAll(chart.successors, source, key);
+        incident.erase(inc);
+    }
+    if (auto it = chart.successors.find(key); it != chart.successors.end()) chart.successors.erase(it);
+    if (auto it = chart.predecessors.find(key); it != chart.predecessors.end()) chart.predecessors.erase(it);
+
+    if (auto it = chart.nodes.find(key); it != chart.nodes.end()) {
+        const std::string& label = it->second.label;
+        if (auto name = chart.nameToId.find(label); !label.empty() && name != chart.nameToId.end() &&
+                                                      name->second == key) {
+            chart.nameToId.erase(name);
+        }
+        chart.hashNode(it->second, false);
+        chart.nodes.erase(it);
+    }
+    if (auto groups = memberOf.find(key); groups != memberOf.end()) {
+        for (const auto& subgraphId : groups->second) {
+            auto subgraph = chart.subgraphs.find(subgraphId);
+            if (subgraph != chart.subgraphs.end() && subgraph->second.nodeIds.erase(key)) {
+                chart.hashSubgraphMember(subgraphId, key, false);
+            }
+        }
+        memberOf.erase(groups);
+    }
+    if (auto it = chart.nodeClasses.find(key); it != chart.nodeClasses.end()) {
+        chart.hashNodeClassKey(it->first, false);
+        forEachDistinct(it->second, [&](const std::string& className) {
+            chart.hashNodeClass(it->first, className, false);
+        });
+        chart.nodeClasses.erase(it);
+    }
+
+    maybeCompact();
+    return true;
+}
+
+bool ChartPatch::renameNode(std::string_view from, std::string_view to) {
+    if (!known(from)) return false;
+    if (from == to) return true;
+    if (known(to) || chart.nodeClasses.find(to) != chart.nodeClasses.end()) return false;
+    buildIndex();
+    std::string oldId(from);
+    std::string newId(to);
+
+    auto inc = incident.find(oldId);
+    if (inc != incident.end()) {
+        std::vector<uint32_t> positions = std::move(inc->second);
+        incident.erase(inc);
+        std::unordered_set<std::string> neighbors;
+        for (uint32_t i : positions) {
+            if (!isLive(i)) continue;
+            Connection& conn = chart.connections[i];
+            if (conn.from != oldId) neighbors.insert(conn.from);
+            if (conn.to != oldId) neighbors.insert(conn.to);
+            chart.hashConnection(conn, false);
+            chart.unindexConnection(i);
+            if (conn.from == oldId) conn.from = newId;
+            if (conn.to == oldId) conn.to = newId;
+            chart.indexConnection(i);
+            chart.hashConnection(conn, true);
+        }
+        for (const auto& neighbor : neighbors) {
+            if (auto it = chart.successors.find(neighbor); it != chart.successors.end()) {
+                replaceAll(it->second, oldId, newId);
+            }
+            if (auto it = chart.predecessors.find(neighbor); it != chart.predecessors.end()) {
+                replaceAll(it->second, oldId, newId);
+            }
+        }
+        incident.emplace(newId, std::move(positions));
+    }
+    for (AdjacencyMap* map : {&chart.successors, &chart.predecessors}) {
+        if (auto entry = map->extract(oldId)) {
+            entry.key() = newId;
+            replaceAll(entry.mapped(), oldId, newId); // self-loops
+            map->insert(std::move(entry));
+        }
+    }
+
+    if (auto entry = chart.nodes.extract(oldId)) {
+        Node& node = entry.mapped();
+        chart.hashNode(node, false);
+        node.id = newId;
+        chart.hashNode(node, true);
+        if (auto name = chart.nameToId.find(node.label); !node.label.empty() && name != chart.nameToId.end() &&
+                                                           name->second == oldId) {
+            name->second = newId;
+        }
+        entry.key() = newId;
+        chart.nodes.insert(std::move(entry));
+    }
+    if (auto groups = memberOf.extract(oldId)) {
+        for (const auto& subgraphId : groups.mapped()) {
+            auto subgraph = chart.subgraphs.find(subgraphId);
+            if (subgraph == chart.subgraphs.end() || !subgraph->second.nodeIds.erase(oldId)) continue;
+            chart.hashSubgraphMember(subgraphId, oldId, false);
+            subgraph->second.nodeIds.insert(newId);
+            chart.hashSubgraphMember(subgraphId, newId, true);
+        }
+        groups.key() = newId;
+        memberOf.insert(std::move(groups));
+    }
+    if (auto entry = chart.nodeClasses.extract(oldId)) {
+        chart.hashNodeClassKey(oldId, false);
+        chart.hashNodeClassKey(newId, true);
+        forEachDistinct(entry.mapped(), [&](const std::string& className) {
+            chart.hashNodeClass(oldId, className, false);
+            chart.hashNodeClass(newId, className, true);
+        });
+        entry.key() = newId;
+        chart.nodeClasses.insert(std::move(entry));
+    }
+    return true;
+}
+
+bool ChartPatch::addConnection(Connection conn) {
+    if (!chart.addConnection(std::move(conn))) return false;
+    if (indexed) {
+        uint32_t index = static_cast<uint32_t>(chart.connections.size() - 1);
+        const Connection& added = chart.connections.back();
+        incident[added.from].push_back(index);
+        if (added.to != added.from) {
+            incident[added.to].push_back(index);
+        }
+        dead.push_back(false);
+    }
+    return true;
+}
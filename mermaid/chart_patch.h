@@ -0,0 +1,75 @@
+#ifndef CHART_PATCH_H
+#define CHART_PATCH_H
+
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// An editing session that removes and renames nodes and connections of a
+// live Chart without rebuilding it.
+//
+// Chart::connections is an ordered vector, so deleting from the middle is
+// linear. A patch instead tombstones removed connections in a side bitmap
+// and drops them all in one stable pass on commit(), or on its own once
+// half the vector is dead. Everything else is updated immediately:
+// successors and predecessors, nodes, nameToId, subgraph membership, node
+// classes and the maintained fingerprint. The first edit builds an index
+// from each id to its connections and subgraphs, after which an edit costs
+// time proportional to the degrees of the nodes it touches. Compaction
+// renumbers the index in the same pass, so it survives commit().
+//
+// Until commit() or the destructor runs, connections may still hold the
+// removed entries; read the chart only after committing. Other fields are
+// always current. While a patch is alive, change the chart only through it;
+// connections appended directly after a commit are picked up, but any other
+// direct change leaves the index stale.
+class ChartPatch {
+public:
+    explicit ChartPatch(Chart& chart) : chart(chart) {}
+    ~ChartPatch() { commit(); }
+    ChartPatch(const ChartPatch&) = delete;
+    ChartPatch& operator=(const ChartPatch&) = delete;
+
+    // Removes the most recent connection from -> to, whatever its label.
+    // Returns false if there is none.
+    bool removeConnection(std::string_view from, std::string_view to);
+    // Removes the node, every connection touching it, its subgraph
+    // memberships, its classes and the nameToId entry for its label. Also
+    // works for ids that are only connection endpoints. Returns false if
+    // the id is unknown.
+    bool removeNode(std::string_view id);
+    // Gives a node a new id everywhere it appears. Returns false if from is
+    // unknown or to is already in use.
+    bool renameNode(std::string_view from, std::string_view to);
+    // Chart::addConnection, keeping the patch's index in step
+    bool addConnection(Connection conn);
+
+    // Drops the tombstones, leaving connections exact, in one pass over the
+    // vector; the patch and its index stay usable
+    void commit();
+    size_t tombstoneCount() const { return tombstones; }
+
+private:
+    void buildIndex();
+    bool known(std::string_view id) const;
+    bool isLive(uint32_t index) const { return !dead[index]; }
+    void kill(uint32_t index);
+    // Compacts once at least half the connections are tombstones
+    void maybeCompact();
+
+    Chart& chart;
+    bool indexed = false;
+    // Positions in connections of every connection touching an id; may
+    // include tombstoned positions until the next compaction
+    std::unordered_map<std::string, std::vector<uint32_t>> incident;
+    // Subgraphs whose nodeIds hold each id
+    std::unordered_map<std::string, std::vector<std::string>> memberOf;
+    std::vector<bool> dead;
+    size_t tombstones = 0;
+};
+
+#endif // CHART_PATCH_H
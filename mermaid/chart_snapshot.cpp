@@ -0,0 +1,466 @@
+#include "chart_snapshot.h"
+#include "mermaid_sink.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char kMagic[8] = {'M', 'M', 'D', 'C', 'H', 'A', 'R', 'T'};
+const uint32_t kByteOrder = 0x01020304;
+
+size_t alignUp(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+uint32_t checkedIndex(size_t value) {
+    if (value > UINT32_MAX) {
+        throw std::runtime_error("Chart is too large for the snapshot format");
+    }
+    return static_cast<uint32_t>(value);
+}
+
+} // namespace
+
+// Writer
+void ChartSnapshot::write(const Chart& chart, MermaidSink& sink) {
+    StringInterner strings;
+    strings.intern("");
+
+    // Node ids in map order, then connection endpoints that are not nodes,
+    // merged into one sorted order
+    std::vector<StringId> nodeIds;
+    nodeIds.reserve(chart.nodes.size());
+    for (const auto& [id, node] : chart.nodes) {
+        nodeIds.push_back(strings.intern(id));
+    }
+    std::vector<const Node*> nodeOfString(strings.size(), nullptr);
+    {
+        size_t i = 0;
+        for (const auto& [id, node] : chart.nodes) nodeOfString[nodeIds[i++]] = &node;
+    }
+    std::vector<StringId> endpoints;
+    endpoints.reserve(chart.connections.size() * 2);
+    std::vector<StringId> extras;
+    std::vector<bool> seenExtra;
+    auto firstSighting = [&](StringId sid) {
+        if (sid >= seenExtra.size()) seenExtra.resize(std::max<size_t>(sid + 1, seenExtra.size() * 2));
+        bool first = !seenExtra[sid];
+        seenExtra[sid] = true;
+        return first;
+    };
+    for (const auto& conn : chart.connections) {
+        for (const std::string* id : {&conn.from, &conn.to}) {
+            StringId sid = strings.intern(*id);
+            if (sid >= nodeOfString.size()) nodeOfString.resize(sid + 1, nullptr);
+            if (!nodeOfString[sid] && firstSighting(sid)) extras.push_back(sid);
+            endpoints.push_back(sid);
+        }
+    }
+    std::sort(extras.begin(), extras.end(),
+              [&](StringId a, StringId b) { return strings.str(a) < strings.str(b); });
+
+    std::vector<StringId> order;
+    order.reserve(nodeIds.size() + extras.size());
+    std::merge(nodeIds.begin(), nodeIds.end(), extras.begin(), extras.end(), std::back_inserter(order),
+               [&](StringId a, StringId b) { return strings.str(a) < strings.str(b); });
+    const size_t nodeCount = checkedIndex(order.size());
+    std::vector<NodeHandle> handleOfString(nodeOfString.size(), npos);
+    for (size_t n = 0; n < nodeCount; ++n) {
+        handleOfString[order[n]] = static_cast<NodeHandle>(n);
+    }
+
+    std::vector<NodeRecord> nodeRecords;
+    nodeRecords.reserve(nodeCount);
+    for (StringId sid : order) {
+        NodeRecord record{sid, 0, 0, 0};
+        if (const Node* node = nodeOfString[sid]) {
+            record.label = strings.intern(node->label);
+            record.style = strings.intern(node->style);
+            record.flags = kIsNode;
+        }
+        nodeRecords.push_back(record);
+    }
+
+    std::vector<EdgeRecord> edgeRecords;
+    edgeRecords.reserve(chart.connections.size());
+    for (size_t e = 0; e < chart.connections.size(); ++e) {
+        const Connection& conn = chart.connections[e];
+        edgeRecords.push_back(EdgeRecord{handleOfString[endpoints[2 * e]], handleOfString[endpoints[2 * e + 1]],
+                                         strings.intern(conn.label), strings.intern(conn.style)});
+    }
+    checkedIndex(edgeRecords.size());
+
+    // CSR adjacency, neighbors in connection order
+    std::vector<uint32_t> successorOffsets(nodeCount + 1, 0);
+    std::vector<uint32_t> predecessorOffsets(nodeCount + 1, 0);
+    for (const auto& edge : edgeRecords) {
+        ++successorOffsets[edge.from + 1];
+        ++predecessorOffsets[edge.to + 1];
+    }
+    for (size_t n = 0; n < nodeCount; ++n) {
+        successorOffsets[n + 1] += successorOffsets[n];
+        predecessorOffsets[n + 1] += predecessorOffsets[n];
+    }
+    std::vector<uint32_t> successorTargets(edgeRecords.size());
+    std::vector<uint32_t> predecessorSources(edgeRecords.size());
+    {
+        std::vector<uint32_t> out(successorOffsets.begin(), successorOffsets.end() - 1);
+        std::vector<uint32_t> in(predecessorOffsets.begin(), predecessorOffsets.end() - 1);
+        for (const auto& edge : edgeRecords) {
+            successorTargets[out[edge.from]++] = edge.to;
+            predecessorSources[in[edge.to]++] = edge.from;
+        }
+    }
+
+    std::vector<PairRecord> names;
+    names.reserve(chart.nameToId.size());
+    for (const auto& [name, id] : chart.nameToId) {
+        names.push_back(PairRecord{strings.intern(name), strings.intern(id)});
+    }
+
+    std::vector<SubgraphRecord> subgraphs;
+    std::vector<uint32_t> members;
+    std::vector<uint32_t> children;
+    subgraphs.reserve(chart.subgraphs.size());
+    for (const auto& [id, subgraph] : chart.subgraphs) {
+        SubgraphRecord record{strings.intern(id), strings.intern(subgraph.label), strings.intern(subgraph.style), 0,
+                              checkedIndex(members.size()), 0, checkedIndex(children.size()), 0};
+        for (const auto& nodeId : subgraph.nodeIds) members.push_back(strings.intern(nodeId));
+        for (const auto& childId : subgraph.subgraphIds) children.push_back(strings.intern(childId));
+        record.memberEnd = checkedIndex(members.size());
+        record.childEnd = checkedIndex(children.size());
+        subgraphs.push_back(record);
+    }
+
+    std::vector<PairRecord> classDefinitions;
+    classDefinitions.reserve(chart.classDefinitions.size());
+    for (const auto& [className, definition] : chart.classDefinitions) {
+        classDefinitions.push_back(PairRecord{strings.intern(className), strings.intern(definition)});
+    }
+
+    std::vector<NodeClassRecord> nodeClasses;
+    std::vector<uint32_t> classNames;
+    nodeClasses.reserve(chart.nodeClasses.size());
+    for (const auto& [nodeId, classes] : chart.nodeClasses) {
+        NodeClassRecord record{strings.intern(nodeId), checkedIndex(classNames.size()), 0};
+        for (const auto& className : classes) classNames.push_back(strings.intern(className));
+        record.end = checkedIndex(classNames.size());
+        nodeClasses.push_back(record);
+    }
+
+    std::vector<uint32_t> stringOffsets;
+    stringOffsets.reserve(strings.size() + 1);
+    size_t stringBytes = 0;
+    for (StringId sid = 0; sid < strings.size(); ++sid) {
+        stringOffsets.push_back(checkedIndex(stringBytes));
+        stringBytes += strings.str(sid).size();
+    }
+    stringOffsets.push_back(checkedIndex(stringBytes));
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = formatVersion;
+    header.byteOrder = kByteOrder;
+    header.direction = chart.direction == Direction::LR ? 0 : 1;
+    // The maintained sums are stale after direct edits to the members, and a
+    // loaded snapshot trusts the header, so store freshly computed ones
+    const Chart::FingerprintSums computed = chart.fingerprintSums();
+    const Fingerprint* sums[] = {&computed.nodes, &computed.connections, &computed.subgraphs,
+                                 &computed.classDefinitions, &computed.nodeClasses};
+    for (size_t i = 0; i < 5; ++i) {
+        header.sums[2 * i] = sums[i]->high;
+        header.sums[2 * i + 1] = sums[i]->low;
+    }
+
+    const std::pair<const void*, size_t> sections[kSectionCount] = {
+        {stringOffsets.data(), stringOffsets.size() * sizeof(uint32_t)},
+        {nullptr, stringBytes},
+        {nodeRecords.data(), nodeRecords.size() * sizeof(NodeRecord)},
+        {edgeRecords.data(), edgeRecords.size() * sizeof(EdgeRecord)},
+        {successorOffsets.data(), successorOffsets.size() * sizeof(uint32_t)},
+        {successorTargets.data(), successorTargets.size() * sizeof(uint32_t)},
+        {predecessorOffsets.data(), predecessorOffsets.size() * sizeof(uint32_t)},
+        {predecessorSources.data(), predecessorSources.size() * sizeof(uint32_t)},
+        {names.data(), names.size() * sizeof(PairRecord)},
+        {subgraphs.data(), subgraphs.size() * sizeof(SubgraphRecord)},
+        {members.data(), members.size() * sizeof(uint32_t)},
+        {children.data(), children.size() * sizeof(uint32_t)},
+        {classDefinitions.data(), classDefinitions.size() * sizeof(PairRecord)},
+        {nodeClasses.data(), nodeClasses.size() * sizeof(NodeClassRecord)},
+        {classNames.data(), classNames.size() * sizeof(uint32_t)},
+    };
+    const size_t counts[kSectionCount] = {
+        strings.size(), stringBytes, nodeRecords.size(), edgeRecords.size(),
+        successorOffsets.size() - 1, successorTargets.size(), predecessorOffsets.size() - 1,
+        predecessorSources.size(), names.size(), subgraphs.size(), members.size(), children.size(),
+        classDefinitions.size(), nodeClasses.size(), classNames.size()};
+    size_t offset = alignUp(sizeof(Header));
+    for (size_t s = 0; s < kSectionCount; ++s) {
+        header.sections[s] = SectionEntry{offset, counts[s]};
+        offset = alignUp(offset + sections[s].second);
+    }
+    header.fileSize = offset;
+
+    static const char padding[8] = {};
+    auto put = [&](const void* data, size_t size) {
+        sink.append(std::string_view(static_cast<const char*>(data), size));
+        sink.append(std::string_view(padding, alignUp(size) - size));
+    };
+    put(&header, sizeof(header));
+    for (size_t s = 0; s < kSectionCount; ++s) {
+        if (s == kStringData) {
+            for (StringId sid = 0; sid < strings.size(); ++sid) sink.append(strings.str(sid));
+            sink.append(std::string_view(padding, alignUp(stringBytes) - stringBytes));
+        } else {
+            put(sections[s].first, sections[s].second);
+        }
+    }
+}
+
+// Reader
+ChartSnapshot::ChartSnapshot(const std::string& filename) : file(new MappedFile(filename)) {
+    attach(file->contents());
+}
+
+ChartSnapshot ChartSnapshot::fromBytes(std::string_view bytes) {
+    ChartSnapshot snapshot;
+    snapshot.attach(bytes);
+    return snapshot;
+}
+
+template <typename T>
+const T* ChartSnapshot::section(Section which) const {
+    return reinterpret_cast<const T*>(reinterpret_cast<const char*>(header) + header->sections[which].offset);
+}
+
+void ChartSnapshot::attach(std::string_view bytes) {
+    auto fail = [](const char* what) {
+        throw std::runtime_error(std::string("Invalid chart snapshot: ") + what);
+    };
+    if (reinterpret_cast<uintptr_t>(bytes.data()) % 8 != 0) fail("data is not 8-byte aligned");
+    if (bytes.size() < sizeof(Header)) fail("truncated header");
+    header = reinterpret_cast<const Header*>(bytes.data());
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) fail("bad magic");
+    if (header->version != formatVersion) fail("unsupported version");
+    if (header->byteOrder != kByteOrder) fail("written with a different byte order");
+    if (header->fileSize != bytes.size()) fail("size mismatch");
+    if (header->direction > 1) fail("bad direction");
+
+    // Element size and count of every section, bounds checked before use
+    const size_t elementSizes[kSectionCount] = {
+        sizeof(uint32_t), 1, sizeof(NodeRecord), sizeof(EdgeRecord),
+        sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(PairRecord), sizeof(SubgraphRecord), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(PairRecord), sizeof(NodeClassRecord), sizeof(uint32_t)};
+    const size_t extra[kSectionCount] = {1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0};
+    for (size_t s = 0; s < kSectionCount; ++s) {
+        const SectionEntry& entry = header->sections[s];
+        if (entry.offset % 8 != 0 || entry.offset > bytes.size()) fail("bad section offset");
+        uint64_t room = (bytes.size() - entry.offset) / elementSizes[s];
+        if (entry.count > room || room - entry.count < extra[s] || entry.count > UINT32_MAX) {
+            fail("section out of bounds");
+        }
+    }
+    // The count + 1 arrays must be consistent with what they index
+    const SectionEntry* sections = header->sections;
+    if (sections[kSuccessorOffsets].count != sections[kNodes].count ||
+        sections[kPredecessorOffsets].count != sections[kNodes].count ||
+        sections[kSuccessorTargets].count != sections[kEdges].count ||
+        sections[kPredecessorSources].count != sections[kEdges].count) {
+        fail("adjacency does not match nodes and edges");
+    }
+
+    stringOffsets = section<uint32_t>(kStringOffsets);
+    stringData = section<char>(kStringData);
+    nodes = section<NodeRecord>(kNodes);
+    edges = section<EdgeRecord>(kEdges);
+    successorOffsets = section<uint32_t>(kSuccessorOffsets);
+    successorTargets = section<uint32_t>(kSuccessorTargets);
+    predecessorOffsets = section<uint32_t>(kPredecessorOffsets);
+    predecessorSources = section<uint32_t>(kPredecessorSources);
+
+    // Indices: every reference must land inside its table
+    const uint64_t stringCount = sections[kStringOffsets].count;
+    const uint64_t nodeTotal = sections[kNodes].count;
+    const uint64_t edgeTotal = sections[kEdges].count;
+    if (stringCount == 0 || stringOffsets[0] != 0 || stringOffsets[stringCount] != sections[kStringData].count) {
+        fail("bad string table");
+    }
+    for (uint64_t i = 0; i < stringCount; ++i) {
+        if (stringOffsets[i] > stringOffsets[i + 1]) fail("bad string table");
+    }
+    auto checkStrings = [&](const uint32_t* values, uint64_t count) {
+        for (uint64_t i = 0; i < count; ++i) {
+            if (values[i] >= stringCount) fail("string index out of range");
+        }
+    };
+    for (uint64_t n = 0; n < nodeTotal; ++n) {
+        const NodeRecord& node = nodes[n];
+        if (node.id >= stringCount || node.label >= stringCount || node.style >= stringCount) {
+            fail("string index out of range");
+        }
+        if (node.flags > kIsNode) fail("bad node flags");
+    }
+    for (uint64_t e = 0; e < edgeTotal; ++e) {
+        const EdgeRecord& edge = edges[e];
+        if (edge.from >= nodeTotal || edge.to >= nodeTotal) fail("edge endpoint out of range");
+        if (edge.label >= stringCount || edge.style >= stringCount) fail("string index out of range");
+    }
+    auto checkCsr = [&](const uint32_t* offsets, const uint32_t* targets) {
+        if (offsets[0] != 0 || offsets[nodeTotal] != edgeTotal) fail("bad adjacency offsets");
+        for (uint64_t n = 0; n < nodeTotal; ++n) {
+            if (offsets[n] > offsets[n + 1]) fail("bad adjacency offsets");
+        }
+        for (uint64_t e = 0; e < edgeTotal; ++e) {
+            if (targets[e] >= nodeTotal) fail("adjacency target out of range");
+        }
+    };
+    checkCsr(successorOffsets, successorTargets);
+    checkCsr(predecessorOffsets, predecessorSources);
+
+    checkStrings(section<uint32_t>(kNames), sections[kNames].count * 2);
+    checkStrings(section<uint32_t>(kClassDefinitions), sections[kClassDefinitions].count * 2);
+    checkStrings(section<uint32_t>(kSubgraphMembers), sections[kSubgraphMembers].count);
+    checkStrings(section<uint32_t>(kSubgraphChildren), sections[kSubgraphChildren].count);
+    checkStrings(section<uint32_t>(kNodeClassNames), sections[kNodeClassNames].count);
+    const SubgraphRecord* subgraphs = section<SubgraphRecord>(kSubgraphs);
+    for (uint64_t s = 0; s < sections[kSubgraphs].count; ++s) {
+        const SubgraphRecord& record = subgraphs[s];
+        if (record.id >= stringCount || record.label >= stringCount || record.style >= stringCount) {
+            fail("string index out of range");
+        }
+        if (record.memberBegin > record.memberEnd || record.memberEnd > sections[kSubgraphMembers].count ||
+            record.childBegin > record.childEnd || record.childEnd > sections[kSubgraphChildren].count) {
+            fail("subgraph range out of bounds");
+        }
+    }
+    const NodeClassRecord* nodeClasses = section<NodeClassRecord>(kNodeClasses);
+    for (uint64_t n = 0; n < sections[kNodeClasses].count; ++n) {
+        const NodeClassRecord& record = nodeClasses[n];
+        if (record.node >= stringCount || record.begin > record.end ||
+            record.end > sections[kNodeClassNames].count) {
+            fail("node class range out of bounds");
+        }
+    }
+}
+
+Direction ChartSnapshot::direction() const {
+    return header->direction == 0 ? Direction::LR : Direction::TD;
+}
+
+Fingerprint ChartSnapshot::fingerprint() const {
+    Chart chart;
+    chart.direction = direction();
+    restoreSums(chart);
+    return chart.fingerprint();
+}
+
+void ChartSnapshot::restoreSums(Chart& chart) const {
+    Fingerprint* sums[] = {&chart.sums.nodes, &chart.sums.connections, &chart.sums.subgraphs,
+                           &chart.sums.classDefinitions, &chart.sums.nodeClasses};
+    for (size_t i = 0; i < 5; ++i) {
+        sums[i]->high = header->sums[2 * i];
+        sums[i]->low = header->sums[2 * i + 1];
+    }
+}
+
+ChartSnapshot::NodeHandle ChartSnapshot::find(std::string_view id) const {
+    const NodeRecord* first = nodes;
+    const NodeRecord* last = nodes + nodeCount();
+    const NodeRecord* it = std::lower_bound(first, last, id, [&](const NodeRecord& record, std::string_view key) {
+        return str(record.id) < key;
+    });
+    return it != last && str(it->id) == id ? static_cast<NodeHandle>(it - first) : npos;
+}
+
+// Tables are stored in map order, so every map is filled by appending with
+// an end hint instead of searching
+Chart ChartSnapshot::toChart() const {
+    Chart chart;
+    chart.direction = direction();
+    auto text = [&](uint32_t index) { return std::string(str(index)); };
+
+    const size_t nodeTotal = nodeCount();
+    for (size_t n = 0; n < nodeTotal; ++n) {
+        if (!isNode(static_cast<NodeHandle>(n))) continue;
+        const NodeRecord& record = nodes[n];
+        auto it = chart.nodes.emplace_hint(chart.nodes.end(), std::piecewise_construct,
+                                           std::forward_as_tuple(str(record.id)), std::forward_as_tuple());
+        it->second.id = it->first;
+        it->second.label = str(record.label);
+        it->second.style = str(record.style);
+    }
+
+    const PairRecord* names = section<PairRecord>(kNames);
+    for (size_t i = 0; i < header->sections[kNames].count; ++i) {
+        chart.nameToId.emplace_hint(chart.nameToId.end(), text(names[i].key), text(names[i].value));
+    }
+
+    chart.connections.reserve(edgeCount());
+    for (size_t e = 0; e < edgeCount(); ++e) {
+        const EdgeRecord& edge = edges[e];
+        chart.connections.emplace_back(text(nodes[edge.from].id), text(nodes[edge.to].id), text(edge.label),
+                                       text(edge.style));
+    }
+    auto adjacency = [&](std::map<std::string, std::vector<std::string>, std::less<>>& map,
+                         const uint32_t* offsets, const uint32_t* targets) {
+        for (size_t n = 0; n < nodeTotal; ++n) {
+            if (offsets[n] == offsets[n + 1]) continue;
+            auto it = map.emplace_hint(map.end(), text(nodes[n].id), std::vector<std::string>());
+            it->second.reserve(offsets[n + 1] - offsets[n]);
+            for (uint32_t i = offsets[n]; i < offsets[n + 1]; ++i) {
+                it->second.emplace_back(str(nodes[targets[i]].id));
+            }
+        }
+    };
+    adjacency(chart.successors, successorOffsets, successorTargets);
+    adjacency(chart.predecessors, predecessorOffsets, predecessorSources);
+
+    const SubgraphRecord* subgraphs = section<SubgraphRecord>(kSubgraphs);
+    const uint32_t* members = section<uint32_t>(kSubgraphMembers);
+    const uint32_t* children = section<uint32_t>(kSubgraphChildren);
+    for (size_t s = 0; s < header->sections[kSubgraphs].count; ++s) {
+        const SubgraphRecord& record = subgraphs[s];
+        SubGraph subgraph(text(record.id), text(record.label));
+        subgraph.style = str(record.style);
+        for (uint32_t i = record.memberBegin; i < record.memberEnd; ++i) {
+            subgraph.nodeIds.emplace_hint(subgraph.nodeIds.end(), str(members[i]));
+        }
+        for (uint32_t i = record.childBegin; i < record.childEnd; ++i) {
+            subgraph.subgraphIds.emplace_hint(subgraph.subgraphIds.end(), str(children[i]));
+        }
+        chart.subgraphs.emplace_hint(chart.subgraphs.end(), subgraph.id, std::move(subgraph));
+    }
+
+    const PairRecord* classDefinitions = section<PairRecord>(kClassDefinitions);
+    for (size_t i = 0; i < header->sections[kClassDefinitions].count; ++i) {
+        chart.classDefinitions.emplace_hint(chart.classDefinitions.end(), text(classDefinitions[i].key),
+                                            text(classDefinitions[i].value));
+    }
+
+    const NodeClassRecord* nodeClasses = section<NodeClassRecord>(kNodeClasses);
+    const uint32_t* classNames = section<uint32_t>(kNodeClassNames);
+    for (size_t n = 0; n < header->sections[kNodeClasses].count; ++n) {
+        const NodeClassRecord& record = nodeClasses[n];
+        auto it = chart.nodeClasses.emplace_hint(chart.nodeClasses.end(), text(record.node),
+                                                 std::vector<std::string>());
+        for (uint32_t i = record.begin; i < record.end; ++i) {
+            it->second.emplace_back(str(classNames[i]));
+        }
+    }
+
+    restoreSums(chart);
+    return chart;
+}
+
+void MermaidWriter::writeSnapshot(const Chart& chart, MermaidSink& sink) {
+    ChartSnapshot::write(chart, sink);
+    sink.flush();
+}
@@ -0,0 +1,159 @@
+#ifndef CHART_SNAPSHOT_H
+#define CHART_SNAPSHOT_H
+
+#include "chart_graph.h"
+#include "mapped_file.h"
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class MermaidSink;
+
+// Read-only view of a binary Chart snapshot, as written by
+// MermaidWriter::writeSnapshot. Opening one maps the file and checks that
+// every offset and index in it is in bounds; nothing is parsed or copied, so
+// queries read straight from the page cache. toChart() materializes a Chart
+// equal to the one that was written, fingerprint included; the writer
+// recomputes the fingerprint sums, so they are right even if the chart's
+// maintained ones were stale.
+//
+// Layout (version 1, native little-endian, 8-byte aligned sections):
+//   header     magic, version, byte order, size, direction, fingerprint
+//              sums and a table of (offset, count) per section
+//   strings    uint32 offsets into one character block; string 0 is ""
+//   nodes      sorted by id: (id, label, style, flags) string indices;
+//              endpoints that are not Chart nodes are present but unflagged
+//   edges      (from, to, label, style) in Chart::connections order
+//   adjacency  CSR successors and predecessors over node indices, each an
+//              offset array plus one flat array in connection order
+//   tables     nameToId pairs, subgraphs with member and child ranges,
+//              class definitions, node classes with class name ranges
+class ChartSnapshot {
+public:
+    using NodeHandle = ChartGraph::NodeHandle;
+    using Range = ChartGraph::Range;
+    static constexpr NodeHandle npos = ChartGraph::npos;
+    static constexpr uint32_t formatVersion = 1;
+
+    // Maps the file ("-" reads stdin). Throws std::runtime_error if it is not
+    // a snapshot of this version or is truncated or inconsistent.
+    explicit ChartSnapshot(const std::string& filename);
+    // Views caller-owned bytes, which must be 8-byte aligned and outlive the
+    // snapshot
+    static ChartSnapshot fromBytes(std::string_view bytes);
+
+    Direction direction() const;
+    Fingerprint fingerprint() const;
+
+    // Every id that is a node or a connection endpoint, in ascending order
+    size_t nodeCount() const { return header->sections[kNodes].count; }
+    size_t edgeCount() const { return header->sections[kEdges].count; }
+
+    // Binary search over the sorted ids; npos if absent
+    NodeHandle find(std::string_view id) const;
+    std::string_view id(NodeHandle node) const { return str(nodes[node].id); }
+    std::string_view label(NodeHandle node) const { return str(nodes[node].label); }
+    std::string_view style(NodeHandle node) const { return str(nodes[node].style); }
+    // False for endpoints that were never added to Chart::nodes
+    bool isNode(NodeHandle node) const { return nodes[node].flags & kIsNode; }
+
+    Range successors(NodeHandle node) const {
+        return Range(successorTargets + successorOffsets[node], successorTargets + successorOffsets[node + 1]);
+    }
+    Range predecessors(NodeHandle node) const {
+        return Range(predecessorSources + predecessorOffsets[node], predecessorSources + predecessorOffsets[node + 1]);
+    }
+
+    // Edges in Chart::connections order
+    NodeHandle from(size_t edge) const { return edges[edge].from; }
+    NodeHandle to(size_t edge) const { return edges[edge].to; }
+    std::string_view edgeLabel(size_t edge) const { return str(edges[edge].label); }
+    std::string_view edgeStyle(size_t edge) const { return str(edges[edge].style); }
+
+    Chart toChart() const;
+
+    // Writes chart to sink in the layout above; see MermaidWriter::writeSnapshot
+    static void write(const Chart& chart, MermaidSink& sink);
+
+private:
+    enum Section : uint32_t {
+        kStringOffsets,
+        kStringData,
+        kNodes,
+        kEdges,
+        kSuccessorOffsets,
+        kSuccessorTargets,
+        kPredecessorOffsets,
+        kPredecessorSources,
+        kNames,
+        kSubgraphs,
+        kSubgraphMembers,
+        kSubgraphChildren,
+        kClassDefinitions,
+        kNodeClasses,
+        kNodeClassNames,
+        kSectionCount
+    };
+
+    static constexpr uint32_t kIsNode = 1;
+
+    struct SectionEntry {
+        uint64_t offset;
+        uint64_t count; // elements; kStringOffsets holds count + 1 offsets
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t fileSize;
+        uint32_t direction;
+        uint32_t reserved;
+        uint64_t sums[10]; // Chart::FingerprintSums as (high, low) pairs
+        SectionEntry sections[kSectionCount];
+    };
+
+    struct NodeRecord {
+        uint32_t id, label, style, flags;
+    };
+    struct EdgeRecord {
+        uint32_t from, to, label, style; // from and to are node indices
+    };
+    struct PairRecord {
+        uint32_t key, value;
+    };
+    struct SubgraphRecord {
+        uint32_t id, label, style, reserved;
+        uint32_t memberBegin, memberEnd, childBegin, childEnd;
+    };
+    struct NodeClassRecord {
+        uint32_t node, begin, end;
+    };
+
+    ChartSnapshot() = default;
+    void attach(std::string_view bytes);
+    // Copies the stored fingerprint sums into chart
+    void restoreSums(Chart& chart) const;
+    template <typename T>
+    const T* section(Section which) const;
+
+    std::string_view str(uint32_t index) const {
+        return std::string_view(stringData + stringOffsets[index], stringOffsets[index + 1] - stringOffsets[index]);
+    }
+
+    std::unique_ptr<MappedFile> file;
+    const Header* header = nullptr;
+    const uint32_t* stringOffsets = nullptr;
+    const char* stringData = nullptr;
+    const NodeRecord* nodes = nullptr;
+    const EdgeRecord* edges = nullptr;
+    const uint32_t* successorOffsets = nullptr;
+    const uint32_t* successorTargets = nullptr;
+    const uint32_t* predecessorOffsets = nullptr;
+    const uint32_t* predecessorSources = nullptr;
+};
+
+#endif // CHART_SNAPSHOT_H
@@ -0,0 +1,185 @@
+#include "chart_store.h"
+#include <algorithm>
+#include <utility>
+
+PersistentChart::PersistentChart(const Chart& chart) {
+    direction = chart.direction;
+    for (const auto& [id, node] : chart.nodes) {
+        nodes.set(id, node);
+    }
+    for (const auto& [name, id] : chart.nameToId) {
+        nameToId.set(name, id);
+    }
+    // Sequence numbers keep the adjacency lists in connection order
+    std::map<std::string_view, AdjacencyList> outgoing;
+    std::map<std::string_view, AdjacencyList> incoming;
+    for (const auto& conn : chart.connections) {
+        outgoing[conn.from].set(nextConnection, conn.to);
+        incoming[conn.to].set(nextConnection, conn.from);
+        connections.set(nextConnection++, conn);
+    }
+    for (auto& [id, list] : outgoing) {
+        successors.set(std::string(id), std::move(list));
+    }
+    for (auto& [id, list] : incoming) {
+        predecessors.set(std::string(id), std::move(list));
+    }
+    for (const auto& [className, definition] : chart.classDefinitions) {
+        classDefinitions.set(className, definition);
+    }
+    for (const auto& [id, classes] : chart.nodeClasses) {
+        nodeClasses.set(id, classes);
+    }
+    for (const auto& [id, subgraph] : chart.subgraphs) {
+        Subgraph stored{subgraph.label, subgraph.style, {}, {}};
+        for (const auto& nodeId : subgraph.nodeIds) stored.nodeIds.set(nodeId, true);
+        for (const auto& childId : subgraph.subgraphIds) stored.subgraphIds.set(childId, true);
+        subgraphs.set(id, std::move(stored));
+    }
+    tally.sums = chart.fingerprintSums();
+}
+
+void PersistentChart::addNode(Node node) {
+    if (!node.label.empty()) {
+        nameToId.set(node.label, node.id);
+    }
+    if (const Node* existing = nodes.find(node.id)) {
+        tally.hashNode(*existing, false);
+    }
+    tally.hashNode(node, true);
+    std::string id = node.id;
+    nodes.set(std::move(id), std::move(node));
+}
+
+void PersistentChart::addConnection(Connection conn) {
+    auto append = [&](Map<AdjacencyList>& lists, const std::string& key, const std::string& neighbour) {
+        const AdjacencyList* existing = lists.find(key);
+        AdjacencyList list = existing ? *existing : AdjacencyList();
+        list.set(nextConnection, neighbour);
+        lists.set(key, std::move(list));
+    };
+    append(predecessors, conn.to, conn.from);
+    append(successors, conn.from, conn.to);
+    tally.hashConnection(conn, true);
+    connections.set(nextConnection++, std::move(conn));
+}
+
+void PersistentChart::addClass(const std::string& className, const std::string& definition) {
+    if (const std::string* existing = classDefinitions.find(className)) {
+        tally.hashClassDefinition(className, *existing, false);
+    }
+    tally.hashClassDefinition(className, definition, true);
+    classDefinitions.set(className, definition);
+}
+
+void PersistentChart::addNodeClass(const std::string& nodeId, const std::string& className) {
+    const std::vector<std::string>* existing = nodeClasses.find(nodeId);
+    std::vector<std::string> classes;
+    if (existing) {
+        classes = *existing;
+    } else {
+        tally.hashNodeClassKey(nodeId, true);
+    }
+    // Repeats do not change the class set semanticEquals compares
+    if (std::find(classes.begin(), classes.end(), className) == classes.end()) {
+        tally.hashNodeClass(nodeId, className, true);
+    }
+    classes.push_back(className);
+    nodeClasses.set(nodeId, std::move(classes));
+}
+
+void PersistentChart::addSubgraph(const SubGraph& subgraph) {
+    if (const Subgraph* existing = subgraphs.find(subgraph.id)) {
+        tally.hashSubgraphHeader(SubGraph(subgraph.id, existing->label), false);
+        existing->nodeIds.forEach([&](const std::string& nodeId, bool) {
+            tally.hashSubgraphMember(subgraph.id, nodeId, false);
+        });
+    }
+    tally.hashSubgraphHeader(subgraph, true);
+    Subgraph stored{subgraph.label, subgraph.style, {}, {}};
+    for (const auto& nodeId : subgraph.nodeIds) {
+        stored.nodeIds.set(nodeId, true);
+        tally.hashSubgraphMember(subgraph.id, nodeId, true);
+    }
+    for (const auto& childId : subgraph.subgraphIds) {
+        stored.subgraphIds.set(childId, true);
+    }
+    subgraphs.set(subgraph.id, std::move(stored));
+}
+
+void PersistentChart::addNodeToSubgraph(const std::string& nodeId, const std::string& subgraphId) {
+    const Subgraph* existing = subgraphs.find(subgraphId);
+    if (!existing || !nodes.find(nodeId) || existing->nodeIds.find(nodeId)) return;
+    Subgraph updated = *existing;
+    updated.nodeIds.set(nodeId, true);
+    tally.hashSubgraphMember(subgraphId, nodeId, true);
+    subgraphs.set(subgraphId, std::move(updated));
+}
+
+void PersistentChart::setNodeLabel(std::string_view id, std::string_view label) {
+    const Node* existing = nodes.find(id);
+    if (!existing || existing->label == label) return;
+    Node node = *existing;
+    tally.hashNode(node, false);
+    node.label = label;
+    tally.hashNode(node, true);
+    nodes.set(node.id, node);
+}
+
+Fingerprint PersistentChart::fingerprint() const {
+    Chart header;
+    header.direction = direction;
+    return header.fingerprintOf(tally.sums);
+}
+
+Chart PersistentChart::toChart() const {
+    Chart chart;
+    chart.direction = direction;
+    // Entries arrive in key order, so each insertion is at the end
+    nodes.forEach([&](const std::string& id, const Node& node) { chart.nodes.emplace_hint(chart.nodes.end(), id, node); });
+    nameToId.forEach([&](const std::string& name, const std::string& id) {
+        chart.nameToId.emplace_hint(chart.nameToId.end(), name, id);
+    });
+    chart.connections.reserve(connections.size());
+    connections.forEach([&](uint64_t, const Connection& conn) { chart.connections.push_back(conn); });
+    auto copyLists = [](const Map<AdjacencyList>& from, std::map<std::string, std::vector<std::string>, std::less<>>& to) {
+        from.forEach([&](const std::string& id, const AdjacencyList& list) {
+            auto& ids = to.emplace_hint(to.end(), id, std::vector<std::string>())->second;
+            ids.reserve(list.size());
+            list.forEach([&](uint64_t, const std::string& neighbour) { ids.push_back(neighbour); });
+        });
+    };
+    copyLists(predecessors, chart.predecessors);
+    copyLists(successors, chart.successors);
+    classDefinitions.forEach([&](const std::string& className, const std::string& definition) {
+        chart.classDefinitions.emplace_hint(chart.classDefinitions.end(), className, definition);
+    });
+    nodeClasses.forEach([&](const std::string& id, const std::vector<std::string>& classes) {
+        chart.nodeClasses.emplace_hint(chart.nodeClasses.end(), id, classes);
+    });
+    subgraphs.forEach([&](const std::string& id, const Subgraph& stored) {
+        SubGraph subgraph(id, stored.label);
+        subgraph.style = stored.style;
+        stored.nodeIds.forEach([&](const std::string& nodeId, bool) { subgraph.nodeIds.insert(subgraph.nodeIds.end(), nodeId); });
+        stored.subgraphIds.forEach([&](const std::string& childId, bool) {
+            subgraph.subgraphIds.insert(subgraph.subgraphIds.end(), childId);
+        });
+        chart.subgraphs.emplace_hint(chart.subgraphs.end(), id, std::move(subgraph));
+    });
+    chart.sums = tally.sums;
+    return chart;
+}
+
+ChartStore::ChartStore(const Chart& initial)
+    : published(std::make_shared<const Version>(Version{PersistentChart(initial), 0})) {}
+
+uint64_t ChartStore::update(Edit edit) {
+    std::lock_guard<std::mutex> lock(writer);
+    // Only this thread publishes, so the loaded version is the latest. The
+    // copy shares all of its content; a throwing edit simply drops it.
+    auto next = std::make_shared<Version>(*std::atomic_load(&published));
+    edit(next->chart);
+    uint64_t number = ++next->number;
+    std::atomic_store(&published, Snapshot(std::move(next)));
+    return number;
+}
@@ -0,0 +1,115 @@
+#ifndef CHART_STORE_H
+#define CHART_STORE_H
+
+#include "mermaid_parser.h"
+#include "persistent_map.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A Chart held in persistent maps, so that copies share everything they
+// have in common. Copying is O(1) and each add* call copies only the map
+// paths it touches, O(log n) nodes per key, leaving every other copy as it
+// was. The members mirror Chart's; edit through the methods below so that
+// adjacency and the fingerprint stay in step.
+//
+// Connections are keyed by a sequence number that grows with every
+// connection added, so key order is insertion order, and so are the
+// adjacency lists, which are keyed the same way. Duplicate suppression is
+// not supported.
+class PersistentChart {
+public:
+    template <typename Value>
+    using Map = PersistentMap<std::string, Value>;
+    // Neighbour ids keyed by the sequence number of the connection
+    using AdjacencyList = PersistentMap<uint64_t, std::string>;
+    // A set of ids; the values are unused
+    using IdSet = Map<bool>;
+
+    struct Subgraph {
+        std::string label;
+        std::string style;
+        IdSet nodeIds;
+        IdSet subgraphIds;
+    };
+
+    Direction direction = Direction::LR;
+    Map<Node> nodes;
+    Map<std::string> nameToId;
+    PersistentMap<uint64_t, Connection> connections;
+    Map<AdjacencyList> predecessors;
+    Map<AdjacencyList> successors;
+    Map<std::string> classDefinitions;
+    Map<std::vector<std::string>> nodeClasses;
+    Map<Subgraph> subgraphs;
+
+    PersistentChart() = default;
+    // O(n log n) in the size of chart
+    explicit PersistentChart(const Chart& chart);
+
+    // Same effect as the Chart methods of the same names
+    void addNode(Node node);
+    void addConnection(Connection conn);
+    void addClass(const std::string& className, const std::string& definition);
+    void addNodeClass(const std::string& nodeId, const std::string& className);
+    void addSubgraph(const SubGraph& subgraph);
+    void addNodeToSubgraph(const std::string& nodeId, const std::string& subgraphId);
+    void setNodeLabel(std::string_view id, std::string_view label);
+
+    // Equal to Chart::fingerprint() of toChart(), in O(1)
+    Fingerprint fingerprint() const;
+    // Linear in the size of the chart
+    Chart toChart() const;
+
+private:
+    // Holds no content; its fingerprint sums track this chart's, updated
+    // through Chart's own hashing helpers
+    Chart tally;
+    uint64_t nextConnection = 0;
+};
+
+// Publishes successive versions of a chart to concurrent readers.
+//
+// Readers call snapshot() and get an immutable version that stays valid
+// and unchanged for as long as they hold it, whatever the writer does
+// meanwhile. Taking a snapshot is an atomic shared_ptr load, which the
+// standard library guards with a tiny internal lock held only to copy the
+// pointer, never while a writer works. Writers call update(), which copies
+// the latest version, runs the edit on the copy and atomically publishes it
+// as the next version; writers are serialized among themselves.
+//
+// Versions are PersistentCharts, so the copy is O(1) and the edit copies
+// only what it touches: an update costs O(log n) per element changed, never
+// waits for readers, and each version shares all unchanged content with
+// the others. The last reader to drop a replaced version frees the few
+// nodes only it referenced. Each edit runs exactly once, so it may capture
+// whatever it likes.
+class ChartStore {
+public:
+    struct Version {
+        PersistentChart chart;
+        uint64_t number = 0;
+    };
+    using Snapshot = std::shared_ptr<const Version>;
+    using Edit = std::function<void(PersistentChart&)>;
+
+    ChartStore() : ChartStore(Chart()) {}
+    explicit ChartStore(const Chart& initial);
+
+    Snapshot snapshot() const { return std::atomic_load(&published); }
+
+    // Applies edit and publishes the result; returns the new version number.
+    // If edit throws, nothing is published and the exception propagates.
+    uint64_t update(Edit edit);
+
+private:
+    std::mutex writer;
+    Snapshot published; // only through atomic_load/atomic_store
+};
+
+#endif // CHART_STORE_H
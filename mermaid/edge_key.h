@@ -0,0 +1,38 @@
+#ifndef EDGE_KEY_H
+#define EDGE_KEY_H
+
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+// Hashing helpers shared by the library's own translation units; not part of
+// the public interface.
+
+// Mixes value into seed (the boost::hash_combine step)
+inline size_t hashCombine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+// A connection's identity when order and style do not matter, as in
+// semanticEquals and ChartDiff. Views into the connection it was taken from.
+struct EdgeKey {
+    std::string_view from;
+    std::string_view to;
+    std::string_view label;
+
+    static EdgeKey of(const Connection& conn) { return EdgeKey{conn.from, conn.to, conn.label}; }
+
+    bool operator==(const EdgeKey& other) const {
+        return from == other.from && to == other.to && label == other.label;
+    }
+};
+
+struct EdgeKeyHash {
+    size_t operator()(const EdgeKey& key) const {
+        std::hash<std::string_view> hash;
+        return hashCombine(hashCombine(hash(key.from), hash(key.to)), hash(key.label));
+    }
+};
+
+#endif // EDGE_KEY_H
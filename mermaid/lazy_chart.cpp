@@ -0,0 +1,161 @@
+#include "lazy_chart.h"
+#include "mermaid_reader.h"
+#include <functional>
+#include <stdexcept>
+
+LazyChart::Span LazyChart::span(std::string_view part) {
+    if (part.empty()) return Span();
+    if (part.size() > UINT32_MAX) {
+        throw std::runtime_error("Statement part too long for a lazy chart");
+    }
+    std::less<const char*> before;
+    if (before(part.data(), text.data()) || !before(part.data(), text.data() + text.size())) {
+        size_t at = implied.find(part);
+        if (at == std::string::npos) {
+            at = implied.size();
+            implied += part;
+        }
+        return Span{text.size() + at, static_cast<uint32_t>(part.size())};
+    }
+    return Span{static_cast<uint64_t>(part.data() - text.data()), static_cast<uint32_t>(part.size())};
+}
+
+// First sighting of an id creates the node; later references only relabel
+// it, exactly as in MermaidParser::parseContent
+LazyChart::NodeHandle LazyChart::sight(std::string_view id, std::string_view label, uint32_t declaration) {
+    auto [it, inserted] = index.try_emplace(id, static_cast<NodeHandle>(nodes.size()));
+    if (inserted) {
+        Span labelSpan = span(label);
+        nodes.push_back(NodeRecord{span(id), labelSpan, labelSpan, declaration});
+    } else if (!label.empty()) {
+        nodes[it->second].label = span(label);
+    }
+    return it->second;
+}
+
+LazyChart LazyChart::parse(std::string_view content) {
+    LazyChart chart;
+    chart.text = content;
+
+    // Latest declaration of each subgraph id; a node joins the subgraph as
+    // declared when the node is first seen
+    std::unordered_map<std::string_view, uint32_t> latest;
+
+    MermaidReader reader(content);
+    MermaidEvent event;
+    while (reader.next(&event)) {
+        switch (event.type) {
+        case MermaidEvent::Type::Flowchart:
+            chart.dir = event.direction;
+            break;
+        case MermaidEvent::Type::Node:
+            chart.sight(event.id, event.label, event.subgraph.empty() ? none : latest.find(event.subgraph)->second);
+            break;
+        case MermaidEvent::Type::Edge: {
+            // The reader reports both endpoints as nodes before the edge
+            NodeHandle from = chart.index.find(event.id)->second;
+            NodeHandle to = chart.index.find(event.target)->second;
+            chart.edges.push_back(EdgeRecord{from, to, chart.span(event.label), chart.span(event.style)});
+            break;
+        }
+        case MermaidEvent::Type::SubgraphBegin: {
+            uint32_t declaration = static_cast<uint32_t>(chart.declarations.size());
+            auto [it, inserted] = latest.try_emplace(event.id, declaration);
+            if (!inserted) {
+                // Redeclaring a subgraph replaces it, members included
+                chart.declarations[it->second].latest = false;
+                it->second = declaration;
+            }
+            chart.declarations.push_back(Declaration{chart.span(event.id), chart.span(event.label), true});
+            break;
+        }
+        case MermaidEvent::Type::SubgraphEnd:
+            break;
+        case MermaidEvent::Type::ClassDef:
+            chart.classDefinitions.push_back(Pair{chart.span(event.className), chart.span(event.label)});
+            break;
+        case MermaidEvent::Type::Class:
+            chart.nodeClasses.push_back(Pair{chart.span(event.id), chart.span(event.className)});
+            break;
+        }
+    }
+
+    chart.buildAdjacency();
+    return chart;
+}
+
+LazyChart LazyChart::parseFile(const std::string& filename) {
+    auto file = std::make_unique<MappedFile>(filename);
+    LazyChart chart = parse(file->contents());
+    chart.file = std::move(file);
+    return chart;
+}
+
+// Counting sort of the edges by source and by target; both are stable, so
+// each node's list keeps connection order
+void LazyChart::buildAdjacency() {
+    size_t count = nodes.size();
+    successorOffsets.assign(count + 1, 0);
+    predecessorOffsets.assign(count + 1, 0);
+    for (const EdgeRecord& edge : edges) {
+        ++successorOffsets[edge.from + 1];
+        ++predecessorOffsets[edge.to + 1];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        successorOffsets[i + 1] += successorOffsets[i];
+        predecessorOffsets[i + 1] += predecessorOffsets[i];
+    }
+    successorTargets.resize(edges.size());
+    predecessorSources.resize(edges.size());
+    std::vector<uint32_t> nextSuccessor(successorOffsets.begin(), successorOffsets.end() - 1);
+    std::vector<uint32_t> nextPredecessor(predecessorOffsets.begin(), predecessorOffsets.end() - 1);
+    for (const EdgeRecord& edge : edges) {
+        successorTargets[nextSuccessor[edge.from]++] = edge.to;
+        predecessorSources[nextPredecessor[edge.to]++] = edge.from;
+    }
+}
+
+LazyChart::NodeHandle LazyChart::find(std::string_view id) const {
+    auto it = index.find(id);
+    return it == index.end() ? npos : it->second;
+}
+
+std::string_view LazyChart::label(NodeHandle node) const {
+    std::string_view raw = rawLabel(node);
+    if (raw.size() >= 2 && raw.front() == '"' && raw.back() == '"') {
+        return raw.substr(1, raw.size() - 2);
+    }
+    return raw;
+}
+
+Chart LazyChart::toChart() const {
+    Chart chart;
+    chart.direction = dir;
+    for (const Declaration& declaration : declarations) {
+        if (declaration.latest) {
+            chart.addSubgraph(SubGraph(std::string(view(declaration.id)), std::string(view(declaration.label))));
+        }
+    }
+    // Adding nodes in first-sighting order registers nameToId in the same
+    // order the parser does
+    for (const NodeRecord& node : nodes) {
+        std::string id(view(node.id));
+        chart.addNode(Node(id, std::string(view(node.firstLabel))));
+        chart.setNodeLabel(id, view(node.label));
+        if (node.declaration != none && declarations[node.declaration].latest) {
+            chart.addNodeToSubgraph(id, std::string(view(declarations[node.declaration].id)));
+        }
+    }
+    chart.connections.reserve(edges.size());
+    for (const EdgeRecord& edge : edges) {
+        chart.addConnection(Connection(std::string(view(nodes[edge.from].id)), std::string(view(nodes[edge.to].id)),
+                                       std::string(view(edge.label)), std::string(view(edge.style))));
+    }
+    for (const Pair& definition : classDefinitions) {
+        chart.addClass(std::string(view(definition.first)), std::string(view(definition.second)));
+    }
+    for (const Pair& assignment : nodeClasses) {
+        chart.addNodeClass(std::string(view(assignment.first)), std::string(view(assignment.second)));
+    }
+    return chart;
+}
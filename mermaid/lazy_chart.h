@@ -0,0 +1,132 @@
+#ifndef LAZY_CHART_H
+#define LAZY_CHART_H
+
+#include "chart_graph.h"
+#include "mapped_file.h"
+#include "mermaid_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A parsed flowchart that keeps its source text instead of copying strings
+// out of it, for workloads that mostly look at topology.
+//
+// Ids, labels and styles are stored as byte offsets into the source, which
+// must stay alive and unchanged (parseFile keeps the file mapped for the
+// chart's lifetime). Nodes get dense handles in first-sighting order and
+// adjacency is kept in CSR form in connection order, as in ChartGraph. A
+// label is only decoded when asked for: label() strips surrounding quotes
+// the way Chart::normalizeLabel does, and rawLabel() returns the text as
+// Chart::Node::label holds it. Parsing allocates no per-node strings, so it
+// is faster and far smaller than building a Chart.
+//
+// toChart() materializes the ordinary Chart, equal to
+// MermaidParser::parseContent of the same source.
+class LazyChart {
+public:
+    using NodeHandle = ChartGraph::NodeHandle;
+    using Range = ChartGraph::Range;
+    static constexpr NodeHandle npos = ChartGraph::npos;
+
+    // Parses content, which must outlive the chart. Throws
+    // std::runtime_error if there is no flowchart declaration.
+    static LazyChart parse(std::string_view content);
+    // Maps the file ("-" reads stdin) and keeps it for the chart's lifetime
+    static LazyChart parseFile(const std::string& filename);
+
+    Direction direction() const { return dir; }
+    std::string_view source() const { return text; }
+
+    // Every node, in the order its id was first seen
+    size_t nodeCount() const { return nodes.size(); }
+    size_t edgeCount() const { return edges.size(); }
+
+    NodeHandle find(std::string_view id) const;
+    std::string_view id(NodeHandle node) const { return view(nodes[node].id); }
+    // The latest non-empty label, quotes stripped; empty if there is none
+    std::string_view label(NodeHandle node) const;
+    // The same label as written, quotes included
+    std::string_view rawLabel(NodeHandle node) const { return view(nodes[node].label); }
+
+    Range successors(NodeHandle node) const {
+        return Range(successorTargets.data() + successorOffsets[node],
+                     successorTargets.data() + successorOffsets[node + 1]);
+    }
+    Range predecessors(NodeHandle node) const {
+        return Range(predecessorSources.data() + predecessorOffsets[node],
+                     predecessorSources.data() + predecessorOffsets[node + 1]);
+    }
+
+    // Edges in Chart::connections order
+    NodeHandle from(size_t edge) const { return edges[edge].from; }
+    NodeHandle to(size_t edge) const { return edges[edge].to; }
+    std::string_view edgeLabel(size_t edge) const { return view(edges[edge].label); }
+    std::string_view edgeStyle(size_t edge) const { return view(edges[edge].style); }
+
+    Chart toChart() const;
+
+private:
+    // A range of the source, by offset so the chart holds no pointers into it
+    struct Span {
+        uint64_t offset = 0;
+        uint32_t length = 0;
+    };
+    static constexpr uint32_t none = UINT32_MAX;
+
+    struct NodeRecord {
+        Span id;
+        Span firstLabel; // registered in nameToId when the node was added
+        Span label;
+        uint32_t declaration; // subgraph declaration it joined when first seen, or none
+    };
+    struct EdgeRecord {
+        NodeHandle from;
+        NodeHandle to;
+        Span label;
+        Span style;
+    };
+    struct Declaration {
+        Span id;
+        Span label;
+        bool latest; // no later declaration of the same id replaced it
+    };
+    struct Pair {
+        Span first;
+        Span second;
+    };
+
+    LazyChart() = default;
+    Span span(std::string_view part);
+    std::string_view view(Span part) const {
+        return part.offset < text.size() ? text.substr(part.offset, part.length)
+                                         : std::string_view(implied).substr(part.offset - text.size(), part.length);
+    }
+    NodeHandle sight(std::string_view id, std::string_view label, uint32_t declaration);
+    void buildAdjacency();
+
+    std::unique_ptr<MappedFile> file;
+    std::string_view text;
+    // Text the lexer supplies that is not spelled out in the source, such as
+    // the "-.->" style of "-. text .->"; spans past the end of text index it
+    std::string implied;
+    Direction dir = Direction::LR;
+
+    std::vector<NodeRecord> nodes;
+    std::unordered_map<std::string_view, NodeHandle> index; // views into text
+    std::vector<EdgeRecord> edges;
+    std::vector<uint32_t> successorOffsets;
+    std::vector<NodeHandle> successorTargets;
+    std::vector<uint32_t> predecessorOffsets;
+    std::vector<NodeHandle> predecessorSources;
+
+    // The rest of the chart, in statement order, for toChart()
+    std::vector<Declaration> declarations;
+    std::vector<Pair> classDefinitions; // name, definition
+    std::vector<Pair> nodeClasses;      // node id, class name
+};
+
+#endif // LAZY_CHART_H
@@ -0,0 +1,114 @@
+#include "mapped_file.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    buffer = stream.str();
+    data = buffer.data();
+    size = buffer.size();
+}
+
+void MappedFile::unmap() {}
+
+#else
+
+namespace {
+
+// Reads everything from a descriptor that cannot be mapped
+std::string readAll(int fd, const std::string& filename) {
+    std::string result;
+    char chunk[1 << 16];
+    for (;;) {
+        ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count == 0) break;
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to read file: " + filename);
+        }
+        result.append(chunk, static_cast<size_t>(count));
+    }
+    return result;
+}
+
+} // namespace
+
+MappedFile::MappedFile(const std::string& filename) {
+    bool isStdin = filename == "-";
+    int fd = isStdin ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* view = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            ::madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            data = static_cast<const char*>(view);
+            size = static_cast<size_t>(info.st_size);
+            mapped = true;
+        }
+    }
+
+    if (!mapped) {
+        try {
+            buffer = readAll(fd, filename);
+        } catch (...) {
+            if (!isStdin) ::close(fd);
+            throw;
+        }
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    if (!isStdin) ::close(fd);
+}
+
+void MappedFile::unmap() {
+    if (mapped) {
+        ::munmap(const_cast<char*>(data), size);
+        mapped = false;
+    }
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        mapped = std::exchange(other.mapped, false);
+        buffer = std::move(other.buffer);
+        data = mapped ? other.data : buffer.data();
+        size = std::exchange(other.size, 0);
+        other.data = nullptr;
+    }
+    return *this;
+}
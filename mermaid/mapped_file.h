@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <string_view>
+
+// Read-only view of a file's contents. Regular files are memory-mapped so
+// the parser reads straight from the page cache; pipes, terminals and stdin
+// (named "-") cannot be mapped and are read into an owned buffer instead.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    std::string_view contents() const { return std::string_view(data, size); }
+    bool isMapped() const { return mapped; }
+
+private:
+    void unmap();
+
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,1331 @@
+#include "mermaid_parser.h"
+#include "arena_chart.h"
+#include "lazy_chart.h"
+#include "chart_builder.h"
+#include "chart_diff.h"
+#include "chart_patch.h"
+#include "chart_store.h"
+#include "chart_graph.h"
+#include "chart_algorithms.h"
+#include "reachability_index.h"
+#include "mermaid_reader.h"
+#include "mermaid_document.h"
+#include "mermaid_sink.h"
+#include "chart_snapshot.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <random>
+#include <regex>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tuple>
+
+// Benchmark driver: mermaid_bench [name [scale]]
+// Without arguments every benchmark runs at its default scale.
+
+// Global allocation counters, fed by the replacement operator new below.
+// Each block carries its size in a header so live bytes can be tracked.
+static std::atomic<size_t> allocationCount{0};
+static std::atomic<size_t> allocationBytes{0};
+static std::atomic<size_t> liveBytes{0};
+static std::atomic<size_t> peakLiveBytes{0};
+static const size_t kAllocationHeader = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    if (char* p = static_cast<char*>(std::malloc(size + kAllocationHeader))) {
+        *reinterpret_cast<size_t*>(p) = size;
+        return p + kAllocationHeader;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    char* block = static_cast<char*>(p) - kAllocationHeader;
+    liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+// Over-aligned blocks (std::pmr::new_delete_resource asks for these) put the
+// header in a full alignment unit in front of the block
+void* operator new(size_t size, std::align_val_t align) {
+    size_t header = std::max(static_cast<size_t>(align), kAllocationHeader);
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    size_t total = (size + header + header - 1) / header * header;
+#ifdef _WIN32
+    char* p = static_cast<char*>(_aligned_malloc(total, header));
+#else
+    char* p = static_cast<char*>(std::aligned_alloc(header, total));
+#endif
+    if (p) {
+        *reinterpret_cast<size_t*>(p + header - sizeof(size_t)) = size;
+        return p + header;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t align) noexcept {
+    if (!p) return;
+    size_t header = std::max(static_cast<size_t>(align), kAllocationHeader);
+    char* block = static_cast<char*>(p) - header;
+    liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block + header - sizeof(size_t)), std::memory_order_relaxed);
+#ifdef _WIN32
+    _aligned_free(block);
+#else
+    std::free(block);
+#endif
+}
+
+void operator delete(void* p, size_t, std::align_val_t align) noexcept {
+    operator delete(p, align);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Best wall-clock time of several runs
+template <typename Fn>
+double timeBest(int runs, Fn&& fn) {
+    double best = 0;
+    for (int i = 0; i < runs; ++i) {
+        auto start = Clock::now();
+        fn();
+        double elapsed = secondsSince(start);
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Generates a flowchart with roughly the given number of edges. Nodes are
+// grouped into subgraphs of groupSize, carry labels, and a few classes are
+// applied, so every statement kind the parser knows about shows up in the
+// input.
+std::string generateFlowchart(size_t edges, size_t groupSize = 100) {
+    const size_t nodeCount = edges / 2 + 2;
+    std::string out = "flowchart LR\n";
+    out += "    classDef hot fill:#f96,stroke:#333,stroke-width:2px\n";
+    out += "    classDef cold fill:#9cf, stroke:#333\n";
+    for (size_t group = 0; group * groupSize < nodeCount; ++group) {
+        out += "    subgraph G" + std::to_string(group) + "[\"Group " + std::to_string(group) + "\"]\n";
+        size_t first = group * groupSize;
+        size_t last = std::min(nodeCount, first + groupSize);
+        for (size_t n = first; n < last; ++n) {
+            out += "        n" + std::to_string(n) + "[\"node " + std::to_string(n) + "\"]\n";
+        }
+        out += "    end\n";
+    }
+    out += "    %% edges\n";
+    for (size_t e = 0; e < edges; ++e) {
+        size_t from = e % nodeCount;
+        size_t to = (e * 7919 + 1) % nodeCount;
+        out += "    n" + std::to_string(from) + (e % 5 == 0 ? " ----> n" : " --> n") + std::to_string(to) + "\n";
+    }
+    for (size_t n = 0; n < nodeCount; n += 50) {
+        out += "    class n" + std::to_string(n) + ",n" + std::to_string(n + 1) + (n % 100 ? " hot\n" : " cold\n");
+    }
+    return out;
+}
+
+void report(const char* label, size_t bytes, double seconds) {
+    double mb = bytes / (1024.0 * 1024.0);
+    std::cout << "  " << std::left << std::setw(24) << label << std::right
+              << std::fixed << std::setprecision(3) << std::setw(9) << seconds * 1000.0 << " ms  "
+              << std::setprecision(2) << std::setw(8) << mb / seconds << " MB/s\n";
+}
+
+void benchParse(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "parse: " << scale << " edges, " << content.size() << " bytes\n";
+
+    size_t lexerEdges = 0;
+    double lexer = timeBest(3, [&] { lexerEdges = MermaidParser::parseContent(content).connections.size(); });
+    report("parseContent", content.size(), lexer);
+
+    size_t regexEdges = 0;
+    double regex = timeBest(1, [&] { regexEdges = MermaidParser::parseContentRegex(content).connections.size(); });
+    report("parseContentRegex", content.size(), regex);
+
+    if (lexerEdges != regexEdges) {
+        std::cout << "  MISMATCH: " << lexerEdges << " vs " << regexEdges << " edges\n";
+    }
+    std::cout << "  speedup " << std::setprecision(1) << regex / lexer << "x\n";
+}
+
+// Allocations made while running fn
+struct AllocationStats {
+    size_t count = 0;
+    size_t bytes = 0;
+};
+
+template <typename Fn>
+AllocationStats countAllocations(Fn&& fn) {
+    size_t count = allocationCount.load();
+    size_t bytes = allocationBytes.load();
+    fn();
+    return {allocationCount.load() - count, allocationBytes.load() - bytes};
+}
+
+void reportAllocations(const char* label, size_t inputBytes, AllocationStats stats) {
+    std::cout << "  " << std::left << std::setw(24) << label << std::right
+              << std::setw(10) << stats.count << " allocs "
+              << std::fixed << std::setprecision(4) << std::setw(9) << double(stats.count) / inputBytes << " allocs/byte "
+              << std::setprecision(2) << std::setw(7) << double(stats.bytes) / inputBytes << " bytes/byte\n";
+}
+
+// Per-line cost of the regex parser's pieces. Until patterns were compiled
+// once, every line paid for constructing all seven of them.
+void benchRegex(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::vector<std::string> lines;
+    std::istringstream stream(content);
+    for (std::string line; std::getline(stream, line);) lines.push_back(line);
+    std::cout << "regex: " << lines.size() << " lines\n";
+
+    const char* sources[] = {
+        "(flowchart|graph)\\s+(LR|TD|TB|RL|BT)",
+        "subgraph\\s+(\\w+)(?:\\s*\\[([^\\]]+)\\])?",
+        "(\\w+)(\\s*\\[([^\\]]+)\\])?\\s*(-+>|=+>|\\.-+>)\\s*(\\w+)(\\s*\\[([^\\]]+)\\])?",
+        "(\\w+)\\s*(-+>|=+>|\\.-+>)\\s*(\\w+)",
+        "classDef\\s+(\\w+)\\s+(.+)",
+        "class\\s+([\\w,]+)\\s+(\\w+)",
+        "^\\s*(\\w+)\\s*\\[([^\\]]+)\\]",
+    };
+    auto perLine = [&](const char* label, size_t count, double seconds) {
+        std::cout << "  " << std::left << std::setw(36) << label << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << seconds * 1e6 / count << " us/line\n";
+    };
+
+    const size_t sample = std::min<size_t>(lines.size(), 500);
+    double construct = timeBest(1, [&] {
+        for (size_t i = 0; i < sample; ++i) {
+            for (const char* source : sources) std::regex pattern(source);
+        }
+    });
+    perLine("construct the 7 patterns", sample, construct);
+
+    std::vector<std::regex> compiled;
+    for (const char* source : sources) compiled.emplace_back(source, std::regex::ECMAScript | std::regex::optimize);
+    size_t matched = 0;
+    double searchAll = timeBest(1, [&] {
+        std::smatch match;
+        for (const auto& line : lines) {
+            // The statement patterns in parser order, without dispatch
+            for (size_t p = 1; p < compiled.size(); ++p) {
+                if (std::regex_search(line, match, compiled[p])) {
+                    ++matched;
+                    break;
+                }
+            }
+        }
+    });
+    perLine("search, compiled once, no dispatch", lines.size(), searchAll);
+
+    double regex = timeBest(3, [&] { MermaidParser::parseContentRegex(content); });
+    perLine("parseContentRegex", lines.size(), regex);
+    double lexer = timeBest(3, [&] { MermaidParser::parseContent(content); });
+    perLine("parseContent", lines.size(), lexer);
+    if (matched == 0) std::cout << "  (no lines matched)\n";
+}
+
+void benchAllocations(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "allocations: " << scale << " edges, " << content.size() << " bytes\n";
+    reportAllocations("parseContent", content.size(),
+                      countAllocations([&] { MermaidParser::parseContent(content); }));
+    reportAllocations("parseContentRegex", content.size(),
+                      countAllocations([&] { MermaidParser::parseContentRegex(content); }));
+}
+
+#ifndef _WIN32
+
+// Peak resident set size of the calling process in MB
+double peakRssMb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// Runs fn in a child process so its peak RSS is not polluted by earlier runs
+template <typename Fn>
+void reportPeakRss(const char* label, Fn&& fn) {
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        double before = peakRssMb();
+        fn();
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(8) << before << " MB before "
+                  << std::setw(8) << peakRssMb() << " MB peak" << std::endl;
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+void benchPeakRss(size_t scale) {
+    const char* filename = "bench_rss.mermaid";
+    size_t bytes = 0;
+    {
+        std::string content = generateFlowchart(scale);
+        bytes = content.size();
+        std::ofstream(filename) << content;
+    }
+    std::cout << "rss: " << scale << " edges, " << bytes << " bytes\n";
+
+    reportPeakRss("ifstream + stringstream", [&] {
+        std::ifstream file(filename);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        MermaidParser::parseContent(buffer.str());
+    });
+    reportPeakRss("parseFile (mmap)", [&] { MermaidParser::parseFile(filename); });
+    std::remove(filename);
+}
+
+#endif
+
+// Visits everything reachable from start; returns the number of nodes seen
+size_t reachableViaMaps(const Chart& chart, const std::string& start) {
+    std::set<std::string> seen{start};
+    std::vector<std::string> stack{start};
+    while (!stack.empty()) {
+        std::string node = std::move(stack.back());
+        stack.pop_back();
+        auto it = chart.successors.find(node);
+        if (it == chart.successors.end()) continue;
+        for (const auto& next : it->second) {
+            if (seen.insert(next).second) stack.push_back(next);
+        }
+    }
+    return seen.size();
+}
+
+size_t reachableViaGraph(const ChartGraph& graph, ChartGraph::NodeHandle start) {
+    std::vector<bool> seen(graph.nodeCount());
+    std::vector<ChartGraph::NodeHandle> stack{start};
+    seen[start] = true;
+    size_t count = 1;
+    while (!stack.empty()) {
+        ChartGraph::NodeHandle node = stack.back();
+        stack.pop_back();
+        for (ChartGraph::NodeHandle next : graph.successors(node)) {
+            if (!seen[next]) {
+                seen[next] = true;
+                ++count;
+                stack.push_back(next);
+            }
+        }
+    }
+    return count;
+}
+
+void benchGraph(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "graph: " << scale << " edges\n";
+
+    size_t before = liveBytes.load();
+    Chart chart = MermaidParser::parseContent(content);
+    size_t chartBytes = liveBytes.load() - before;
+
+    before = liveBytes.load();
+    ChartGraph graph(chart);
+    size_t graphBytes = liveBytes.load() - before;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  Chart                    " << std::setw(8) << chartBytes / (1024.0 * 1024.0) << " MB\n"
+              << "  ChartGraph               " << std::setw(8) << graphBytes / (1024.0 * 1024.0) << " MB ("
+              << graph.memoryUsage() / (1024.0 * 1024.0) << " MB reported, "
+              << 100.0 * graphBytes / chartBytes << "% of Chart)\n"
+              << "  Chart + ChartGraph       " << std::setw(8) << (chartBytes + graphBytes) / (1024.0 * 1024.0)
+              << " MB (the graph is built alongside the chart, not in place of it)\n";
+
+    size_t viaMaps = 0, viaGraph = 0;
+    double maps = timeBest(3, [&] { viaMaps = reachableViaMaps(chart, "n0"); });
+    double csr = timeBest(3, [&] { viaGraph = reachableViaGraph(graph, graph.find("n0")); });
+    std::cout << std::setprecision(3)
+              << "  reachability via maps    " << std::setw(9) << maps * 1000.0 << " ms (" << viaMaps << " nodes)\n"
+              << "  reachability via CSR     " << std::setw(9) << csr * 1000.0 << " ms (" << viaGraph << " nodes)\n";
+}
+
+// Random DAG: each node links to two later nodes at most 64 positions
+// ahead, plus backEdges edges pointing back, which create cycles
+Chart generateDag(size_t nodes, size_t backEdges) {
+    std::mt19937 random(42);
+    Chart chart;
+    auto id = [](size_t n) { return "n" + std::to_string(n); };
+    for (size_t n = 0; n < nodes; ++n) chart.addNode(Node(id(n)));
+    for (size_t n = 0; n + 1 < nodes; ++n) {
+        size_t span = std::min<size_t>(64, nodes - n - 1);
+        for (int k = 0; k < 2; ++k) chart.addConnection(Connection(id(n), id(n + 1 + random() % span)));
+    }
+    for (size_t e = 0; e < backEdges; ++e) {
+        size_t to = random() % nodes;
+        chart.addConnection(Connection(id(to + random() % (nodes - to)), id(to)));
+    }
+    return chart;
+}
+
+// What tools did before: Kahn's algorithm keyed by id strings
+size_t topologicalSortViaMaps(const Chart& chart) {
+    std::map<std::string, size_t> indegree;
+    for (const auto& [id, node] : chart.nodes) indegree[id] = 0;
+    for (const auto& conn : chart.connections) ++indegree[conn.to];
+    std::vector<std::string> order;
+    for (const auto& [id, degree] : indegree) {
+        if (degree == 0) order.push_back(id);
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+        auto it = chart.successors.find(order[head]);
+        if (it == chart.successors.end()) continue;
+        for (const auto& next : it->second) {
+            if (--indegree[next] == 0) order.push_back(next);
+        }
+    }
+    return order.size();
+}
+
+void benchBuilder(size_t scale) {
+    // Records as a program would produce them: random edges over scale / 4
+    // nodes, in no particular order
+    std::mt19937 random(11);
+    size_t nodeCount = std::max<size_t>(scale / 4, 1);
+    std::vector<Node> nodes;
+    nodes.reserve(nodeCount);
+    for (size_t i = 0; i < nodeCount; ++i) {
+        nodes.emplace_back("node" + std::to_string(random()), "Label " + std::to_string(i));
+    }
+    std::vector<Connection> connections;
+    connections.reserve(scale);
+    for (size_t i = 0; i < scale; ++i) {
+        connections.emplace_back(nodes[random() % nodeCount].id, nodes[random() % nodeCount].id);
+    }
+    std::cout << "builder: " << nodeCount << " nodes, " << scale << " connections\n";
+
+    auto run = [&](const char* label, auto&& build) {
+        Chart chart;
+        Clock::time_point start = Clock::now();
+        AllocationStats stats = countAllocations([&] { chart = build(); });
+        double seconds = secondsSince(start);
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(9) << seconds * 1000 << " ms " << std::setw(10)
+                  << stats.count << " allocs, fingerprint " << chart.fingerprint().toString() << "\n";
+    };
+    run("addNode/addConnection", [&] {
+        Chart chart;
+        for (const auto& node : nodes) chart.addNode(node);
+        for (const auto& conn : connections) chart.addConnection(conn);
+        return chart;
+    });
+    run("ChartBuilder", [&] {
+        ChartBuilder builder;
+        builder.addNodes(nodes);
+        builder.addConnections(connections);
+        return builder.build();
+    });
+}
+
+void benchDedup(size_t scale) {
+    // Two overlapping scanners: every edge once, then a random half again,
+    // interleaved
+    Chart source = MermaidParser::parseContent(generateFlowchart(scale));
+    std::mt19937 random(13);
+    std::vector<Connection> input;
+    input.reserve(source.connections.size() * 3 / 2);
+    for (const auto& conn : source.connections) {
+        input.push_back(conn);
+        if (random() % 2) input.push_back(source.connections[random() % source.connections.size()]);
+    }
+    std::cout << "dedup: " << input.size() << " connections, " << input.size() - source.connections.size()
+              << " repeats\n";
+
+    auto report = [](const char* label, double seconds, const Chart& chart) {
+        std::cout << "  " << std::left << std::setw(30) << label << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(9) << seconds * 1000 << " ms " << std::setw(10) << chart.connections.size()
+                  << " connections " << std::setw(8) << chart.suppressedConnections() << " suppressed\n";
+    };
+    Chart plain;
+    Clock::time_point start = Clock::now();
+    for (const auto& conn : input) plain.addConnection(conn);
+    report("addConnection", secondsSince(start), plain);
+
+    Chart deduped;
+    start = Clock::now();
+    deduped.setDeduplicateConnections(true);
+    for (const auto& conn : input) deduped.addConnection(conn);
+    report("addConnection, deduplicating", secondsSince(start), deduped);
+
+    // What consumers did before: filter the repeats out afterwards
+    start = Clock::now();
+    std::set<std::tuple<std::string, std::string, std::string, std::string>> seen;
+    std::vector<Connection> filtered;
+    for (const auto& conn : plain.connections) {
+        if (seen.emplace(conn.from, conn.to, conn.label, conn.style).second) filtered.push_back(conn);
+    }
+    double filter = secondsSince(start);
+    std::cout << "  " << std::left << std::setw(30) << "filter afterwards (std::set)" << std::right << std::fixed
+              << std::setprecision(1) << std::setw(9) << filter * 1000 << " ms " << std::setw(10) << filtered.size()
+              << " connections\n";
+
+    start = Clock::now();
+    plain.setDeduplicateConnections(true);
+    report("setDeduplicateConnections", secondsSince(start), plain);
+}
+
+void benchAlgorithms(size_t scale) {
+    Chart chart = generateDag(scale, 0);
+    std::cout << "algorithms: " << chart.nodes.size() << " nodes, " << chart.connections.size() << " edges\n";
+    auto row = [](const char* label, double seconds, size_t count, const char* unit) {
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(9) << seconds * 1000.0 << " ms  " << count << " " << unit << "\n";
+    };
+
+    ChartGraph graph;
+    double elapsed = timeBest(1, [&] { graph = ChartGraph(chart); });
+    row("ChartGraph(chart)", elapsed, graph.nodeCount(), "nodes");
+
+    size_t count = 0;
+    elapsed = timeBest(1, [&] { count = topologicalSortViaMaps(chart); });
+    row("topo sort via maps", elapsed, count, "nodes");
+    elapsed = timeBest(3, [&] { count = GraphAlgorithms::topologicalSort(graph).size(); });
+    row("topologicalSort", elapsed, count, "nodes");
+
+    elapsed = timeBest(1, [&] { count = reachableViaMaps(chart, "n0"); });
+    row("reachability via maps", elapsed, count, "nodes");
+    elapsed = timeBest(3, [&] { count = GraphAlgorithms::reachable(graph, graph.find("n0")).count(); });
+    row("reachable", elapsed, count, "nodes");
+
+    elapsed = timeBest(3, [&] { count = GraphAlgorithms::longestPath(graph).size(); });
+    row("longestPath", elapsed, count, "nodes");
+
+    elapsed = timeBest(3, [&] { count = GraphAlgorithms::stronglyConnectedComponents(graph).count; });
+    row("SCC (acyclic)", elapsed, count, "components");
+
+    // Back edges fold much of the graph into large components
+    ChartGraph cyclic(generateDag(scale, scale / 1000));
+    elapsed = timeBest(3, [&] { count = GraphAlgorithms::stronglyConnectedComponents(cyclic).count; });
+    row("SCC (cyclic)", elapsed, count, "components");
+}
+
+// Uniformly random edges: a small-world graph with a short diameter
+ChartGraph generateRandomGraph(size_t nodes, size_t edgesPerNode) {
+    std::mt19937 random(42);
+    ChartGraphBuilder builder;
+    builder.reserve(nodes, nodes * edgesPerNode);
+    std::vector<std::string> ids(nodes);
+    for (size_t n = 0; n < nodes; ++n) {
+        ids[n] = "n" + std::to_string(n);
+        builder.addNode(ids[n]);
+    }
+    for (size_t e = 0; e < nodes * edgesPerNode; ++e) {
+        builder.addEdge(ids[random() % nodes], ids[random() % nodes]);
+    }
+    return builder.build();
+}
+
+void benchBfs(size_t scale) {
+    std::mt19937 random(7);
+    auto row = [](const char* label, double seconds, size_t queries) {
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(9) << seconds * 1000.0 / queries << " ms/query\n";
+    };
+
+    for (int shape = 0; shape < 2; ++shape) {
+        ChartGraph graph = shape == 0 ? generateRandomGraph(scale, 4) : ChartGraph(generateDag(scale, 0));
+        std::cout << "bfs: " << (shape == 0 ? "random graph, " : "windowed DAG, ") << graph.nodeCount()
+                  << " nodes, " << graph.edgeCount() << " edges\n";
+        std::vector<ChartGraph::NodeHandle> sources(256);
+        for (auto& source : sources) source = static_cast<ChartGraph::NodeHandle>(random() % graph.nodeCount());
+
+        const size_t single = 8;
+        size_t reached = 0;
+        double elapsed = timeBest(1, [&] {
+            for (size_t i = 0; i < single; ++i) reached += GraphAlgorithms::reachable(graph, sources[i]).count();
+        });
+        row("reachable (DFS)", elapsed, single);
+        elapsed = timeBest(1, [&] {
+            for (size_t i = 0; i < single; ++i) reached += GraphAlgorithms::downstream(graph, sources[i], 1).count();
+        });
+        row("downstream, 1 thread", elapsed, single);
+        elapsed = timeBest(1, [&] {
+            for (size_t i = 0; i < single; ++i) reached += GraphAlgorithms::downstream(graph, sources[i]).count();
+        });
+        row("downstream", elapsed, single);
+        elapsed = timeBest(1, [&] { reached += GraphAlgorithms::downstreamOfEach(graph, sources).size(); });
+        row("downstreamOfEach x256", elapsed, sources.size());
+    }
+}
+
+void benchParallel(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "parallel: " << scale << " edges, " << content.size() << " bytes, "
+              << cores << " hardware threads\n";
+
+    Chart sequential;
+    double base = timeBest(3, [&] { sequential = MermaidParser::parseContent(content); });
+    report("parseContent", content.size(), base);
+
+    for (unsigned threads = 2; threads <= std::max(8u, cores); threads *= 2) {
+        Chart parallel;
+        double elapsed = timeBest(3, [&] { parallel = MermaidParser::parseContentParallel(content, threads); });
+        std::string label = "parallel x" + std::to_string(threads);
+        report(label.c_str(), content.size(), elapsed);
+        if (parallel != sequential || parallel.successors != sequential.successors ||
+            parallel.predecessors != sequential.predecessors || parallel.nameToId != sequential.nameToId) {
+            std::cout << "  MISMATCH with " << threads << " threads\n";
+        }
+    }
+}
+
+// Consumer that only needs counts, so nothing is kept per statement
+struct EdgeCounter : MermaidHandler {
+    size_t edges = 0;
+    void edge(std::string_view, std::string_view, std::string_view, std::string_view) override { ++edges; }
+};
+
+void benchStream(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "stream: " << scale << " edges, " << content.size() << " bytes\n";
+
+    size_t edges = 0;
+    report("parseContent", content.size(),
+           timeBest(3, [&] { edges = MermaidParser::parseContent(content).connections.size(); }));
+    report("MermaidReader::parse", content.size(), timeBest(3, [&] {
+        EdgeCounter counter;
+        MermaidReader::parse(content, counter);
+        edges = counter.edges;
+    }));
+    report("MermaidReader::next", content.size(), timeBest(3, [&] {
+        MermaidReader reader(content);
+        MermaidEvent event;
+        edges = 0;
+        while (reader.next(&event)) edges += event.type == MermaidEvent::Type::Edge;
+    }));
+    std::cout << "  " << edges << " edges counted\n";
+
+    reportAllocations("parseContent", content.size(),
+                      countAllocations([&] { MermaidParser::parseContent(content); }));
+    reportAllocations("MermaidReader::parse", content.size(), countAllocations([&] {
+        EdgeCounter counter;
+        MermaidReader::parse(content, counter);
+    }));
+}
+
+void benchSemanticEquals(size_t scale) {
+    std::cout << "semantic: semanticEquals against a shuffled, restyled copy\n";
+    for (size_t edges = 1000; edges <= scale; edges *= 10) {
+        Chart chart = MermaidParser::parseContent(generateFlowchart(edges));
+        Chart copy = chart;
+        std::shuffle(copy.connections.begin(), copy.connections.end(), std::mt19937(42));
+        for (auto& [name, definition] : copy.classDefinitions) {
+            size_t colon = definition.find(':');
+            if (colon != std::string::npos) definition.replace(colon, 1, " : ");
+        }
+
+        bool equal = false;
+        double elapsed = timeBest(edges < 100000 ? 3 : 1, [&] { equal = chart.semanticEquals(copy); });
+        std::cout << "  " << std::left << std::setw(10) << edges << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(12) << elapsed * 1000.0 << " ms"
+                  << (equal ? "" : "  (NOT EQUAL)") << "\n";
+    }
+}
+
+void benchDiff(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    Chart before = MermaidParser::parseContent(content);
+    // A new version with a few dozen scattered edits
+    Chart after = before;
+    std::mt19937 random(3);
+    for (int i = 0; i < 20; ++i) {
+        std::string id = "n" + std::to_string(random() % before.nodes.size());
+        after.setNodeLabel(id, "edited " + std::to_string(i));
+        after.addNode(Node("new" + std::to_string(i), "New"));
+        after.addConnection(Connection(id, "new" + std::to_string(i)));
+        after.addNodeClass(id, "hot");
+    }
+    after.addClass("warm", "fill:#fa0");
+    std::cout << "diff: " << scale << " edges, 20 nodes relabeled, 20 added, 20 connections added\n";
+
+    ChartDiff diff;
+    double compute = timeBest(3, [&] { diff = ChartDiff::compute(before, after); });
+    // semanticEquals stops at the first difference; time it on an equal copy
+    // for the cost of a full comparison
+    Chart copy = before;
+    bool equal = false;
+    double semantic = timeBest(3, [&] { equal = before.semanticEquals(copy); });
+    double apply = 0;
+    for (int i = 0; i < 3; ++i) {
+        Chart target = before;
+        Clock::time_point start = Clock::now();
+        diff.apply(target);
+        double elapsed = secondsSince(start);
+        if (i == 0 || elapsed < apply) apply = elapsed;
+    }
+    Chart patched;
+    double reparse = timeBest(1, [&] { patched = MermaidParser::parseContent(content); });
+    std::cout << std::fixed << std::setprecision(1)
+              << "  ChartDiff::compute      " << std::setw(9) << compute * 1000 << " ms, " << diff.size() << " edits\n"
+              << "  semanticEquals          " << std::setw(9) << semantic * 1000 << " ms" << (equal ? "" : " (NOT EQUAL)") << "\n"
+              << "  ChartDiff::apply        " << std::setw(9) << apply * 1000 << " ms\n"
+              << "  parseContent (rebuild)  " << std::setw(9) << reparse * 1000 << " ms\n";
+}
+
+void benchPatch(size_t scale) {
+    Chart chart = MermaidParser::parseContent(generateFlowchart(scale));
+    const size_t removals = 1000;
+    std::mt19937 random(9);
+    std::vector<Connection> victims;
+    for (size_t i = 0; i < removals; ++i) victims.push_back(chart.connections[random() % chart.connections.size()]);
+    std::vector<std::string> nodes;
+    for (size_t i = 0; i < 100; ++i) nodes.push_back("n" + std::to_string(random() % chart.nodes.size()));
+    std::cout << "patch: " << scale << " edges; " << removals << " connection removals, 100 node removals, 100 renames\n";
+
+    // Erasing from the vector, the only option without a patch
+    Chart erased = chart;
+    Clock::time_point start = Clock::now();
+    for (const auto& victim : victims) {
+        auto& connections = erased.connections;
+        for (size_t i = connections.size(); i-- > 0;) {
+            if (connections[i].from == victim.from && connections[i].to == victim.to) {
+                connections.erase(connections.begin() + i);
+                break;
+            }
+        }
+    }
+    double erase = secondsSince(start);
+
+    Chart patched = chart;
+    ChartPatch patch(patched);
+    start = Clock::now();
+    patch.removeConnection(victims[0].from, victims[0].to);
+    double index = secondsSince(start);
+    start = Clock::now();
+    for (size_t i = 1; i < victims.size(); ++i) patch.removeConnection(victims[i].from, victims[i].to);
+    double remove = secondsSince(start);
+    start = Clock::now();
+    for (const auto& node : nodes) patch.removeNode(node);
+    double removeNodes = secondsSince(start);
+    start = Clock::now();
+    for (size_t i = 0; i < 100; ++i) patch.renameNode("n" + std::to_string(i * 7 + 1), "renamed" + std::to_string(i));
+    double rename = secondsSince(start);
+    start = Clock::now();
+    patch.commit();
+    double commit = secondsSince(start);
+
+    // An edit-then-read loop commits after every edit; the index survives
+    const size_t rounds = 20;
+    start = Clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        const Connection& victim = patched.connections[random() % patched.connections.size()];
+        patch.removeConnection(std::string(victim.from), std::string(victim.to));
+        patch.commit();
+    }
+    double editCommit = secondsSince(start);
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "  vector erase            " << std::setw(10) << erase * 1e6 / removals << " us/removal\n"
+              << "  ChartPatch first edit   " << std::setw(10) << index * 1000 << " ms (builds the index)\n"
+              << "  removeConnection        " << std::setw(10) << remove * 1e6 / (removals - 1) << " us/removal\n"
+              << "  removeNode              " << std::setw(10) << removeNodes * 1e6 / nodes.size() << " us/node\n"
+              << "  renameNode              " << std::setw(10) << rename * 1e6 / 100 << " us/node\n"
+              << "  commit                  " << std::setw(10) << commit * 1000 << " ms\n"
+              << "  remove + commit         " << std::setw(10) << editCommit * 1000 / rounds << " ms/round\n";
+}
+
+// Readers look up successors of random nodes for a fixed time while one
+// writer keeps adding connections, first with every access under a
+// shared_mutex on one Chart, then with readers on ChartStore snapshots
+void benchStore(size_t scale) {
+    const Chart chart = MermaidParser::parseContent(generateFlowchart(scale));
+    const size_t nodeCount = chart.nodes.size();
+    const int readers = std::max(2u, std::thread::hardware_concurrency());
+    const auto duration = std::chrono::milliseconds(1000);
+    std::cout << "store: " << scale << " edges, " << readers << " reader threads, 1 writer, "
+              << std::thread::hardware_concurrency() << " hardware threads\n";
+
+    auto run = [&](const char* label, auto read, auto write) {
+        std::atomic<bool> stop(false);
+        std::atomic<size_t> reads(0);
+        std::atomic<size_t> found(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < readers; ++t) {
+            threads.emplace_back([&, t] {
+                std::mt19937 random(t);
+                size_t count = 0;
+                size_t hits = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    hits += read("n" + std::to_string(random() % nodeCount));
+                    ++count;
+                }
+                reads += count;
+                found += hits;
+            });
+        }
+        size_t writes = 0;
+        Clock::time_point start = Clock::now();
+        while (Clock::now() - start < duration) {
+            write(writes++);
+        }
+        stop = true;
+        double elapsed = secondsSince(start);
+        for (auto& thread : threads) thread.join();
+        std::cout << "  " << std::left << std::setw(22) << label << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << reads / elapsed << " reads/s" << std::setw(10) << writes / elapsed
+                  << " writes/s\n";
+        if (found.load() == 0) std::cout << "  (no lookups hit)\n";
+    };
+    auto edge = [&](size_t i) {
+        return Connection("n" + std::to_string(i % nodeCount), "w" + std::to_string(i));
+    };
+
+    Chart locked = chart;
+    std::shared_mutex mutex;
+    run(
+        "shared_mutex",
+        [&](const std::string& id) {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = locked.successors.find(id);
+            return it == locked.successors.end() ? size_t(0) : it->second.size();
+        },
+        [&](size_t i) {
+            Connection conn = edge(i);
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            locked.addConnection(std::move(conn));
+        });
+
+    ChartStore store(chart);
+    run(
+        "ChartStore",
+        [&](const std::string& id) {
+            ChartStore::Snapshot snapshot = store.snapshot();
+            const auto* list = snapshot->chart.successors.find(id);
+            return list ? list->size() : size_t(0);
+        },
+        [&](size_t i) { store.update([conn = edge(i)](PersistentChart& target) { target.addConnection(conn); }); });
+}
+
+void benchFingerprint(size_t scale) {
+    std::cout << "fingerprint: full recomputation vs maintained sums\n";
+    for (size_t edges = 1000; edges <= scale; edges *= 10) {
+        Chart chart = MermaidParser::parseContent(generateFlowchart(edges));
+        Fingerprint full, maintained;
+        double compute = timeBest(3, [&] { full = chart.computeFingerprint(); });
+        double read = timeBest(3, [&] { maintained = chart.fingerprint(); });
+        double equals = timeBest(1, [&] { chart.semanticEquals(chart); });
+        std::cout << "  " << std::left << std::setw(10) << edges << std::right << std::fixed << std::setprecision(3)
+                  << " computeFingerprint " << std::setw(10) << compute * 1000.0 << " ms"
+                  << "   fingerprint " << std::setw(8) << read * 1e6 << " us"
+                  << "   semanticEquals " << std::setw(10) << equals * 1000.0 << " ms"
+                  << (full == maintained ? "" : "  (MISMATCH)") << "\n";
+    }
+}
+
+void benchWrite(size_t scale) {
+    // Groups of 20 nodes give thousands of subgraphs at the default scale
+    Chart chart = MermaidParser::parseContent(generateFlowchart(scale, 20));
+    std::cout << "write: " << chart.connections.size() << " edges, " << chart.subgraphs.size() << " subgraphs\n";
+
+    std::string out;
+    double elapsed = timeBest(3, [&] { out = MermaidWriter::generateContent(chart); });
+    report("generateContent", out.size(), elapsed);
+    std::string reused;
+    elapsed = timeBest(3, [&] {
+        reused.clear();
+        MermaidWriter::generateContent(chart, reused);
+    });
+    report("generateContent(out)", reused.size(), elapsed);
+    reportAllocations("generateContent", out.size(),
+                      countAllocations([&] { MermaidWriter::generateContent(chart); }));
+}
+
+// Most heap the call held at once beyond what was live when it started
+template <typename Fn>
+size_t peakAllocation(Fn&& fn) {
+    size_t before = liveBytes.load();
+    peakLiveBytes.store(before);
+    fn();
+    return peakLiveBytes.load() - before;
+}
+
+#ifndef _WIN32
+
+void benchSink(size_t scale) {
+    Chart chart = MermaidParser::parseContent(generateFlowchart(scale));
+    std::cout << "sink: " << chart.connections.size() << " edges\n";
+    FILE* devNull = std::fopen("/dev/null", "wb");
+    if (!devNull) return;
+
+    auto row = [](const char* label, double total, double firstByte, size_t peak) {
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(9) << total * 1000.0 << " ms  ";
+        if (firstByte >= 0) {
+            std::cout << std::setw(9) << firstByte * 1000.0 << " ms to first byte ";
+        } else {
+            std::cout << std::setw(27) << "";
+        }
+        std::cout << std::setprecision(1) << std::setw(8) << peak / 1024.0 << " KB peak\n";
+    };
+
+    // Whole text first, then one write
+    double firstByte = 0;
+    size_t peak = 0;
+    double total = timeBest(3, [&] {
+        auto start = Clock::now();
+        peak = peakAllocation([&] {
+            std::string content = MermaidWriter::generateContent(chart);
+            firstByte = secondsSince(start);
+            std::fwrite(content.data(), 1, content.size(), devNull);
+        });
+    });
+    row("generateContent+fwrite", total, firstByte, peak);
+
+    total = timeBest(3, [&] {
+        auto start = Clock::now();
+        bool first = true;
+        peak = peakAllocation([&] {
+            CallbackSink sink([&](std::string_view piece) {
+                if (first) firstByte = secondsSince(start), first = false;
+                std::fwrite(piece.data(), 1, piece.size(), devNull);
+            });
+            MermaidWriter::write(chart, sink);
+        });
+    });
+    row("write(CallbackSink)", total, firstByte, peak);
+
+    total = timeBest(3, [&] {
+        peak = peakAllocation([&] {
+            FdSink sink(fileno(devNull));
+            MermaidWriter::write(chart, sink);
+        });
+    });
+    row("write(FdSink)", total, -1, peak);
+    std::fclose(devNull);
+}
+
+#endif
+
+// sample.mermaid repeated copies times, with ids and labels suffixed per copy
+Chart replicateSample(size_t copies) {
+    Chart sample = MermaidParser::parseFile("sample.mermaid");
+    Chart chart;
+    chart.direction = sample.direction;
+    for (const auto& [className, definition] : sample.classDefinitions) {
+        chart.addClass(className, definition);
+    }
+    for (size_t copy = 0; copy < copies; ++copy) {
+        std::string suffix = "_" + std::to_string(copy);
+        auto relabel = [&](const std::string& label) {
+            if (label.empty()) return label;
+            if (label.size() > 1 && label.front() == '"' && label.back() == '"') {
+                return label.substr(0, label.size() - 1) + suffix + "\"";
+            }
+            return label + suffix;
+        };
+        for (const auto& [id, node] : sample.nodes) {
+            chart.addNode(Node(id + suffix, relabel(node.label)));
+        }
+        for (const auto& [id, subgraph] : sample.subgraphs) {
+            chart.addSubgraph(SubGraph(id + suffix, relabel(subgraph.label)));
+            for (const auto& nodeId : subgraph.nodeIds) {
+                chart.addNodeToSubgraph(nodeId + suffix, id + suffix);
+            }
+        }
+        for (const auto& conn : sample.connections) {
+            chart.addConnection(Connection(conn.from + suffix, conn.to + suffix, conn.label, conn.style));
+        }
+        for (const auto& [nodeId, classes] : sample.nodeClasses) {
+            for (const auto& className : classes) {
+                chart.addNodeClass(nodeId + suffix, className);
+            }
+        }
+    }
+    return chart;
+}
+
+void benchSnapshot(size_t scale) {
+    const char* textFile = "bench_snapshot.mermaid";
+    const char* binaryFile = "bench_snapshot.bin";
+    {
+        Chart chart = MermaidParser::parseContent(MermaidWriter::generateContent(replicateSample(scale)));
+        MermaidWriter::writeToFile(chart, textFile);
+        MermaidWriter::writeSnapshotFile(chart, binaryFile);
+    }
+    size_t textBytes = MappedFile(textFile).contents().size();
+    size_t binaryBytes = MappedFile(binaryFile).contents().size();
+    std::cout << "snapshot: sample.mermaid x" << scale << ", " << textBytes << " bytes of text, "
+              << binaryBytes << " bytes of snapshot\n";
+
+    Chart parsed;
+    report("parseFile", textBytes, timeBest(3, [&] { parsed = MermaidParser::parseFile(textFile); }));
+    size_t nodes = 0;
+    report("ChartSnapshot open", binaryBytes, timeBest(3, [&] { nodes = ChartSnapshot(binaryFile).nodeCount(); }));
+    Chart loaded;
+    report("ChartSnapshot toChart", binaryBytes,
+           timeBest(3, [&] { loaded = ChartSnapshot(binaryFile).toChart(); }));
+    if (nodes != parsed.nodes.size() || loaded != parsed || loaded.fingerprint() != parsed.fingerprint()) {
+        std::cout << "  snapshot does not match the parsed chart\n";
+    }
+    Chart source = parsed;
+    report("writeSnapshotFile", binaryBytes, timeBest(3, [&] { MermaidWriter::writeSnapshotFile(source, binaryFile); }));
+    std::remove(textFile);
+    std::remove(binaryFile);
+}
+
+void benchArena(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "arena: " << scale << " edges, " << content.size() << " bytes, parse then discard\n";
+
+    // Parse and teardown timed separately; allocations and peak heap cover both
+    auto run = [&](const char* label, auto&& parse) {
+        double parseBest = 0, discardBest = 0;
+        AllocationStats stats;
+        size_t peak = 0;
+        for (int i = 0; i < 3; ++i) {
+            double parseTime = 0, discardTime = 0;
+            peak = peakAllocation([&] {
+                stats = countAllocations([&] {
+                    Clock::time_point start = Clock::now();
+                    auto chart = parse();
+                    parseTime = secondsSince(start);
+                    start = Clock::now();
+                    chart.reset();
+                    discardTime = secondsSince(start);
+                });
+            });
+            if (i == 0 || parseTime < parseBest) parseBest = parseTime;
+            if (i == 0 || discardTime < discardBest) discardBest = discardTime;
+        }
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(1)
+                  << " parse " << std::setw(7) << parseBest * 1000 << " ms, discard " << std::setprecision(2)
+                  << std::setw(7) << discardBest * 1000 << " ms, " << std::setw(8) << stats.count << " allocs, peak "
+                  << std::setprecision(1) << peak / (1024.0 * 1024.0) << " MB\n";
+    };
+    run("Chart", [&] { return std::make_unique<Chart>(MermaidParser::parseContent(content)); });
+    run("ArenaChart", [&] { return std::make_unique<ArenaChart>(ArenaChart::parse(content)); });
+}
+
+// An endless-generator stand-in: a flowchart of the given number of edges
+// among a fixed set of nodes, produced a few KB at a time so the whole text
+// never exists at once
+class GeneratedFlowchart : public std::streambuf {
+public:
+    GeneratedFlowchart(size_t edges, size_t nodes) : edges(edges), nodes(nodes) {}
+
+protected:
+    int_type underflow() override {
+        chunk.clear();
+        if (next == 0 && !header) {
+            chunk = "flowchart LR\n";
+            header = true;
+        }
+        while (chunk.size() < 4096 && next < edges) {
+            size_t from = next % nodes;
+            size_t to = (next * 7919 + 1) % nodes;
+            chunk += "    n" + std::to_string(from) + " --> n" + std::to_string(to) + "\n";
+            ++next;
+        }
+        if (chunk.empty()) return traits_type::eof();
+        setg(chunk.data(), chunk.data(), chunk.data() + chunk.size());
+        return traits_type::to_int_type(chunk[0]);
+    }
+
+private:
+    size_t edges;
+    size_t nodes;
+    size_t next = 0;
+    bool header = false;
+    std::string chunk;
+};
+
+void benchBlocks(size_t scale) {
+    const size_t nodes = 10000;
+    std::cout << "blocks: " << nodes << " distinct nodes, edges streamed from a generator\n";
+    for (size_t edges : {scale / 10, scale}) {
+        size_t count = 0;
+        size_t peak = 0;
+        double seconds = timeBest(3, [&] {
+            GeneratedFlowchart source(edges, nodes);
+            std::istream in(&source);
+            EdgeCounter counter;
+            peak = peakAllocation([&] { MermaidParser::parseStream(in, counter); });
+            count = counter.edges;
+        });
+        std::cout << "  parseStream " << std::setw(9) << count << " edges " << std::fixed << std::setprecision(1)
+                  << std::setw(8) << seconds * 1000 << " ms, peak " << std::setprecision(2)
+                  << peak / (1024.0 * 1024.0) << " MB\n";
+    }
+
+    // For comparison: read everything first, then run the reader over it
+    size_t edges = scale / 10;
+    size_t peak = peakAllocation([&] {
+        GeneratedFlowchart source(edges, nodes);
+        std::string content(std::istreambuf_iterator<char>(&source), {});
+        EdgeCounter counter;
+        MermaidReader::parse(content, counter);
+    });
+    std::cout << "  whole input " << std::setw(9) << edges << " edges, peak " << std::setprecision(2)
+              << peak / (1024.0 * 1024.0) << " MB\n";
+}
+
+void benchLazy(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "lazy: " << scale << " edges, " << content.size() << " bytes, parse then count out-degrees\n";
+
+    // A topology-only query: the largest out-degree
+    auto run = [&](const char* label, auto&& parse, auto&& query) {
+        double parseBest = 0, queryBest = 0;
+        AllocationStats stats;
+        size_t peak = 0;
+        for (int i = 0; i < 3; ++i) {
+            double parseTime = 0, queryTime = 0;
+            peak = peakAllocation([&] {
+                stats = countAllocations([&] {
+                    Clock::time_point start = Clock::now();
+                    auto chart = parse();
+                    parseTime = secondsSince(start);
+                    start = Clock::now();
+                    if (query(chart) == 0) std::cout << "  no edges?\n";
+                    queryTime = secondsSince(start);
+                });
+            });
+            if (i == 0 || parseTime < parseBest) parseBest = parseTime;
+            if (i == 0 || queryTime < queryBest) queryBest = queryTime;
+        }
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(1)
+                  << " parse " << std::setw(7) << parseBest * 1000 << " ms, query " << std::setprecision(2)
+                  << std::setw(7) << queryBest * 1000 << " ms, " << std::setw(8) << stats.count << " allocs, peak "
+                  << std::setprecision(1) << peak / (1024.0 * 1024.0) << " MB\n";
+    };
+    run("Chart", [&] { return MermaidParser::parseContent(content); },
+        [](const Chart& chart) {
+            size_t best = 0;
+            for (const auto& [id, targets] : chart.successors) best = std::max(best, targets.size());
+            return best;
+        });
+    run("LazyChart", [&] { return LazyChart::parse(content); },
+        [](const LazyChart& chart) {
+            size_t best = 0;
+            for (LazyChart::NodeHandle n = 0; n < chart.nodeCount(); ++n) {
+                best = std::max(best, chart.successors(n).size());
+            }
+            return best;
+        });
+
+    // Decoding every label afterwards, for comparison with the eager copies
+    LazyChart chart = LazyChart::parse(content);
+    size_t bytes = 0;
+    double decode = timeBest(3, [&] {
+        bytes = 0;
+        for (LazyChart::NodeHandle n = 0; n < chart.nodeCount(); ++n) bytes += chart.label(n).size();
+    });
+    std::cout << "  decode all " << chart.nodeCount() << " labels " << std::setprecision(2) << decode * 1000
+              << " ms (" << bytes << " bytes)\n";
+}
+
+void benchReachabilityIndex(size_t scale) {
+    std::mt19937 random(5);
+    for (int shape = 0; shape < 3; ++shape) {
+        const char* names[] = {"sample.mermaid x", "windowed DAG, nodes ", "random graph, nodes "};
+        size_t size = shape == 0 ? scale / 100 : scale;
+        ChartGraph graph = shape == 0   ? ChartGraph(replicateSample(size))
+                           : shape == 1 ? ChartGraph(generateDag(size, 0))
+                                        : generateRandomGraph(size, 4);
+        std::cout << "reachindex: " << names[shape] << size << ", " << graph.edgeCount() << " edges\n";
+
+        std::unique_ptr<ReachabilityIndex> index;
+        double build = 0;
+        try {
+            build = timeBest(1, [&] { index.reset(new ReachabilityIndex(graph)); });
+        } catch (const std::exception& e) {
+            std::cout << "  " << e.what() << "\n";
+            continue;
+        }
+
+        const size_t queries = 1000000;
+        std::vector<std::pair<ChartGraph::NodeHandle, ChartGraph::NodeHandle>> pairs(queries);
+        for (auto& pair : pairs) {
+            pair.first = static_cast<ChartGraph::NodeHandle>(random() % graph.nodeCount());
+            pair.second = static_cast<ChartGraph::NodeHandle>(random() % graph.nodeCount());
+        }
+        size_t hits = 0;
+        double query = timeBest(3, [&] {
+            hits = 0;
+            for (const auto& [from, to] : pairs) hits += index->reaches(from, to);
+        });
+        double bfs = timeBest(1, [&] { GraphAlgorithms::downstream(graph, pairs[0].first); });
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "  build                    " << std::setw(9) << build * 1000.0 << " ms, "
+                  << index->componentCount() << " components, " << index->intervalCount() << " intervals\n"
+                  << "  memory                   " << std::setw(9) << index->memoryUsage() / (1024.0 * 1024.0)
+                  << " MB\n"
+                  << "  reaches                  " << std::setw(9) << query * 1e9 / queries << " ns/query ("
+                  << hits << " of " << queries << " reachable)\n"
+                  << "  downstream (BFS)         " << std::setw(9) << bfs * 1e9 << " ns/query\n";
+    }
+}
+
+// Mean time of an edit repeated on the same document, in microseconds
+template <typename Fn>
+double timeEdits(int edits, Fn&& fn) {
+    auto start = Clock::now();
+    for (int i = 0; i < edits; ++i) fn(i);
+    return secondsSince(start) * 1e6 / edits;
+}
+
+void benchEdit(size_t scale) {
+    std::string content = generateFlowchart(scale);
+    std::cout << "edit: " << scale << " edges, " << content.size() << " bytes\n";
+
+    report("parseContent", content.size(), timeBest(3, [&] { MermaidParser::parseContent(content); }));
+    // Built once: replacing a document frees the old one's many small blocks,
+    // which the allocator then sorts through during the first edits timed
+    Clock::time_point start = Clock::now();
+    MermaidDocument doc(content);
+    report("MermaidDocument", content.size(), secondsSince(start));
+
+    // Edits land on an edge line half way through the document
+    const int edits = 200;
+    size_t middle = doc.text().find("    n", doc.text().find("%% edges") + content.size() / 4);
+    auto row = [](const char* label, double micros) {
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(9) << micros << " us/edit\n";
+    };
+    row("relabel node", timeEdits(edits, [&](int i) {
+        std::string line = i % 2 ? "    n1[\"one\"] --> n2\n" : "    n1[\"uno\"] --> n2\n";
+        doc.edit(middle, i == 0 ? 0 : line.size(), line);
+    }));
+    row("insert + delete line", timeEdits(edits, [&](int i) {
+        if (i % 2 == 0) {
+            doc.edit(middle, 0, "    x1 --> x2\n");
+        } else {
+            doc.edit(middle, 14, "");
+        }
+    }));
+    // Reading the chart materializes what the edits changed: in place for a
+    // relabelled connection, by moving the connections after it for an
+    // inserted or deleted one. The first read catches up with the edits above.
+    doc.chart();
+    row("relabel + chart()", timeEdits(edits, [&](int i) {
+        std::string line = i % 2 ? "    n1[\"one\"] --> n2\n" : "    n1[\"uno\"] --> n2\n";
+        doc.edit(middle, line.size(), line);
+        doc.chart();
+    }));
+    row("insert + chart()", timeEdits(edits, [&](int i) {
+        if (i % 2 == 0) {
+            doc.edit(middle, 0, "    x1 --> x2\n");
+        } else {
+            doc.edit(middle, 14, "");
+        }
+        doc.chart();
+    }));
+    row("append line", timeEdits(edits, [&](int i) {
+        doc.edit(doc.size(), 0, "    a" + std::to_string(i) + " --> n1\n");
+    }));
+    row("type one character", timeEdits(edits, [&](int) { doc.edit(middle + 5, 0, "x"); }));
+    std::cout << "  " << doc.rebuildCount() << " rebuilds\n";
+}
+
+struct Benchmark {
+    const char* name;
+    size_t defaultScale;
+    void (*run)(size_t scale);
+};
+
+const Benchmark benchmarks[] = {
+    {"parse", 5000, benchParse},
+    {"regex", 20000, benchRegex},
+    {"alloc", 2000, benchAllocations},
+    {"arena", 1000000, benchArena},
+    {"lazy", 1000000, benchLazy},
+#ifndef _WIN32
+    {"rss", 200000, benchPeakRss},
+#endif
+    {"graph", 1000000, benchGraph},
+    {"builder", 1000000, benchBuilder},
+    {"dedup", 1000000, benchDedup},
+    {"algorithms", 1000000, benchAlgorithms},
+    {"bfs", 1000000, benchBfs},
+    {"reachindex", 1000000, benchReachabilityIndex},
+    {"parallel", 1000000, benchParallel},
+    {"stream", 200000, benchStream},
+    {"blocks", 10000000, benchBlocks},
+    {"edit", 200000, benchEdit},
+    {"semantic", 1000000, benchSemanticEquals},
+    {"diff", 1000000, benchDiff},
+    {"patch", 1000000, benchPatch},
+    {"store", 200000, benchStore},
+    {"fingerprint", 1000000, benchFingerprint},
+    {"write", 200000, benchWrite},
+#ifndef _WIN32
+    {"sink", 1000000, benchSink},
+#endif
+    {"snapshot", 10000, benchSnapshot},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* only = argc > 1 ? argv[1] : nullptr;
+    size_t scale = argc > 2 ? std::stoul(argv[2]) : 0;
+
+    bool ran = false;
+    for (const auto& bench : benchmarks) {
+        if (only && std::strcmp(only, bench.name) != 0) continue;
+        bench.run(scale ? scale : bench.defaultScale);
+        ran = true;
+    }
+
+    if (!ran) {
+        std::cerr << "Unknown benchmark: " << only << "\nAvailable:";
+        for (const auto& bench : benchmarks) std::cerr << " " << bench.name;
+        std::cerr << std::endl;
+        return 1;
+    }
+    return 0;
+}
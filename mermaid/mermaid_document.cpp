@@ -0,0 +1,592 @@
+#include "mermaid_document.h"
+#include "mermaid_lexer.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Lines are numbered with gaps so inserted lines can be given keys between
+// their neighbors without renumbering. Lines typed in the middle of the
+// document take small steps so the gap lasts; when a gap runs out the
+// document is rebuilt, which renumbers everything.
+constexpr uint64_t kKeySpacing = uint64_t(1) << 32;
+constexpr uint64_t kInsertStep = uint64_t(1) << 20;
+
+template <typename Map>
+typename Map::mapped_type& entry(Map& map, std::string_view key) {
+    auto it = map.find(key);
+    if (it == map.end()) {
+        it = map.emplace(std::string(key), typename Map::mapped_type()).first;
+    }
+    return it->second;
+}
+
+// Subgraph, end and flowchart lines change the context of every line after
+// them, so they cannot be patched locally
+bool isStructural(std::string_view text) {
+    Direction direction;
+    if (scanFlowchartHeader(text, &direction)) return true;
+    MermaidStatement::Kind kind = scanStatement(text).kind;
+    return kind == MermaidStatement::Kind::Subgraph || kind == MermaidStatement::Kind::End;
+}
+
+} // namespace
+
+MermaidDocument::MermaidDocument(std::string text) : content(std::move(text)) {
+    build();
+}
+
+void MermaidDocument::build() {
+    std::vector<Line> split;
+    for (size_t start = 0, i = 1;; ++i) {
+        size_t newline = content.find('\n', start);
+        size_t end = newline == std::string::npos ? content.size() : newline;
+        split.push_back(Line{content.substr(start, end - start), i * kKeySpacing, 0});
+        if (newline == std::string::npos) break;
+        start = newline + 1;
+    }
+
+    // First pass: direction, subgraph declarations and each line's context
+    std::map<std::string, uint32_t, std::less<>> scopeIndex;
+    std::vector<uint32_t> stack;
+    bool inFlowchart = false;
+    for (Line& line : split) {
+        if (!inFlowchart && scanFlowchartHeader(line.text, &parsed.direction)) {
+            inFlowchart = true;
+        }
+        line.context = stack.empty() ? 0 : stack.back();
+
+        MermaidStatement st = scanStatement(line.text);
+        if (st.kind == MermaidStatement::Kind::Subgraph) {
+            auto it = scopeIndex.find(st.id);
+            if (it == scopeIndex.end()) {
+                it = scopeIndex.emplace(std::string(st.id), static_cast<uint32_t>(scopes.size())).first;
+                scopes.push_back(Scope{std::string(st.id), OrderKey{0, 0}});
+            }
+            scopes[it->second].declared = OrderKey{line.key, 0};
+            parsed.addSubgraph(SubGraph(std::string(st.id), std::string(st.label)));
+            stack.push_back(it->second + 1);
+        } else if (st.kind == MermaidStatement::Kind::End && !stack.empty()) {
+            stack.pop_back();
+        }
+    }
+
+    if (!inFlowchart) {
+        throw std::runtime_error("No valid flowchart declaration found");
+    }
+
+    // Second pass: every other statement, in document order
+    for (const Line& line : split) {
+        applyLine(line.text, line.key, line.context, true);
+    }
+    refresh();
+    lines.assign(std::move(split), [](const Line& line) { return line.text.size() + 1; });
+
+    parsed.connections.reserve(connections.size());
+    connectionKeys.reserve(connections.size());
+    connections.forEach([&](const KeyedConnection& item) {
+        parsed.connections.push_back(item.conn);
+        connectionKeys.push_back(item.key);
+    });
+    touchedConnections.clear();
+}
+
+void MermaidDocument::edit(size_t offset, size_t length, std::string_view replacement) {
+    if (offset > size() || length > size() - offset) {
+        throw std::runtime_error("Edit range is outside the document");
+    }
+
+    // The edit replaces whole lines first..last with the lines of region
+    size_t first = lines.indexAt(offset);
+    size_t last = lines.indexAt(offset + length);
+    std::string region = lines[first].text;
+    for (size_t i = first + 1; i <= last; ++i) {
+        region += '\n';
+        region += lines[i].text;
+    }
+    region.replace(offset - lines.offsetOf(first), length, replacement.data(), replacement.size());
+
+    std::vector<std::string_view> regionLines;
+    for (size_t start = 0;;) {
+        size_t newline = region.find('\n', start);
+        size_t end = newline == std::string::npos ? region.size() : newline;
+        regionLines.push_back(std::string_view(region).substr(start, end - start));
+        if (newline == std::string::npos) break;
+        start = newline + 1;
+    }
+
+    bool rebuild = false;
+    for (size_t i = first; i <= last && !rebuild; ++i) {
+        rebuild = isStructural(lines[i].text);
+    }
+    for (size_t i = 0; i < regionLines.size() && !rebuild; ++i) {
+        rebuild = isStructural(regionLines[i]);
+    }
+
+    // Lines beyond the ones being replaced need fresh keys in the gap before
+    // the next line
+    size_t oldCount = last - first + 1;
+    size_t newCount = regionLines.size();
+    size_t reused = std::min(oldCount, newCount);
+    uint64_t step = 0;
+    if (!rebuild && newCount > reused) {
+        uint64_t extra = newCount - reused;
+        uint64_t prev = lines[first + reused - 1].key;
+        if (last + 1 < lines.size()) {
+            step = std::min((lines[last + 1].key - prev) / (extra + 1), kInsertStep);
+        } else if ((UINT64_MAX - prev) / (extra + 1) >= kKeySpacing) {
+            step = kKeySpacing;
+        }
+        rebuild = step == 0;
+    }
+
+    if (rebuild) {
+        std::string text = this->text();
+        text.replace(offset, length, replacement.data(), replacement.size());
+        MermaidDocument document(std::move(text));
+        document.rebuilds = rebuilds + 1;
+        *this = std::move(document);
+        return;
+    }
+
+    // No structural lines on either side, so every line in the region keeps
+    // the context of the lines it replaces
+    uint32_t context = lines[first].context;
+    std::vector<uint64_t> keys(newCount);
+    std::vector<bool> patched(newCount, false);
+    for (size_t i = 0; i < oldCount; ++i) {
+        const Line& line = lines[first + i];
+        if (i < reused) {
+            keys[i] = line.key;
+            // A connection edited into another connection keeps its slot, so
+            // typing inside an edge line does not shift Chart::connections
+            MermaidStatement was = scanStatement(line.text);
+            MermaidStatement now = scanStatement(regionLines[i]);
+            if (was.kind == MermaidStatement::Kind::Connection && now.kind == MermaidStatement::Kind::Connection) {
+                replaceConnections(was, now, line.key, context);
+                patched[i] = true;
+                continue;
+            }
+        }
+        applyLine(line.text, line.key, context, false);
+    }
+    for (size_t i = reused; i < newCount; ++i) {
+        keys[i] = keys[reused - 1] + (i - reused + 1) * step;
+    }
+
+    for (size_t i = 0; i < oldCount; ++i) {
+        lines.erase(first);
+    }
+    for (size_t i = 0; i < newCount; ++i) {
+        lines.insert(first + i, Line{std::string(regionLines[i]), keys[i], context}, regionLines[i].size() + 1);
+        if (!patched[i]) applyLine(regionLines[i], keys[i], context, true);
+    }
+    textStale = true;
+    refresh();
+}
+
+const std::string& MermaidDocument::text() const {
+    if (textStale) {
+        content.clear();
+        content.reserve(size());
+        lines.forEach([&](const Line& line) {
+            content += line.text;
+            content += '\n';
+        });
+        content.pop_back();
+        textStale = false;
+    }
+    return content;
+}
+
+const Chart& MermaidDocument::chart() const {
+    auto& touched = touchedConnections;
+    if (touched.empty()) return parsed;
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    // Keys both materialized and still present are replaced in place; the
+    // rest were added or removed since the last read
+    auto& list = parsed.connections;
+    std::vector<std::pair<OrderKey, const Connection*>> added;
+    std::vector<OrderKey> removed;
+    for (OrderKey key : touched) {
+        size_t c = connectionIndex(key);
+        const Connection* now = c < connections.size() && connections[c].key == key ? &connections[c].conn : nullptr;
+        auto it = std::lower_bound(connectionKeys.begin(), connectionKeys.end(), key);
+        if (it != connectionKeys.end() && *it == key) {
+            if (now) {
+                list[it - connectionKeys.begin()] = *now;
+            } else {
+                removed.push_back(key);
+            }
+        } else if (now) {
+            added.emplace_back(key, now);
+        }
+    }
+    touched.clear();
+    if (added.empty() && removed.empty()) return parsed;
+
+    // Removed entries are compacted out in a forward pass from the first of
+    // them, then added ones merged in by key in a backward pass from the end
+    // down to the first of them, so only the entries after a change move
+    if (!removed.empty()) {
+        size_t write = std::lower_bound(connectionKeys.begin(), connectionKeys.end(), removed.front()) -
+                       connectionKeys.begin();
+        size_t r = 0;
+        for (size_t i = write; i < list.size(); ++i) {
+            if (r < removed.size() && removed[r] == connectionKeys[i]) {
+                ++r;
+                continue;
+            }
+            list[write] = std::move(list[i]);
+            connectionKeys[write++] = connectionKeys[i];
+        }
+        list.resize(write);
+        connectionKeys.resize(write);
+    }
+    if (!added.empty()) {
+        size_t i = list.size();
+        size_t write = i + added.size();
+        list.resize(write);
+        connectionKeys.resize(write);
+        for (size_t a = added.size(); a > 0;) {
+            --write;
+            if (i > 0 && added[a - 1].first < connectionKeys[i - 1]) {
+                --i;
+                list[write] = std::move(list[i]);
+                connectionKeys[write] = connectionKeys[i];
+            } else {
+                --a;
+                list[write] = *added[a].second;
+                connectionKeys[write] = added[a].first;
+            }
+        }
+    }
+    return parsed;
+}
+
+size_t MermaidDocument::connectionIndex(OrderKey key) const {
+    return connections.partitionPoint([&](const KeyedConnection& item) { return item.key < key; });
+}
+
+void MermaidDocument::touchConnection(OrderKey key) {
+    touchedConnections.push_back(key);
+    // Without reads the list would grow with every edit; catching up once it
+    // outgrows the chart keeps that amortized O(1)
+    if (touchedConnections.size() > connections.size() + connectionKeys.size()) {
+        chart();
+    }
+}
+
+void MermaidDocument::applyLine(std::string_view text, uint64_t key, uint32_t context, bool add) {
+    MermaidStatement st = scanStatement(text);
+    switch (st.kind) {
+    case MermaidStatement::Kind::Connection:
+        addConnections(st, key, context, add);
+        break;
+    case MermaidStatement::Kind::ClassDef:
+        addClassDef(st.id, st.label, OrderKey{key, 0}, add);
+        break;
+    case MermaidStatement::Kind::Class: {
+        uint32_t item = 0;
+        forEachListItem(st.list, [&](std::string_view nodeId) {
+            addNodeClass(nodeId, st.id, OrderKey{key, item++}, add);
+        });
+        break;
+    }
+    case MermaidStatement::Kind::Node:
+        addReference(st.id, OrderKey{key, 0}, st.label, context, add);
+        break;
+    default:
+        // Subgraph and end lines are handled by build()
+        break;
+    }
+}
+
+MermaidDocument::IdMap::iterator MermaidDocument::touch(std::string_view id) {
+    auto it = ids.find(id);
+    if (it == ids.end()) {
+        it = ids.emplace(std::string(id), IdState()).first;
+    }
+    if (!it->second.dirty) {
+        it->second.dirty = true;
+        dirtyIds.push_back(it);
+    }
+    return it;
+}
+
+void MermaidDocument::addReference(std::string_view id, OrderKey key, std::string_view label,
+                                   uint32_t context, bool add) {
+    IdState& state = touch(id)->second;
+    if (add) {
+        state.refs.emplace(key, context);
+        if (!label.empty()) state.labels.emplace(key, std::string(label));
+    } else {
+        state.refs.erase(key);
+        state.labels.erase(key);
+    }
+}
+
+void MermaidDocument::addConnection(std::string_view from, std::string_view to, std::string_view label,
+                                    std::string_view style, OrderKey key, bool add) {
+    size_t c = connectionIndex(key);
+    if (add) {
+        Connection conn{std::string(from), std::string(to), std::string(label), std::string(style)};
+        parsed.hashConnection(conn, true);
+        connections.insert(c, KeyedConnection{key, std::move(conn)}, 1);
+    } else {
+        parsed.hashConnection(connections[c].conn, false);
+        connections.erase(c);
+    }
+    touchConnection(key);
+    linkNodes(from, to, key, add);
+}
+
+// A connection line's references are keyed by vertex position and its
+// connections by edge position, both within the line's key
+void MermaidDocument::addConnections(const MermaidStatement& st, uint64_t line, uint32_t context, bool add) {
+    for (uint32_t v = 0; v < st.vertices.size(); ++v) {
+        addReference(st.vertices[v].id, OrderKey{line, v}, st.vertices[v].label, context, add);
+    }
+    for (uint32_t e = 0; e < st.edges.size(); ++e) {
+        const MermaidEdge& edge = st.edges[e];
+        addConnection(st.vertices[edge.from].id, st.vertices[edge.to].id, edge.label, edge.style,
+                      OrderKey{line, e}, add);
+    }
+}
+
+void MermaidDocument::replaceConnections(const MermaidStatement& before, const MermaidStatement& after,
+                                         uint64_t line, uint32_t context) {
+    for (uint32_t v = 0; v < before.vertices.size(); ++v) {
+        addReference(before.vertices[v].id, OrderKey{line, v}, before.vertices[v].label, context, false);
+    }
+    for (uint32_t v = 0; v < after.vertices.size(); ++v) {
+        addReference(after.vertices[v].id, OrderKey{line, v}, after.vertices[v].label, context, true);
+    }
+
+    // Edges at the same position keep their slot in Chart::connections
+    size_t common = std::min(before.edges.size(), after.edges.size());
+    for (uint32_t e = 0; e < common; ++e) {
+        OrderKey key{line, e};
+        std::string_view oldFrom = before.vertices[before.edges[e].from].id;
+        std::string_view oldTo = before.vertices[before.edges[e].to].id;
+        const MermaidEdge& edge = after.edges[e];
+        std::string_view from = after.vertices[edge.from].id;
+        std::string_view to = after.vertices[edge.to].id;
+
+        Connection& conn = connections[connectionIndex(key)].conn;
+        parsed.hashConnection(conn, false);
+        if (conn.from != from) conn.from = from;
+        if (conn.to != to) conn.to = to;
+        if (conn.label != edge.label) conn.label = edge.label;
+        if (conn.style != edge.style) conn.style = edge.style;
+        parsed.hashConnection(conn, true);
+        touchConnection(key);
+        if (oldFrom != from || oldTo != to) {
+            linkNodes(oldFrom, oldTo, key, false);
+            linkNodes(from, to, key, true);
+        }
+    }
+    for (uint32_t e = static_cast<uint32_t>(common); e < before.edges.size(); ++e) {
+        const MermaidEdge& edge = before.edges[e];
+        addConnection(before.vertices[edge.from].id, before.vertices[edge.to].id, edge.label, edge.style,
+                      OrderKey{line, e}, false);
+    }
+    for (uint32_t e = static_cast<uint32_t>(common); e < after.edges.size(); ++e) {
+        const MermaidEdge& edge = after.edges[e];
+        addConnection(after.vertices[edge.from].id, after.vertices[edge.to].id, edge.label, edge.style,
+                      OrderKey{line, e}, true);
+    }
+}
+
+void MermaidDocument::linkNodes(std::string_view from, std::string_view to, OrderKey key, bool add) {
+    IdState& source = touch(from)->second;
+    IdState& target = touch(to)->second;
+    size_t o = std::lower_bound(source.outKeys.begin(), source.outKeys.end(), key) - source.outKeys.begin();
+    size_t i = std::lower_bound(target.inKeys.begin(), target.inKeys.end(), key) - target.inKeys.begin();
+
+    if (add) {
+        source.outKeys.insert(source.outKeys.begin() + o, key);
+        auto& successors = entry(parsed.successors, from);
+        successors.insert(successors.begin() + o, std::string(to));
+        target.inKeys.insert(target.inKeys.begin() + i, key);
+        auto& predecessors = entry(parsed.predecessors, to);
+        predecessors.insert(predecessors.begin() + i, std::string(from));
+        return;
+    }
+
+    source.outKeys.erase(source.outKeys.begin() + o);
+    auto successors = parsed.successors.find(from);
+    successors->second.erase(successors->second.begin() + o);
+    if (successors->second.empty()) parsed.successors.erase(successors);
+    target.inKeys.erase(target.inKeys.begin() + i);
+    auto predecessors = parsed.predecessors.find(to);
+    predecessors->second.erase(predecessors->second.begin() + i);
+    if (predecessors->second.empty()) parsed.predecessors.erase(predecessors);
+}
+
+void MermaidDocument::addNodeClass(std::string_view id, std::string_view className, OrderKey key, bool add) {
+    IdState& state = touch(id)->second;
+    size_t i = std::lower_bound(state.classKeys.begin(), state.classKeys.end(), key) - state.classKeys.begin();
+    if (add) {
+        state.classKeys.insert(state.classKeys.begin() + i, key);
+        auto classes = parsed.nodeClasses.find(id);
+        if (classes == parsed.nodeClasses.end()) {
+            classes = parsed.nodeClasses.emplace(std::string(id), std::vector<std::string>()).first;
+            parsed.hashNodeClassKey(classes->first, true);
+        }
+        auto& list = classes->second;
+        if (std::find(list.begin(), list.end(), className) == list.end()) {
+            parsed.hashNodeClass(classes->first, std::string(className), true);
+        }
+        list.insert(list.begin() + i, std::string(className));
+        return;
+    }
+    state.classKeys.erase(state.classKeys.begin() + i);
+    auto classes = parsed.nodeClasses.find(id);
+    auto& list = classes->second;
+    std::string removed = std::move(list[i]);
+    list.erase(list.begin() + i);
+    if (std::find(list.begin(), list.end(), removed) == list.end()) {
+        parsed.hashNodeClass(classes->first, removed, false);
+    }
+    if (list.empty()) {
+        parsed.hashNodeClassKey(classes->first, false);
+        parsed.nodeClasses.erase(classes);
+    }
+}
+
+void MermaidDocument::addClassDef(std::string_view className, std::string_view definition,
+                                  OrderKey key, bool add) {
+    auto& definitions = entry(classDefs, className);
+    if (add) {
+        definitions.emplace(key, std::string(definition));
+    } else {
+        definitions.erase(key);
+    }
+    dirtyClasses.emplace_back(className);
+}
+
+void MermaidDocument::refresh() {
+    for (IdMap::iterator it : dirtyIds) {
+        refreshNode(it);
+    }
+    dirtyIds.clear();
+
+    // The last definition of a class wins
+    for (const std::string& className : dirtyClasses) {
+        auto it = classDefs.find(className);
+        if (it == classDefs.end()) continue;
+        auto current = parsed.classDefinitions.find(className);
+        if (current != parsed.classDefinitions.end()) {
+            parsed.hashClassDefinition(className, current->second, false);
+        }
+        if (it->second.empty()) {
+            if (current != parsed.classDefinitions.end()) parsed.classDefinitions.erase(current);
+            classDefs.erase(it);
+        } else {
+            const std::string& definition = it->second.rbegin()->second;
+            if (current == parsed.classDefinitions.end()) {
+                parsed.classDefinitions.emplace(className, definition);
+            } else {
+                current->second = definition;
+            }
+            parsed.hashClassDefinition(className, definition, true);
+        }
+    }
+    dirtyClasses.clear();
+
+    // A label maps to the node whose first sighting carried it most recently
+    for (const std::string& label : dirtyLabels) {
+        auto it = labelOwners.find(label);
+        if (it == labelOwners.end()) continue;
+        if (it->second.empty()) {
+            parsed.nameToId.erase(label);
+            labelOwners.erase(it);
+        } else {
+            parsed.nameToId[label] = it->second.rbegin()->second;
+        }
+    }
+    dirtyLabels.clear();
+}
+
+void MermaidDocument::refreshNode(IdMap::iterator it) {
+    const std::string& id = it->first;
+    IdState& state = it->second;
+    state.dirty = false;
+
+    if (state.refs.empty()) {
+        auto node = parsed.nodes.find(id);
+        if (node != parsed.nodes.end()) {
+            parsed.hashNode(node->second, false);
+            parsed.nodes.erase(node);
+        }
+        setMember(id, state, 0);
+        setName(id, state, false, OrderKey{0, 0}, std::string());
+        if (state.outKeys.empty() && state.inKeys.empty() && state.classKeys.empty()) {
+            ids.erase(it);
+        }
+        return;
+    }
+
+    // The last non-empty label wins
+    static const std::string noLabel;
+    const std::string& label = state.labels.empty() ? noLabel : state.labels.rbegin()->second;
+    auto node = parsed.nodes.find(id);
+    if (node == parsed.nodes.end()) {
+        node = parsed.nodes.emplace(id, Node(id, label)).first;
+        parsed.hashNode(node->second, true);
+    } else if (node->second.label != label) {
+        parsed.hashNode(node->second, false);
+        node->second.label = label;
+        parsed.hashNode(node->second, true);
+    }
+
+    // The first sighting decides subgraph membership, unless the subgraph is
+    // declared again later, which resets its members
+    auto firstRef = state.refs.begin();
+    uint32_t context = firstRef->second;
+    setMember(id, state, context != 0 && scopes[context - 1].declared < firstRef->first ? context : 0);
+
+    auto firstLabel = state.labels.find(firstRef->first);
+    if (firstLabel != state.labels.end()) {
+        setName(id, state, true, firstRef->first, firstLabel->second);
+    } else {
+        setName(id, state, false, OrderKey{0, 0}, std::string());
+    }
+}
+
+void MermaidDocument::setName(const std::string& id, IdState& state, bool named, OrderKey key,
+                              const std::string& label) {
+    if (state.named == named && (!named || (state.nameKey == key && state.nameLabel == label))) return;
+    if (state.named) {
+        // A reused line key may already have been claimed by another id
+        auto& owners = labelOwners[state.nameLabel];
+        auto owner = owners.find(state.nameKey);
+        if (owner != owners.end() && owner->second == id) owners.erase(owner);
+        dirtyLabels.push_back(state.nameLabel);
+    }
+    if (named) {
+        labelOwners[label][key] = id;
+        dirtyLabels.push_back(label);
+    }
+    state.named = named;
+    state.nameKey = key;
+    state.nameLabel = label;
+}
+
+void MermaidDocument::setMember(const std::string& id, IdState& state, uint32_t member) {
+    if (state.member == member) return;
+    if (state.member != 0) {
+        const std::string& subgraphId = scopes[state.member - 1].id;
+        parsed.subgraphs[subgraphId].nodeIds.erase(id);
+        parsed.hashSubgraphMember(subgraphId, id, false);
+    }
+    if (member != 0) {
+        const std::string& subgraphId = scopes[member - 1].id;
+        parsed.subgraphs[subgraphId].nodeIds.insert(id);
+        parsed.hashSubgraphMember(subgraphId, id, true);
+    }
+    state.member = member;
+}
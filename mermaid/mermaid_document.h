@@ -0,0 +1,139 @@
+#ifndef MERMAID_DOCUMENT_H
+#define MERMAID_DOCUMENT_H
+
+#include "mermaid_parser.h"
+#include "sequence_tree.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct MermaidStatement;
+
+// A Mermaid source text kept together with its parsed Chart, for editors that
+// re-parse on every keystroke. edit() re-lexes only the lines an edit touches
+// and patches nodes, labels, connections, adjacency, classes and subgraph
+// membership in place; chart() is always exactly what
+// MermaidParser::parseContent(text()) would return.
+//
+// To make that possible the document remembers, per id, every line that
+// references it (first sighting decides existence and subgraph membership,
+// the last non-empty label wins) under order keys that survive insertions.
+// Edits that add or remove subgraph, end or flowchart lines change the
+// context of everything after them and fall back to a full rebuild.
+//
+// Apart from rebuilds, an edit costs O(log n) per line and connection it
+// touches, plus the degree of the ids on those lines: the lines live in an
+// order-statistic tree that finds a byte offset and splices lines without
+// shifting the ones after them, and the connections in another, in
+// Chart::connections order. text() and chart().connections are materialized
+// from those trees when read after an edit, in time linear in the document,
+// except that connections replaced in place are patched in at O(log n)
+// each. Because of that lazy step, text() and chart() are not safe to call
+// from several threads at once.
+class MermaidDocument {
+public:
+    // Throws std::runtime_error like parseContent when there is no flowchart
+    // declaration
+    explicit MermaidDocument(std::string text);
+
+    // Replaces length bytes at offset with replacement. Throws
+    // std::runtime_error, leaving the document unchanged, if the range is
+    // outside the text or the result has no flowchart declaration.
+    void edit(size_t offset, size_t length, std::string_view replacement);
+
+    const std::string& text() const;
+    // Length of text(), without materializing it
+    size_t size() const { return lines.totalWeight() - 1; }
+    const Chart& chart() const;
+    // Edits that could not be applied incrementally
+    size_t rebuildCount() const { return rebuilds; }
+
+private:
+    // Position of a reference: the line's order key plus its index on the line
+    struct OrderKey {
+        uint64_t line;
+        uint32_t item;
+
+        bool operator<(const OrderKey& other) const {
+            return line < other.line || (line == other.line && item < other.item);
+        }
+        bool operator==(const OrderKey& other) const {
+            return line == other.line && item == other.item;
+        }
+    };
+
+    // Weighs its length plus the newline in the tree, the last line included
+    struct Line {
+        std::string text;
+        uint64_t key;
+        uint32_t context; // enclosing subgraph scope + 1, 0 at top level
+    };
+
+    struct KeyedConnection {
+        OrderKey key;
+        Connection conn;
+    };
+
+    struct Scope {
+        std::string id;
+        OrderKey declared; // last declaration, which resets membership
+    };
+
+    // Everything the document knows about one id, node or not
+    struct IdState {
+        std::map<OrderKey, uint32_t> refs;       // sightings and their context
+        std::map<OrderKey, std::string> labels;  // non-empty labels only
+        std::vector<OrderKey> outKeys;           // parallel to Chart::successors[id]
+        std::vector<OrderKey> inKeys;            // parallel to Chart::predecessors[id]
+        std::vector<OrderKey> classKeys;         // parallel to Chart::nodeClasses[id]
+        uint32_t member = 0;                     // scope whose nodeIds holds the id
+        bool named = false;                      // registered in labelOwners
+        OrderKey nameKey{0, 0};
+        std::string nameLabel;
+        bool dirty = false;
+    };
+
+    using IdMap = std::map<std::string, IdState, std::less<>>;
+
+    void build();
+    size_t connectionIndex(OrderKey key) const;
+    void touchConnection(OrderKey key);
+    void applyLine(std::string_view text, uint64_t key, uint32_t context, bool add);
+    IdMap::iterator touch(std::string_view id);
+    void addReference(std::string_view id, OrderKey key, std::string_view label, uint32_t context, bool add);
+    void addConnection(std::string_view from, std::string_view to, std::string_view label, std::string_view style,
+                       OrderKey key, bool add);
+    void addConnections(const MermaidStatement& st, uint64_t line, uint32_t context, bool add);
+    void replaceConnections(const MermaidStatement& before, const MermaidStatement& after, uint64_t line,
+                            uint32_t context);
+    void linkNodes(std::string_view from, std::string_view to, OrderKey key, bool add);
+    void addNodeClass(std::string_view id, std::string_view className, OrderKey key, bool add);
+    void addClassDef(std::string_view className, std::string_view definition, OrderKey key, bool add);
+    void refresh();
+    void refreshNode(IdMap::iterator it);
+    void setName(const std::string& id, IdState& state, bool named, OrderKey key, const std::string& label);
+    void setMember(const std::string& id, IdState& state, uint32_t member);
+
+    SequenceTree<Line> lines;
+    SequenceTree<KeyedConnection> connections; // in Chart::connections order
+    // Materialized by text() and chart(): content is stale after any edit,
+    // parsed.connections at the keys of connections added, removed or
+    // replaced since chart() last ran
+    mutable std::string content;
+    mutable bool textStale = false;
+    mutable Chart parsed;
+    mutable std::vector<OrderKey> connectionKeys; // parallel to parsed.connections
+    mutable std::vector<OrderKey> touchedConnections;
+    std::vector<Scope> scopes;
+    IdMap ids;
+    std::map<std::string, std::map<OrderKey, std::string>, std::less<>> classDefs;
+    std::map<std::string, std::map<OrderKey, std::string>, std::less<>> labelOwners;
+    std::vector<IdMap::iterator> dirtyIds;
+    std::vector<std::string> dirtyClasses;
+    std::vector<std::string> dirtyLabels;
+    size_t rebuilds = 0;
+};
+
+#endif // MERMAID_DOCUMENT_H
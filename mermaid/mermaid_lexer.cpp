@@ -0,0 +1,382 @@
+#include "mermaid_lexer.h"
+#include "TextScanner.h"
+
+namespace {
+
+// The matchers accept a superset of the grammar in
+// MermaidParser::parseContentRegex: every statement the regex parser accepts
+// is matched the same way and yields the same Chart, and the lexer also
+// understands edge labels, chained edges, "&" groups and node shapes.
+
+// "word" is the regex \w class, which is exactly the character set accepted
+// by tsGetTokenAlphaNumeric.
+
+bool isWordChar(char c) {
+    return c == '_' || tsIsNumeric(c) || tsIsAlpha(c);
+}
+
+std::string_view span(const char* begin, const char* end) {
+    return std::string_view(begin, static_cast<size_t>(end - begin));
+}
+
+bool startsWith(const char* p, const char* end, const char* prefix) {
+    return tsExpect(p, end, prefix) != p;
+}
+
+// Returns the end of the word starting at p (p itself if there is none)
+const char* scanWord(const char* p, const char* end) {
+    const char* word;
+    uint32_t length;
+    tsGetTokenAlphaNumeric(p, end, &word, &length);
+    return word == p ? p + length : p;
+}
+
+// Finds the next occurrence of a keyword at or after p
+const char* findKeyword(const char* p, const char* end, const char* keyword) {
+    while ((p = tsScanForCharacter(p, end, keyword[0])) < end) {
+        if (startsWith(p, end, keyword)) return p;
+        ++p;
+    }
+    return end;
+}
+
+// Matches \s*\[([^\]]+)\] at p, returning the position after the closing
+// bracket, or p if the optional label is absent
+const char* scanBracketLabel(const char* p, const char* end, std::string_view* label) {
+    const char* open = tsScanForNonWhiteSpace(p, end);
+    if (open == end || *open != '[') return p;
+    const char* close = tsScanForCharacter(open + 1, end, ']');
+    if (close == end || close == open + 1) return p;
+    if (label) *label = span(open + 1, close);
+    return close + 1;
+}
+
+// Trims the whitespace that MermaidParser::trim removes
+void trimRange(const char** begin, const char** end) {
+    const char* b = tsScanForNonWhiteSpace(*begin, *end);
+    const char* e = *end;
+    while (e > b && tsIsWhiteSpace(e[-1])) --e;
+    *begin = b;
+    *end = e;
+}
+
+// Matches -+> | =+> | \.-+> | -\.+-+> at p, returning the position past the
+// arrow, or p if there is no arrow. The last is Mermaid's dotted arrow, which
+// the regex grammar does not know.
+const char* scanArrow(const char* p, const char* end) {
+    if (p == end) return p;
+    const char* q = p;
+    if (*q == '.') {
+        ++q;
+    } else if (*q == '-' && q + 1 < end && q[1] == '.') {
+        q += 2;
+        while (q < end && *q == '.') ++q;
+    }
+    if (q == end || (*q != '-' && (*q != '=' || q != p))) return p;
+    const char* shaft = q;
+    while (q < end && *q == *shaft) ++q;
+    return (q < end && *q == '>') ? q + 1 : p;
+}
+
+// (flowchart|graph)\s+(LR|TD|TB|RL|BT), searched anywhere in the line
+bool matchFlowchart(const char* p, const char* end, Direction* direction) {
+    for (; p < end; ++p) {
+        const char* q = p;
+        if (startsWith(p, end, "flowchart")) q = p + 9;
+        else if (startsWith(p, end, "graph")) q = p + 5;
+        else continue;
+        if (q == end || !tsIsWhiteSpace(*q)) continue;
+        q = tsScanForNonWhiteSpace(q, end);
+        if (startsWith(q, end, "LR") || startsWith(q, end, "RL")) {
+            *direction = Direction::LR;
+            return true;
+        }
+        if (startsWith(q, end, "TD") || startsWith(q, end, "TB") || startsWith(q, end, "BT")) {
+            *direction = Direction::TD;
+            return true;
+        }
+    }
+    return false;
+}
+
+// subgraph\s+(\w+)(?:\s*\[([^\]]+)\])?
+bool matchSubgraph(const char* p, const char* end, std::string_view* id, std::string_view* label) {
+    for (; (p = findKeyword(p, end, "subgraph")) < end; ++p) {
+        const char* q = p + 8;
+        if (q == end || !tsIsWhiteSpace(*q)) continue;
+        q = tsScanForNonWhiteSpace(q, end);
+        const char* idEnd = scanWord(q, end);
+        if (idEnd == q) continue;
+        *id = span(q, idEnd);
+        *label = {};
+        scanBracketLabel(idEnd, end, label);
+        return true;
+    }
+    return false;
+}
+
+// Node shapes, longer openings first so that "((" is not read as "("
+struct Shape {
+    const char* open;
+    const char* close;
+};
+const Shape kShapes[] = {{"((", "))"}, {"([", "])"}, {"[[", "]]"}, {"[(", ")]"},
+                         {"{{", "}}"}, {"[", "]"},   {"(", ")"},   {"{", "}"}};
+
+// Finds the next occurrence of a delimiter at or after p
+const char* findDelimiter(const char* p, const char* end, const char* delimiter) {
+    return delimiter[1] ? findKeyword(p, end, delimiter) : tsScanForCharacter(p, end, delimiter[0]);
+}
+
+// Matches \s* followed by a shape enclosing non-empty text, returning the
+// position after the shape, or p if there is none. For [text] this is the
+// bracket label of the original pattern.
+const char* scanShape(const char* p, const char* end, std::string_view* label) {
+    const char* open = tsScanForNonWhiteSpace(p, end);
+    for (const Shape& shape : kShapes) {
+        if (!startsWith(open, end, shape.open)) continue;
+        const char* text = open + (shape.open[1] ? 2 : 1);
+        const char* close = findDelimiter(text, end, shape.close);
+        if (close == end || close == text) continue;
+        *label = span(text, close);
+        return close + (shape.close[1] ? 2 : 1);
+    }
+    return p;
+}
+
+// Matches a word and an optional shape at p, or returns p
+const char* scanVertex(const char* p, const char* end, MermaidVertex* vertex) {
+    const char* idEnd = scanWord(p, end);
+    if (idEnd == p) return p;
+    vertex->id = span(p, idEnd);
+    vertex->label = {};
+    return scanShape(idEnd, end, &vertex->label);
+}
+
+// Matches vertex (\s*&\s*vertex)* at p, appending the vertices, or returns p
+const char* scanGroup(const char* p, const char* end, std::vector<MermaidVertex>* vertices) {
+    MermaidVertex vertex;
+    const char* q = scanVertex(p, end, &vertex);
+    if (q == p) return p;
+    vertices->push_back(vertex);
+    for (;;) {
+        const char* amp = tsScanForNonWhiteSpace(q, end);
+        if (amp == end || *amp != '&') return q;
+        const char* next = tsScanForNonWhiteSpace(amp + 1, end);
+        const char* after = scanVertex(next, end, &vertex);
+        if (after == next) return q;
+        vertices->push_back(vertex);
+        q = after;
+    }
+}
+
+// Matches \s*\|text\| at p, where a quoted text may contain '|', or returns p
+const char* scanPipeLabel(const char* p, const char* end, std::string_view* label) {
+    const char* open = tsScanForNonWhiteSpace(p, end);
+    if (open == end || *open != '|') return p;
+    const char* text = open + 1;
+    const char* close = tsScanForNonWhiteSpace(text, end);
+    if (close < end && *close == '"') {
+        close = tsScanForCharacter(close + 1, end, '"');
+        if (close == end) return p;
+    }
+    close = tsScanForCharacter(close, end, '|');
+    if (close == end) return p;
+    const char* textEnd = close;
+    trimRange(&text, &textEnd);
+    *label = span(text, textEnd);
+    return close + 1;
+}
+
+// Matches \s* followed by a link at p: an arrow with an optional |text|, or
+// text between an opening "--", "==" or "-." and an arrow of the same kind.
+// Returns the position after the link, or p if there is none.
+const char* scanLink(const char* p, const char* end, std::string_view* style, std::string_view* label) {
+    const char* q = tsScanForNonWhiteSpace(p, end);
+    *label = {};
+    const char* arrowEnd = scanArrow(q, end);
+    if (arrowEnd != q) {
+        *style = span(q, arrowEnd);
+        return scanPipeLabel(arrowEnd, end, label);
+    }
+    char shaft;
+    if (startsWith(q, end, "--")) shaft = '-';
+    else if (startsWith(q, end, "==")) shaft = '=';
+    else if (startsWith(q, end, "-.")) shaft = '.';
+    else return p;
+    const char* text = q + 2;
+    for (const char* r = text; (r = tsScanForCharacter(r, end, shaft)) < end; ++r) {
+        const char* closeEnd = scanArrow(r, end);
+        if (closeEnd == r) continue;
+        const char* textEnd = r;
+        trimRange(&text, &textEnd);
+        if (text == textEnd) return p;
+        // "-. text .->" closes with ".->", but the arrow it spells is "-.->"
+        *style = shaft == '.' ? std::string_view("-.->") : span(r, closeEnd);
+        *label = span(text, textEnd);
+        return closeEnd;
+    }
+    return p;
+}
+
+// group (link group)*, at least one link, where group is vertex (& vertex)*.
+// Like (\w+)(\s*\[([^\]]+)\])?\s*(-+>|=+>|\.-+>)\s*(\w+)(\s*\[([^\]]+)\])?
+// it is searched from every word in turn, and text after the last group that
+// does not continue the chain is ignored.
+bool matchChain(const char* p, const char* end, MermaidStatement* st) {
+    auto& vertices = st->vertices;
+    auto& edges = st->edges;
+    while (p < end) {
+        if (!isWordChar(*p)) {
+            ++p;
+            continue;
+        }
+        vertices.clear();
+        edges.clear();
+        const char* q = scanGroup(p, end, &vertices);
+        uint32_t groupBegin = 0;
+        uint32_t groupEnd = static_cast<uint32_t>(vertices.size());
+        std::string_view style;
+        std::string_view label;
+        for (;;) {
+            const char* linkEnd = scanLink(q, end, &style, &label);
+            if (linkEnd == q) break;
+            const char* next = tsScanForNonWhiteSpace(linkEnd, end);
+            const char* groupEndPos = scanGroup(next, end, &vertices);
+            if (groupEndPos == next) break;
+            uint32_t nextEnd = static_cast<uint32_t>(vertices.size());
+            for (uint32_t from = groupBegin; from < groupEnd; ++from) {
+                for (uint32_t to = groupEnd; to < nextEnd; ++to) {
+                    edges.push_back({from, to, style, label});
+                }
+            }
+            groupBegin = groupEnd;
+            groupEnd = nextEnd;
+            q = groupEndPos;
+        }
+        if (!edges.empty()) return true;
+        p = scanWord(p, end);
+    }
+    vertices.clear();
+    return false;
+}
+
+// classDef\s+(\w+)\s+(.+)
+bool matchClassDef(const char* p, const char* end, std::string_view* name, std::string_view* definition) {
+    for (; (p = findKeyword(p, end, "classDef")) < end; ++p) {
+        const char* q = p + 8;
+        if (q == end || !tsIsWhiteSpace(*q)) continue;
+        q = tsScanForNonWhiteSpace(q, end);
+        const char* nameEnd = scanWord(q, end);
+        if (nameEnd == q || nameEnd == end || !tsIsWhiteSpace(*nameEnd)) continue;
+        const char* def = tsScanForNonWhiteSpace(nameEnd, end);
+        if (def == end) continue;
+        *name = span(q, nameEnd);
+        *definition = span(def, end);
+        return true;
+    }
+    return false;
+}
+
+// class\s+([\w,]+)\s+(\w+)
+bool matchClass(const char* p, const char* end, const char** listBegin, const char** listEnd,
+                std::string_view* className) {
+    for (; (p = findKeyword(p, end, "class")) < end; ++p) {
+        const char* q = p + 5;
+        if (q == end || !tsIsWhiteSpace(*q)) continue;
+        q = tsScanForNonWhiteSpace(q, end);
+        const char* qEnd = q;
+        while (qEnd < end && (isWordChar(*qEnd) || *qEnd == ',')) ++qEnd;
+        if (qEnd == q || qEnd == end || !tsIsWhiteSpace(*qEnd)) continue;
+        const char* name = tsScanForNonWhiteSpace(qEnd, end);
+        const char* nameEnd = scanWord(name, end);
+        if (nameEnd == name) continue;
+        *listBegin = q;
+        *listEnd = qEnd;
+        *className = span(name, nameEnd);
+        return true;
+    }
+    return false;
+}
+
+// ^\s*(\w+)\s*\[([^\]]+)\], or any other shape in place of the brackets
+bool matchNode(const char* p, const char* end, std::string_view* id, std::string_view* label) {
+    const char* idEnd = scanWord(p, end);
+    if (idEnd == p) return false;
+    if (scanShape(idEnd, end, label) == idEnd) return false;
+    *id = span(p, idEnd);
+    return true;
+}
+
+} // namespace
+
+bool LineCursor::next(std::string_view* line) {
+    if (curr >= end) return false;
+    const char* lineEnd = tsScanForCharacter(curr, end, '\n');
+    *line = span(curr, lineEnd);
+    curr = lineEnd < end ? lineEnd + 1 : lineEnd;
+    return true;
+}
+
+bool scanFlowchartHeader(std::string_view line, Direction* direction) {
+    const char* b = line.data();
+    const char* e = b + line.size();
+    trimRange(&b, &e);
+    return b != e && !startsWith(b, e, "%%") && matchFlowchart(b, e, direction);
+}
+
+MermaidStatement scanStatement(std::string_view line) {
+    MermaidStatement st;
+    scanStatement(line, &st);
+    return st;
+}
+
+void scanStatement(std::string_view line, MermaidStatement* statement) {
+    MermaidStatement& st = *statement;
+    st.kind = MermaidStatement::Kind::None;
+    st.id = {};
+    st.label = {};
+    st.list = {};
+    st.vertices.clear();
+    st.edges.clear();
+
+    const char* lineEnd = line.data() + line.size();
+    const char* e = line.data();
+    while ((e = tsScanForCharacter(e, lineEnd, '%')) < lineEnd && !startsWith(e, lineEnd, "%%")) ++e;
+    const char* b = line.data();
+    trimRange(&b, &e);
+    if (b == e) return;
+    if (startsWith(b, e, "flowchart") || startsWith(b, e, "graph")) return;
+
+    if (matchSubgraph(b, e, &st.id, &st.label)) {
+        st.kind = MermaidStatement::Kind::Subgraph;
+        return;
+    }
+
+    if (e - b == 3 && startsWith(b, e, "end")) {
+        st.kind = MermaidStatement::Kind::End;
+        return;
+    }
+
+    if (matchChain(b, e, &st)) {
+        st.kind = MermaidStatement::Kind::Connection;
+        return;
+    }
+
+    if (matchClassDef(b, e, &st.id, &st.label)) {
+        st.kind = MermaidStatement::Kind::ClassDef;
+        return;
+    }
+
+    const char* listBegin;
+    const char* listEnd;
+    if (matchClass(b, e, &listBegin, &listEnd, &st.id)) {
+        st.kind = MermaidStatement::Kind::Class;
+        st.list = span(listBegin, listEnd);
+        return;
+    }
+
+    if (matchNode(b, e, &st.id, &st.label)) {
+        st.kind = MermaidStatement::Kind::Node;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef MERMAID_LEXER_H
+#define MERMAID_LEXER_H
+
+#include "mermaid_parser.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Statement scanner shared by the Mermaid parsers. Every view returned here
+// points into the caller's buffer, except the style of a "-. text .->" edge,
+// which is the string literal "-.->".
+
+// A node written in a connection statement, with the text of its shape
+// ([x], (x), ((x)), {x}, ...) when it has one
+struct MermaidVertex {
+    std::string_view id;
+    std::string_view label;
+};
+
+// An edge of a connection statement between two of its vertices
+struct MermaidEdge {
+    uint32_t from;
+    uint32_t to;
+    std::string_view style; // the arrow, e.g. "-->" or "-.->"
+    std::string_view label; // |text| or -- text -->, trimmed
+};
+
+// One classified line of a flowchart
+struct MermaidStatement {
+    enum class Kind {
+        None,       // blank, comment, header or unrecognized line
+        Subgraph,   // id, label
+        End,
+        Connection, // vertices and edges
+        ClassDef,   // id is the class name, label the definition
+        Class,      // id is the class name, list the comma separated node ids
+        Node        // id, label
+    };
+
+    Kind kind = Kind::None;
+    std::string_view id;
+    std::string_view label;
+    std::string_view list;
+    // Connection statements: every node from left to right, and the edges
+    // between consecutive "&" groups, source-major within each link
+    std::vector<MermaidVertex> vertices;
+    std::vector<MermaidEdge> edges;
+};
+
+// Walks a buffer one '\n'-terminated line at a time
+class LineCursor {
+public:
+    explicit LineCursor(std::string_view content)
+        : curr(content.data()), end(content.data() + content.size()) {}
+
+    bool next(std::string_view* line);
+    // Offset of the next line relative to the start of the buffer
+    const char* position() const { return curr; }
+
+private:
+    const char* curr;
+    const char* end;
+};
+
+// Matches a flowchart declaration the way the first pass of the regex parser
+// does: the trimmed line must not start with "%%" and must contain
+// (flowchart|graph)\s+(LR|TD|TB|RL|BT)
+bool scanFlowchartHeader(std::string_view line, Direction* direction);
+
+// Strips comments and whitespace from a line and classifies what is left.
+// The second form reuses the vectors of *statement, for loops over lines.
+MermaidStatement scanStatement(std::string_view line);
+void scanStatement(std::string_view line, MermaidStatement* statement);
+
+// Calls fn for every node id in a class statement's comma separated list
+template <typename Fn>
+void forEachListItem(std::string_view list, Fn&& fn) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        if (!item.empty()) fn(item);
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+}
+
+#endif // MERMAID_LEXER_H
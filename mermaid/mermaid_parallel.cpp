@@ -0,0 +1,355 @@
+#include "mermaid_parser.h"
+#include "mermaid_lexer.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+// Parallel chunked parsing.
+//
+// The input is split at line boundaries and every chunk is scanned on its own
+// thread into a ChunkResult that only holds views into the input. Everything
+// that depends on earlier lines (which node sighting is the first, which
+// subgraph is open) is recorded relative to the chunk and resolved by a cheap
+// sequential replay. The Chart's maps are then built in parallel, one key
+// range per thread, and spliced together in key order without copying.
+
+namespace {
+
+const size_t kMinChunkBytes = 256 * 1024;
+
+// Everything one chunk contributes, in chunk order
+struct ChunkResult {
+    bool hasHeader = false;
+    Direction direction = Direction::LR;
+
+    struct Declaration {
+        std::string_view id;
+        std::string_view label;
+    };
+
+    // Context is the index of the enclosing declaration in this chunk, or
+    // -1 - d for the subgraph d levels below the top of the stack that was
+    // open when the chunk started
+    struct Sighting {
+        std::string_view id;
+        std::string_view firstLabel;
+        std::string_view lastLabel;
+        int32_t context;
+    };
+
+    // Subgraph declarations and first sightings of ids, interleaved in order
+    struct Event {
+        bool isDeclaration;
+        uint32_t index;
+    };
+
+    std::vector<Declaration> declarations;
+    std::vector<Sighting> sightings;
+    std::vector<Event> events;
+    std::unordered_map<std::string_view, uint32_t> sightingIndex;
+
+    size_t inheritedPops = 0;
+    std::vector<uint32_t> openDeclarations;
+
+    std::vector<Connection> connections;
+    std::vector<std::pair<std::string_view, std::string_view>> classDefinitions;
+    std::vector<std::pair<std::string_view, std::string_view>> nodeClasses;
+};
+
+void scanChunk(std::string_view chunk, ChunkResult& result) {
+    auto context = [&]() -> int32_t {
+        if (!result.openDeclarations.empty()) return static_cast<int32_t>(result.openDeclarations.back());
+        return -1 - static_cast<int32_t>(result.inheritedPops);
+    };
+
+    auto sight = [&](std::string_view id, std::string_view label) {
+        auto [it, inserted] = result.sightingIndex.try_emplace(id, static_cast<uint32_t>(result.sightings.size()));
+        if (inserted) {
+            result.sightings.push_back({id, label, label, context()});
+            result.events.push_back({false, it->second});
+        } else if (!label.empty()) {
+            result.sightings[it->second].lastLabel = label;
+        }
+    };
+
+    LineCursor lines(chunk);
+    std::string_view line;
+    MermaidStatement st;
+    while (lines.next(&line)) {
+        if (!result.hasHeader && scanFlowchartHeader(line, &result.direction)) {
+            result.hasHeader = true;
+        }
+
+        scanStatement(line, &st);
+        switch (st.kind) {
+        case MermaidStatement::Kind::None:
+            break;
+        case MermaidStatement::Kind::Subgraph: {
+            uint32_t index = static_cast<uint32_t>(result.declarations.size());
+            result.declarations.push_back({st.id, st.label});
+            result.events.push_back({true, index});
+            result.openDeclarations.push_back(index);
+            break;
+        }
+        case MermaidStatement::Kind::End:
+            if (!result.openDeclarations.empty()) {
+                result.openDeclarations.pop_back();
+            } else {
+                ++result.inheritedPops;
+            }
+            break;
+        case MermaidStatement::Kind::Connection:
+            for (const MermaidVertex& vertex : st.vertices) {
+                sight(vertex.id, vertex.label);
+            }
+            for (const MermaidEdge& edge : st.edges) {
+                result.connections.emplace_back(std::string(st.vertices[edge.from].id),
+                                                std::string(st.vertices[edge.to].id), std::string(edge.label),
+                                                std::string(edge.style));
+            }
+            break;
+        case MermaidStatement::Kind::ClassDef:
+            result.classDefinitions.emplace_back(st.id, st.label);
+            break;
+        case MermaidStatement::Kind::Class:
+            forEachListItem(st.list, [&](std::string_view nodeId) {
+                result.nodeClasses.emplace_back(nodeId, st.id);
+            });
+            break;
+        case MermaidStatement::Kind::Node:
+            sight(st.id, st.label);
+            break;
+        }
+    }
+}
+
+// Splits keys into contiguous, sorted ranges so that per-range maps can be
+// concatenated in key order
+class KeyRanges {
+public:
+    KeyRanges(std::vector<std::string_view> sample, size_t parts) {
+        std::sort(sample.begin(), sample.end());
+        for (size_t p = 1; p < parts && !sample.empty(); ++p) {
+            splitters.push_back(sample[p * sample.size() / parts]);
+        }
+    }
+
+    uint8_t operator()(std::string_view key) const {
+        return static_cast<uint8_t>(std::upper_bound(splitters.begin(), splitters.end(), key) - splitters.begin());
+    }
+
+private:
+    std::vector<std::string_view> splitters;
+};
+
+template <typename T>
+std::vector<std::string_view> sampleKeys(const std::vector<T>& items, std::string_view (*key)(const T&)) {
+    const size_t sampleSize = 1024;
+    std::vector<std::string_view> sample;
+    size_t step = std::max<size_t>(1, items.size() / sampleSize);
+    for (size_t i = 0; i < items.size(); i += step) {
+        sample.push_back(key(items[i]));
+    }
+    return sample;
+}
+
+// Moves the nodes of range-partitioned maps into out, in key order
+template <typename Map>
+void splice(std::vector<Map>& parts, Map& out) {
+    for (auto& part : parts) {
+        while (!part.empty()) {
+            out.insert(out.end(), part.extract(part.begin()));
+        }
+    }
+}
+
+struct Creation {
+    std::string_view id;
+    std::string_view firstLabel;
+    std::string_view label;
+};
+
+} // namespace
+
+Chart MermaidParser::parseContentParallel(std::string_view content, unsigned threads) {
+    size_t chunkCount = threads;
+    if (chunkCount == 0) {
+        chunkCount = std::max(1u, std::thread::hardware_concurrency());
+        chunkCount = std::min(chunkCount, std::max<size_t>(1, content.size() / kMinChunkBytes));
+    }
+    chunkCount = std::min<size_t>(chunkCount, 255);
+    if (chunkCount <= 1) {
+        return parseContent(content);
+    }
+
+    // Split at line boundaries
+    std::vector<std::string_view> chunks;
+    size_t begin = 0;
+    for (size_t c = 1; c <= chunkCount; ++c) {
+        size_t end = c == chunkCount ? content.size() : content.size() * c / chunkCount;
+        end = std::max(end, begin);
+        if (end < content.size()) {
+            size_t newline = content.find('\n', end);
+            end = newline == std::string_view::npos ? content.size() : newline + 1;
+        }
+        chunks.push_back(content.substr(begin, end - begin));
+        begin = end;
+    }
+
+    std::vector<ChunkResult> results(chunks.size());
+    parallelFor(chunks.size(), [&](size_t c) { scanChunk(chunks[c], results[c]); });
+
+    Chart chart;
+    auto header = std::find_if(results.begin(), results.end(), [](const ChunkResult& r) { return r.hasHeader; });
+    if (header == results.end()) {
+        throw std::runtime_error("No valid flowchart declaration found");
+    }
+    chart.direction = header->direction;
+
+    // Replay node creations and subgraph declarations in document order
+    struct SubgraphState {
+        std::string_view label;
+        std::vector<std::string_view> members;
+    };
+    std::unordered_map<std::string_view, SubgraphState> subgraphStates;
+    std::unordered_map<std::string_view, uint32_t> creationIndex;
+    std::vector<Creation> creations;
+    std::vector<std::string_view> stack;
+
+    for (const ChunkResult& result : results) {
+        for (const ChunkResult::Event& event : result.events) {
+            if (event.isDeclaration) {
+                const auto& decl = result.declarations[event.index];
+                SubgraphState& state = subgraphStates[decl.id];
+                state.label = decl.label;
+                state.members.clear();
+                continue;
+            }
+
+            const auto& sighting = result.sightings[event.index];
+            auto [it, created] = creationIndex.try_emplace(sighting.id, static_cast<uint32_t>(creations.size()));
+            if (created) {
+                creations.push_back({sighting.id, sighting.firstLabel, sighting.firstLabel});
+                std::string_view subgraph;
+                if (sighting.context >= 0) {
+                    subgraph = result.declarations[sighting.context].id;
+                } else {
+                    size_t depth = static_cast<size_t>(-1 - sighting.context);
+                    if (depth < stack.size()) subgraph = stack[stack.size() - 1 - depth];
+                }
+                if (!subgraph.empty()) {
+                    subgraphStates[subgraph].members.push_back(sighting.id);
+                }
+            }
+            if (!sighting.lastLabel.empty()) {
+                creations[it->second].label = sighting.lastLabel;
+            }
+        }
+
+        stack.resize(stack.size() - std::min(result.inheritedPops, stack.size()));
+        for (uint32_t open : result.openDeclarations) {
+            stack.push_back(result.declarations[open].id);
+        }
+    }
+
+    // Connections keep document order; each chunk moves its own slice
+    std::vector<size_t> connectionOffsets(results.size() + 1, 0);
+    for (size_t c = 0; c < results.size(); ++c) {
+        connectionOffsets[c + 1] = connectionOffsets[c] + results[c].connections.size();
+    }
+    chart.connections.resize(connectionOffsets.back());
+    parallelFor(results.size(), [&](size_t c) {
+        std::move(results[c].connections.begin(), results[c].connections.end(),
+                  chart.connections.begin() + static_cast<std::ptrdiff_t>(connectionOffsets[c]));
+    });
+
+    std::vector<std::pair<SubGraph*, const SubgraphState*>> subgraphFill;
+    for (const auto& [id, state] : subgraphStates) {
+        SubGraph& subgraph = chart.subgraphs[std::string(id)];
+        subgraph = SubGraph(std::string(id), std::string(state.label));
+        subgraphFill.emplace_back(&subgraph, &state);
+    }
+
+    // Each worker owns one key range of every large map
+    const size_t parts = chunks.size();
+    KeyRanges idRanges(sampleKeys<Creation>(creations, [](const Creation& c) { return c.id; }), parts);
+    KeyRanges labelRanges(sampleKeys<Creation>(creations, [](const Creation& c) { return c.firstLabel; }), parts);
+
+    // Bucket every creation and connection by the part that owns its key, in
+    // one pass. Each worker classifies a contiguous slice, so reading a part's
+    // buckets in worker order keeps document order within the part.
+    struct Bucket {
+        std::vector<size_t> creations;
+        std::vector<size_t> labels;
+        std::vector<size_t> sources;
+        std::vector<size_t> targets;
+    };
+    std::vector<std::vector<Bucket>> buckets(parts, std::vector<Bucket>(parts));
+    parallelFor(parts, [&](size_t w) {
+        std::vector<Bucket>& mine = buckets[w];
+        for (size_t i = creations.size() * w / parts; i < creations.size() * (w + 1) / parts; ++i) {
+            mine[idRanges(creations[i].id)].creations.push_back(i);
+            if (!creations[i].firstLabel.empty()) {
+                mine[labelRanges(creations[i].firstLabel)].labels.push_back(i);
+            }
+        }
+        const size_t edges = chart.connections.size();
+        for (size_t i = edges * w / parts; i < edges * (w + 1) / parts; ++i) {
+            mine[idRanges(chart.connections[i].from)].sources.push_back(i);
+            mine[idRanges(chart.connections[i].to)].targets.push_back(i);
+        }
+    });
+
+    using NodeMap = decltype(chart.nodes);
+    using NameMap = decltype(chart.nameToId);
+    using AdjacencyMap = decltype(chart.successors);
+    std::vector<NodeMap> nodeParts(parts);
+    std::vector<NameMap> nameParts(parts);
+    std::vector<AdjacencyMap> successorParts(parts);
+    std::vector<AdjacencyMap> predecessorParts(parts);
+
+    parallelFor(parts, [&](size_t p) {
+        for (size_t w = 0; w < parts; ++w) {
+            const Bucket& bucket = buckets[w][p];
+            for (size_t i : bucket.creations) {
+                std::string id(creations[i].id);
+                nodeParts[p].emplace(id, Node(id, std::string(creations[i].label)));
+            }
+            for (size_t i : bucket.labels) {
+                nameParts[p][std::string(creations[i].firstLabel)] = std::string(creations[i].id);
+            }
+            for (size_t i : bucket.sources) {
+                const Connection& conn = chart.connections[i];
+                successorParts[p][conn.from].push_back(conn.to);
+            }
+            for (size_t i : bucket.targets) {
+                const Connection& conn = chart.connections[i];
+                predecessorParts[p][conn.to].push_back(conn.from);
+            }
+        }
+        for (size_t i = p; i < subgraphFill.size(); i += parts) {
+            for (std::string_view member : subgraphFill[i].second->members) {
+                subgraphFill[i].first->nodeIds.emplace(member);
+            }
+        }
+    });
+
+    splice(nodeParts, chart.nodes);
+    splice(nameParts, chart.nameToId);
+    splice(successorParts, chart.successors);
+    splice(predecessorParts, chart.predecessors);
+
+    for (const ChunkResult& result : results) {
+        for (const auto& [name, definition] : result.classDefinitions) {
+            chart.classDefinitions[std::string(name)] = std::string(definition);
+        }
+        for (const auto& [nodeId, className] : result.nodeClasses) {
+            chart.nodeClasses[std::string(nodeId)].emplace_back(className);
+        }
+    }
+
+    // The maps above were filled directly rather than through the add* methods
+    chart.refreshFingerprint();
+    return chart;
+}
@@ -1,37 +1,219 @@
 #include "mermaid_parser.h"
+#include "edge_key.h"
+#include "mapped_file.h"
+#include "mermaid_reader.h"
+#include "mermaid_sink.h"
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Hash of everything Connection::operator== compares
+size_t hashConnectionFields(const Connection& conn) {
+    std::hash<std::string_view> hash;
+    size_t h = hash(conn.from);
+    for (const std::string* field : {&conn.to, &conn.label, &conn.style}) {
+        h = hashCombine(h, hash(*field));
+    }
+    return h;
+}
+
+} // namespace
 
 // Chart implementation
-void Chart::addNode(const Node& node) {
-    nodes[node.id] = node;
+void Chart::addNode(Node node) {
     if (!node.label.empty()) {
         nameToId[node.label] = node.id;
     }
+    auto [it, inserted] = nodes.try_emplace(node.id);
+    if (!inserted) {
+        hashNode(it->second, false);
+    }
+    hashNode(node, true);
+    it->second = std::move(node);
 }
 
-void Chart::addConnection(const Connection& conn) {
-    connections.push_back(conn);
+bool Chart::addConnection(Connection conn) {
+    if (deduplicate) {
+        size_t hash = hashConnectionFields(conn);
+        if (containsConnection(conn, hash)) {
+            ++suppressed;
+            return false;
+        }
+        connectionIndex.emplace(hash, static_cast<uint32_t>(connections.size()));
+    }
     predecessors[conn.to].push_back(conn.from);
     successors[conn.from].push_back(conn.to);
+    hashConnection(conn, true);
+    connections.push_back(std::move(conn));
+    return true;
+}
+
+bool Chart::containsConnection(const Connection& conn, size_t hash) const {
+    auto [begin, end] = connectionIndex.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+        // Positions are checked against the vector, so a stale entry can
+        // only hide a duplicate, never suppress a distinct connection
+        if (it->second < connections.size() && connections[it->second] == conn) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Chart::indexConnections() {
+    connectionIndex.clear();
+    connectionIndex.reserve(connections.size());
+    for (size_t i = 0; i < connections.size(); ++i) {
+        connectionIndex.emplace(hashConnectionFields(connections[i]), static_cast<uint32_t>(i));
+    }
+}
+
+void Chart::unindexConnection(size_t index) {
+    if (!deduplicate) return;
+    auto [begin, end] = connectionIndex.equal_range(hashConnectionFields(connections[index]));
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == index) {
+            connectionIndex.erase(it);
+            return;
+        }
+    }
+}
+
+void Chart::indexConnection(size_t index) {
+    if (!deduplicate) return;
+    connectionIndex.emplace(hashConnectionFields(connections[index]), static_cast<uint32_t>(index));
+}
+
+void Chart::setDeduplicateConnections(bool enabled) {
+    deduplicate = enabled;
+    connectionIndex.clear();
+    if (!enabled) return;
+
+    // Mark the first of each group of equal connections and index it
+    connectionIndex.reserve(connections.size());
+    std::vector<bool> keep(connections.size(), true);
+    // Adjacency lists that lose entries, with read and write cursors for
+    // compacting them in connection order
+    struct Cursor {
+        std::vector<std::string>* list;
+        size_t read = 0;
+        size_t write = 0;
+    };
+    std::unordered_map<std::string_view, Cursor> successorLists;
+    std::unordered_map<std::string_view, Cursor> predecessorLists;
+    size_t kept = 0;
+    for (size_t i = 0; i < connections.size(); ++i) {
+        const Connection& conn = connections[i];
+        size_t hash = hashConnectionFields(conn);
+        if (containsConnection(conn, hash)) {
+            keep[i] = false;
+            ++suppressed;
+            hashConnection(conn, false);
+            if (successorLists.find(conn.from) == successorLists.end()) {
+                successorLists.emplace(conn.from, Cursor{&successors.find(conn.from)->second});
+            }
+            if (predecessorLists.find(conn.to) == predecessorLists.end()) {
+                predecessorLists.emplace(conn.to, Cursor{&predecessors.find(conn.to)->second});
+            }
+            continue;
+        }
+        // containsConnection compares against connections[position], so the
+        // entry holds the current position until the compaction below
+        connectionIndex.emplace(hash, static_cast<uint32_t>(i));
+        ++kept;
+    }
+    if (kept == connections.size()) return;
+
+    // Each list holds one entry per connection touching its key, in
+    // connection order, so walking the connections visits them in step.
+    // Repeats never empty a list: the first of their group stays.
+    auto advance = [](Cursor& cursor, bool keepEntry) {
+        auto& list = *cursor.list;
+        if (keepEntry) {
+            if (cursor.write != cursor.read) list[cursor.write] = std::move(list[cursor.read]);
+            ++cursor.write;
+        }
+        ++cursor.read;
+    };
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (auto it = successorLists.find(connections[i].from); it != successorLists.end()) advance(it->second, keep[i]);
+        if (auto it = predecessorLists.find(connections[i].to); it != predecessorLists.end()) advance(it->second, keep[i]);
+    }
+    for (auto* lists : {&successorLists, &predecessorLists}) {
+        for (auto& [id, cursor] : *lists) cursor.list->resize(cursor.write);
+    }
+    successorLists.clear();
+    predecessorLists.clear();
+
+    std::vector<uint32_t> moved(connections.size());
+    uint32_t write = 0;
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (!keep[i]) continue;
+        if (write != i) connections[write] = std::move(connections[i]);
+        moved[i] = write++;
+    }
+    connections.resize(write);
+    for (auto& entry : connectionIndex) {
+        entry.second = moved[entry.second];
+    }
 }
 
 void Chart::addClass(const std::string& className, const std::string& definition) {
-    classDefinitions[className] = definition;
+    auto [it, inserted] = classDefinitions.try_emplace(className);
+    if (!inserted) {
+        hashClassDefinition(className, it->second, false);
+    }
+    it->second = definition;
+    hashClassDefinition(className, definition, true);
 }
 
 void Chart::addNodeClass(const std::string& nodeId, const std::string& className) {
-    nodeClasses[nodeId].push_back(className);
+    auto [it, inserted] = nodeClasses.try_emplace(nodeId);
+    if (inserted) {
+        hashNodeClassKey(nodeId, true);
+    }
+    // Repeats do not change the class set semanticEquals compares
+    if (std::find(it->second.begin(), it->second.end(), className) == it->second.end()) {
+        hashNodeClass(nodeId, className, true);
+    }
+    it->second.push_back(className);
 }
 
 void Chart::addSubgraph(const SubGraph& subgraph) {
-    subgraphs[subgraph.id] = subgraph;
+    auto [it, inserted] = subgraphs.try_emplace(subgraph.id);
+    if (!inserted) {
+        hashSubgraphHeader(it->second, false);
+        for (const auto& nodeId : it->second.nodeIds) {
+            hashSubgraphMember(subgraph.id, nodeId, false);
+        }
+    }
+    it->second = subgraph;
+    hashSubgraphHeader(subgraph, true);
+    for (const auto& nodeId : subgraph.nodeIds) {
+        hashSubgraphMember(subgraph.id, nodeId, true);
+    }
 }
 
 void Chart::addNodeToSubgraph(const std::string& nodeId, const std::string& subgraphId) {
-    if (subgraphs.find(subgraphId) != subgraphs.end() && nodes.find(nodeId) != nodes.end()) {
-        subgraphs[subgraphId].nodeIds.insert(nodeId);
+    auto it = subgraphs.find(subgraphId);
+    if (it != subgraphs.end() && nodes.find(nodeId) != nodes.end()) {
+        if (it->second.nodeIds.insert(nodeId).second) {
+            hashSubgraphMember(subgraphId, nodeId, true);
+        }
     }
 }
 
+void Chart::setNodeLabel(std::string_view id, std::string_view label) {
+    auto it = nodes.find(id);
+    if (it == nodes.end() || it->second.label == label) return;
+    hashNode(it->second, false);
+    it->second.label = label;
+    hashNode(it->second, true);
+}
+
 bool Chart::operator==(const Chart& other) const {
     return direction == other.direction &&
            nodes == other.nodes &&
@@ -45,95 +227,108 @@ bool Chart::operator!=(const Chart& other) const {
     return !(*this == other);
 }
 
+namespace {
+
+bool isCssSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Same classes, ignoring order and repeats
+bool sameClassSet(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+    if (a == b) return true;
+    std::vector<std::string_view> x(a.begin(), a.end());
+    std::vector<std::string_view> y(b.begin(), b.end());
+    std::sort(x.begin(), x.end());
+    std::sort(y.begin(), y.end());
+    x.erase(std::unique(x.begin(), x.end()), x.end());
+    y.erase(std::unique(y.begin(), y.end()), y.end());
+    return x == y;
+}
+
+} // namespace
+
 bool Chart::semanticEquals(const Chart& other) const {
     // 1. Direction must match
     if (direction != other.direction) return false;
     
-    // 2. Nodes must match (ignoring style, focusing on id and label)
+    // 2. Nodes must match (ignoring style, focusing on id and label). The
+    // maps are ordered, so matching keys line up and one walk is enough.
     if (nodes.size() != other.nodes.size()) return false;
-    for (const auto& [id, node] : nodes) {
-        auto it = other.nodes.find(id);
-        if (it == other.nodes.end() || 
-            node.id != it->second.id || 
-            normalizeLabel(node.label) != normalizeLabel(it->second.label)) {
+    for (auto a = nodes.begin(), b = other.nodes.begin(); a != nodes.end(); ++a, ++b) {
+        if (a->first != b->first ||
+            a->second.id != b->second.id ||
+            normalizeLabel(a->second.label) != normalizeLabel(b->second.label)) {
             return false;
         }
     }
     
-    // 3. Connections must be equivalent (order-independent)
+    // 3. Connections must be equivalent (order-independent). (from, to, label)
+    // triples are compared as multisets; style can differ (-->, --->, etc.)
+    // as long as the connection exists.
     if (connections.size() != other.connections.size()) return false;
+    std::unordered_map<EdgeKey, size_t, EdgeKeyHash> edgeCounts;
+    edgeCounts.reserve(connections.size());
     for (const auto& conn : connections) {
-        bool found = false;
-        for (const auto& otherConn : other.connections) {
-            if (conn.from == otherConn.from && 
-                conn.to == otherConn.to && 
-                conn.label == otherConn.label) {
-                // Style can differ (-->, --->, etc.) as long as connection exists
-                found = true;
-                break;
-            }
-        }
-        if (!found) return false;
+        ++edgeCounts[EdgeKey::of(conn)];
+    }
+    for (const auto& conn : other.connections) {
+        auto it = edgeCounts.find(EdgeKey::of(conn));
+        if (it == edgeCounts.end() || it->second == 0) return false;
+        --it->second;
     }
     
     // 4. Subgraphs must match (structure and membership)
     if (subgraphs.size() != other.subgraphs.size()) return false;
-    for (const auto& [id, subgraph] : subgraphs) {
-        auto it = other.subgraphs.find(id);
-        if (it == other.subgraphs.end() ||
-            subgraph.id != it->second.id ||
-            subgraph.label != it->second.label ||
-            subgraph.nodeIds != it->second.nodeIds) {
+    for (auto a = subgraphs.begin(), b = other.subgraphs.begin(); a != subgraphs.end(); ++a, ++b) {
+        if (a->first != b->first ||
+            a->second.id != b->second.id ||
+            a->second.label != b->second.label ||
+            a->second.nodeIds != b->second.nodeIds) {
             return false;
         }
     }
     
     // 5. Class definitions must be equivalent (normalize CSS)
     if (classDefinitions.size() != other.classDefinitions.size()) return false;
-    for (const auto& [className, definition] : classDefinitions) {
-        auto it = other.classDefinitions.find(className);
-        if (it == other.classDefinitions.end()) return false;
-        
-        // Normalize CSS by removing extra spaces and comparing
-        std::string normalizedDef = normalizeCss(definition);
-        std::string otherNormalizedDef = normalizeCss(it->second);
-        if (normalizedDef != otherNormalizedDef) return false;
+    for (auto a = classDefinitions.begin(), b = other.classDefinitions.begin(); a != classDefinitions.end(); ++a, ++b) {
+        if (a->first != b->first) return false;
+        if (a->second != b->second && normalizeCss(a->second) != normalizeCss(b->second)) return false;
     }
     
     // 6. Node classes must be equivalent (order-independent)
     if (nodeClasses.size() != other.nodeClasses.size()) return false;
-    for (const auto& [nodeId, classes] : nodeClasses) {
-        auto it = other.nodeClasses.find(nodeId);
-        if (it == other.nodeClasses.end()) return false;
-        
-        // Convert to sets for order-independent comparison
-        std::set<std::string> classSet(classes.begin(), classes.end());
-        std::set<std::string> otherClassSet(it->second.begin(), it->second.end());
-        if (classSet != otherClassSet) return false;
+    for (auto a = nodeClasses.begin(), b = other.nodeClasses.begin(); a != nodeClasses.end(); ++a, ++b) {
+        if (a->first != b->first || !sameClassSet(a->second, b->second)) return false;
     }
     
     return true;
 }
 
-// Helper function to normalize CSS strings
+// Helper function to normalize CSS strings: drops whitespace around colons
+// and commas, then trims spaces and tabs from both ends
 std::string Chart::normalizeCss(const std::string& css) const {
-    std::string normalized = css;
-    
-    // Remove extra spaces around colons and commas
-    normalized = std::regex_replace(normalized, std::regex("\\s*:\\s*"), ":");
-    normalized = std::regex_replace(normalized, std::regex("\\s*,\\s*"), ",");
+    std::string normalized;
+    normalized.reserve(css.size());
+    for (size_t i = 0; i < css.size(); ++i) {
+        char c = css[i];
+        if (c == ':' || c == ',') {
+            while (!normalized.empty() && isCssSpace(normalized.back())) normalized.pop_back();
+            normalized += c;
+            while (i + 1 < css.size() && isCssSpace(css[i + 1])) ++i;
+        } else {
+            normalized += c;
+        }
+    }
     
     // Remove leading/trailing whitespace
     size_t first = normalized.find_first_not_of(" \t");
     if (first == std::string::npos) return "";
     size_t last = normalized.find_last_not_of(" \t");
-    normalized = normalized.substr(first, last - first + 1);
-    
-    return normalized;
+    return normalized.substr(first, last - first + 1);
 }
 
 // Helper function to normalize labels (remove surrounding quotes)
-std::string Chart::normalizeLabel(const std::string& label) const {
+std::string_view Chart::normalizeLabel(std::string_view label) const {
     if (label.length() >= 2 && 
         label.front() == '"' && 
         label.back() == '"') {
@@ -142,19 +337,273 @@ std::string Chart::normalizeLabel(const std::string& label) const {
     return label;
 }
 
+namespace {
+
+// Domains keep equal strings in different roles from hashing alike
+enum HashDomain : uint64_t {
+    kNodeHash = 1,
+    kConnectionHash,
+    kSubgraphHash,
+    kSubgraphMemberHash,
+    kClassDefinitionHash,
+    kNodeClassKeyHash,
+    kNodeClassHash,
+    kChartHash
+};
+
+uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// MurmurHash3 finalizer
+uint64_t fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Two independent 64-bit lanes over length-prefixed fields. Words are read
+// little-endian so fingerprints are the same on every platform.
+class FingerprintHasher {
+public:
+    explicit FingerprintHasher(uint64_t domain)
+        : a(0x243f6a8885a308d3ULL ^ domain), b(0x13198a2e03707344ULL + domain * 0x9e3779b97f4a7c15ULL) {}
+
+    void mix(uint64_t v) {
+        a = (a ^ v) * 0x9e3779b97f4a7c15ULL;
+        a ^= a >> 32;
+        b = (b + v) * 0xbf58476d1ce4e5b9ULL;
+        b ^= b >> 29;
+    }
+
+    void add(std::string_view str) {
+        mix(str.size());
+        uint64_t word = 0;
+        int shift = 0;
+        for (unsigned char c : str) {
+            word |= uint64_t(c) << shift;
+            shift += 8;
+            if (shift == 64) {
+                mix(word);
+                word = 0;
+                shift = 0;
+            }
+        }
+        if (shift != 0) mix(word);
+    }
+
+    void add(const Fingerprint& fingerprint) {
+        mix(fingerprint.high);
+        mix(fingerprint.low);
+    }
+
+    Fingerprint finish() const {
+        Fingerprint result;
+        result.high = fmix(a ^ rotl(b, 23));
+        result.low = fmix(b + rotl(a, 41) + result.high);
+        return result;
+    }
+
+private:
+    uint64_t a;
+    uint64_t b;
+};
+
+// Sums are kept per 64-bit lane, so contributions can be taken back out
+void accumulate(Fingerprint* sum, const Fingerprint& element, bool add) {
+    if (add) {
+        sum->high += element.high;
+        sum->low += element.low;
+    } else {
+        sum->high -= element.high;
+        sum->low -= element.low;
+    }
+}
+
+Fingerprint hashFields(uint64_t domain, std::string_view first, std::string_view second = {},
+                       std::string_view third = {}) {
+    FingerprintHasher hasher(domain);
+    hasher.add(first);
+    hasher.add(second);
+    hasher.add(third);
+    return hasher.finish();
+}
+
+} // namespace
+
+std::string Fingerprint::toString() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        out[15 - i] = digits[(high >> (4 * i)) & 0xf];
+        out[31 - i] = digits[(low >> (4 * i)) & 0xf];
+    }
+    return out;
+}
+
+void Chart::hashNode(const Node& node, bool add) {
+    accumulate(&sums.nodes, hashFields(kNodeHash, node.id, normalizeLabel(node.label)), add);
+}
+
+void Chart::hashConnection(const Connection& conn, bool add) {
+    accumulate(&sums.connections, hashFields(kConnectionHash, conn.from, conn.to, conn.label), add);
+}
+
+void Chart::hashSubgraphHeader(const SubGraph& subgraph, bool add) {
+    accumulate(&sums.subgraphs, hashFields(kSubgraphHash, subgraph.id, subgraph.label), add);
+}
+
+void Chart::hashSubgraphMember(const std::string& subgraphId, const std::string& nodeId, bool add) {
+    accumulate(&sums.subgraphs, hashFields(kSubgraphMemberHash, subgraphId, nodeId), add);
+}
+
+void Chart::hashClassDefinition(const std::string& className, const std::string& definition, bool add) {
+    accumulate(&sums.classDefinitions, hashFields(kClassDefinitionHash, className, normalizeCss(definition)), add);
+}
+
+void Chart::hashNodeClassKey(const std::string& nodeId, bool add) {
+    accumulate(&sums.nodeClasses, hashFields(kNodeClassKeyHash, nodeId), add);
+}
+
+void Chart::hashNodeClass(const std::string& nodeId, const std::string& className, bool add) {
+    accumulate(&sums.nodeClasses, hashFields(kNodeClassHash, nodeId, className), add);
+}
+
+Chart::FingerprintSums Chart::fingerprintSums() const {
+    Chart scratch;
+    for (const auto& [id, node] : nodes) {
+        scratch.hashNode(node, true);
+    }
+    for (const auto& conn : connections) {
+        scratch.hashConnection(conn, true);
+    }
+    for (const auto& [id, subgraph] : subgraphs) {
+        scratch.hashSubgraphHeader(subgraph, true);
+        for (const auto& nodeId : subgraph.nodeIds) {
+            scratch.hashSubgraphMember(id, nodeId, true);
+        }
+    }
+    for (const auto& [className, definition] : classDefinitions) {
+        scratch.hashClassDefinition(className, definition, true);
+    }
+    for (const auto& [nodeId, classes] : nodeClasses) {
+        scratch.hashNodeClassKey(nodeId, true);
+        for (size_t i = 0; i < classes.size(); ++i) {
+            if (std::find(classes.begin(), classes.begin() + i, classes[i]) == classes.begin() + i) {
+                scratch.hashNodeClass(nodeId, classes[i], true);
+            }
+        }
+    }
+    return scratch.sums;
+}
+
+Fingerprint Chart::fingerprintOf(const FingerprintSums& fingerprintSums) const {
+    FingerprintHasher hasher(kChartHash);
+    hasher.mix(direction == Direction::LR ? 1 : 2);
+    hasher.add(fingerprintSums.nodes);
+    hasher.add(fingerprintSums.connections);
+    hasher.add(fingerprintSums.subgraphs);
+    hasher.add(fingerprintSums.classDefinitions);
+    hasher.add(fingerprintSums.nodeClasses);
+    return hasher.finish();
+}
+
+Fingerprint Chart::fingerprint() const {
+    return fingerprintOf(sums);
+}
+
+Fingerprint Chart::computeFingerprint() const {
+    return fingerprintOf(fingerprintSums());
+}
+
+void Chart::refreshFingerprint() {
+    sums = fingerprintSums();
+}
+
 // MermaidParser implementation
 Chart MermaidParser::parseFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+    return parseFile(filename, false);
+}
+
+Chart MermaidParser::parseContent(std::string_view content, bool /*verbose*/) {
+    Chart chart;
+
+    // Lambda to add a node. Lookups go through the view, so a string is only
+    // materialized the first time an id is seen.
+    auto addNode = [&](std::string_view id, std::string_view label, std::string_view subgraph) {
+        auto it = chart.nodes.find(id);
+        if (it == chart.nodes.end()) {
+            chart.addNode(Node(std::string(id), std::string(label)));
+            if (!subgraph.empty()) {
+                chart.addNodeToSubgraph(std::string(id), std::string(subgraph));
+            }
+        } else if (!label.empty()) {
+            chart.setNodeLabel(id, label);
+        }
+    };
+
+    // The Chart is one consumer of the event stream
+    MermaidReader reader(content);
+    MermaidEvent event;
+    while (reader.next(&event)) {
+        switch (event.type) {
+        case MermaidEvent::Type::Flowchart:
+            chart.direction = event.direction;
+            break;
+        case MermaidEvent::Type::Node:
+            addNode(event.id, event.label, event.subgraph);
+            break;
+        case MermaidEvent::Type::Edge:
+            chart.addConnection(Connection(std::string(event.id), std::string(event.target),
+                                           std::string(event.label), std::string(event.style)));
+            break;
+        case MermaidEvent::Type::SubgraphBegin:
+            chart.addSubgraph(SubGraph(std::string(event.id), std::string(event.label)));
+            break;
+        case MermaidEvent::Type::SubgraphEnd:
+            break;
+        case MermaidEvent::Type::ClassDef:
+            chart.addClass(std::string(event.className), std::string(event.label));
+            break;
+        case MermaidEvent::Type::Class:
+            chart.addNodeClass(std::string(event.id), std::string(event.className));
+            break;
+        }
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return parseContent(buffer.str());
+    return chart;
 }
 
-Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
+namespace {
+
+// The statement patterns of parseContentRegex, compiled once per process.
+// Each also comes with the literal text it cannot match without, so a line
+// only runs the patterns that could match it: most lines are connections,
+// which contain no "subgraph" and rarely reach the later patterns at all.
+struct RegexPatterns {
+    static constexpr auto flags = std::regex::ECMAScript | std::regex::optimize;
+
+    std::regex flowchart{"(flowchart|graph)\\s+(LR|TD|TB|RL|BT)", flags};
+    std::regex subgraph{"subgraph\\s+(\\w+)(?:\\s*\\[([^\\]]+)\\])?", flags};
+    std::regex conn{"(\\w+)(\\s*\\[([^\\]]+)\\])?\\s*(-+>|=+>|\\.-+>)\\s*(\\w+)(\\s*\\[([^\\]]+)\\])?", flags};
+    std::regex simple{"(\\w+)\\s*(-+>|=+>|\\.-+>)\\s*(\\w+)", flags};
+    std::regex classDef{"classDef\\s+(\\w+)\\s+(.+)", flags};
+    std::regex classAssignment{"class\\s+([\\w,]+)\\s+(\\w+)", flags};
+    std::regex node{"^\\s*(\\w+)\\s*\\[([^\\]]+)\\]", flags};
+
+    static const RegexPatterns& get() {
+        static const RegexPatterns patterns;
+        return patterns;
+    }
+};
+
+} // namespace
+
+Chart MermaidParser::parseContentRegex(const std::string& content, bool /*verbose*/) {
+    const RegexPatterns& patterns = RegexPatterns::get();
     Chart chart;
     std::istringstream iss(content);
     std::string line;
@@ -169,7 +618,7 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
                 chart.addNodeToSubgraph(node.id, subgraphStack.back());
             }
         } else if (!node.label.empty()) {
-            chart.nodes[node.id].label = node.label;
+            chart.setNodeLabel(node.id, node.label);
         }
     };
 
@@ -179,8 +628,7 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
         if (line.empty() || line.substr(0, 2) == "%%") continue;
 
         std::smatch match;
-        std::regex flowchartRegex("(flowchart|graph)\\s+(LR|TD|TB|RL|BT)");
-        if (std::regex_search(line, match, flowchartRegex)) {
+        if (std::regex_search(line, match, patterns.flowchart)) {
             inFlowchart = true;
             std::string dir = match[2];
             chart.direction = (dir == "LR" || dir == "RL") ? Direction::LR : Direction::TD;
@@ -209,8 +657,8 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
 
         // Handle subgraphs
         std::smatch subgraphMatch;
-        std::regex subgraphRegex("subgraph\\s+(\\w+)(?:\\s*\\[([^\\]]+)\\])?");
-        if (std::regex_search(line, subgraphMatch, subgraphRegex)) {
+        if (line.find("subgraph") != std::string::npos &&
+            std::regex_search(line, subgraphMatch, patterns.subgraph)) {
             std::string subgraphId = subgraphMatch[1];
             std::string subgraphLabel = subgraphMatch[2].matched ? subgraphMatch[2].str() : "";
             chart.addSubgraph(SubGraph(subgraphId, subgraphLabel));
@@ -226,9 +674,10 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
         }
 
         // Handle connections with labels: A[Label A] --> B[Label B]
+        // Every arrow ends in '>'
+        bool hasArrow = line.find('>') != std::string::npos;
         std::smatch connMatch;
-        std::regex connRegex("(\\w+)(\\s*\\[([^\\]]+)\\])?\\s*(-+>|=+>|\\.-+>)\\s*(\\w+)(\\s*\\[([^\\]]+)\\])?");
-        if (std::regex_search(line, connMatch, connRegex)) {
+        if (hasArrow && std::regex_search(line, connMatch, patterns.conn)) {
             std::string fromId = connMatch[1];
             std::string fromLabel = connMatch[3].matched ? connMatch[3].str() : "";
             std::string style = connMatch[4];
@@ -243,8 +692,7 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
 
         // Handle simple connections: A --> B
         std::smatch simpleMatch;
-        std::regex simpleRegex("(\\w+)\\s*(-+>|=+>|\\.-+>)\\s*(\\w+)");
-        if (std::regex_search(line, simpleMatch, simpleRegex)) {
+        if (hasArrow && std::regex_search(line, simpleMatch, patterns.simple)) {
             std::string fromId = simpleMatch[1];
             std::string style = simpleMatch[2];
             std::string toId = simpleMatch[3];
@@ -261,9 +709,11 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
         }
 
         // Handle classDef statements: classDef server fill:#f9f,stroke:#333,stroke-width:2px
+        // "classDef" contains "class", so one search rules out both
+        bool hasClass = line.find("class") != std::string::npos;
         std::smatch classDefMatch;
-        std::regex classDefRegex("classDef\\s+(\\w+)\\s+(.+)");
-        if (std::regex_search(line, classDefMatch, classDefRegex)) {
+        if (hasClass && line.find("classDef") != std::string::npos &&
+            std::regex_search(line, classDefMatch, patterns.classDef)) {
             std::string className = classDefMatch[1];
             std::string definition = classDefMatch[2];
             chart.addClass(className, definition);
@@ -272,8 +722,7 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
 
         // Handle class assignments: class C,D server
         std::smatch classMatch;
-        std::regex classRegex("class\\s+([\\w,]+)\\s+(\\w+)");
-        if (std::regex_search(line, classMatch, classRegex)) {
+        if (hasClass && std::regex_search(line, classMatch, patterns.classAssignment)) {
             std::string nodesList = classMatch[1];
             std::string className = classMatch[2];
             
@@ -291,8 +740,7 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
 
         // Handle standalone node declarations: A[Label]
         std::smatch nodeMatch;
-        std::regex nodeRegex("^\\s*(\\w+)\\s*\\[([^\\]]+)\\]");
-        if (std::regex_search(line, nodeMatch, nodeRegex)) {
+        if (line.find('[') != std::string::npos && std::regex_search(line, nodeMatch, patterns.node)) {
             std::string id = nodeMatch[1];
             std::string label = nodeMatch[2];
             addNode(Node(id, label));
@@ -305,101 +753,249 @@ Chart MermaidParser::parseContent(const std::string& content, bool verbose) {
 
 // MermaidWriter implementation
 void MermaidWriter::writeToFile(const Chart& chart, const std::string& filename) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
+    writeToFile(chart, filename, MermaidSink::defaultBufferSize);
+}
+
+namespace {
+
+// Opens filename ("-" for stdout) and streams write(sink) into it
+template <typename Fn>
+void writeThroughSink(const std::string& filename, size_t bufferSize, Fn&& write) {
+    if (filename == "-") {
+        FileSink sink(stdout, bufferSize);
+        write(sink);
+        if (std::fflush(stdout) != 0) {
+            throw std::runtime_error("Failed to write output");
+        }
+        return;
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(filename.c_str(), "wb"), &std::fclose);
+    if (!file) {
         throw std::runtime_error("Failed to open file for writing: " + filename);
     }
-    
-    std::string content = generateContent(chart);
-    file << content;
+    {
+        // Our own buffer replaces stdio's
+        std::setvbuf(file.get(), nullptr, _IONBF, 0);
+        FileSink sink(file.get(), bufferSize);
+        write(sink);
+    }
+    if (std::fclose(file.release()) != 0) {
+        throw std::runtime_error("Failed to write file: " + filename);
+    }
+}
+
+} // namespace
+
+void MermaidWriter::writeToFile(const Chart& chart, const std::string& filename, size_t bufferSize) {
+    writeThroughSink(filename, bufferSize, [&](MermaidSink& sink) { write(chart, sink); });
+}
+
+void MermaidWriter::writeSnapshotFile(const Chart& chart, const std::string& filename) {
+    writeThroughSink(filename, MermaidSink::defaultBufferSize,
+                     [&](MermaidSink& sink) { writeSnapshot(chart, sink); });
 }
 
+void MermaidWriter::write(const Chart& chart, MermaidSink& sink) {
+    writeContent(chart, sink);
+    sink.flush();
+}
+
+namespace {
+
+// Estimate of the generated text, so the output is usually allocated once.
+// Every node, connection and class line is counted once with room for its
+// indentation; a node that belongs to several subgraphs, or a connection
+// whose ends share several, is written once per subgraph and counted only
+// once, so the string may still grow for such charts.
+size_t estimateContentSize(const Chart& chart) {
+    size_t size = 32;
+    for (const auto& [id, node] : chart.nodes) {
+        size += id.size() + node.label.size() + 16;
+    }
+    for (const auto& conn : chart.connections) {
+        size += conn.from.size() + conn.to.size() + conn.style.size() + conn.label.size() + 16;
+    }
+    for (const auto& [id, subgraph] : chart.subgraphs) {
+        size += id.size() + subgraph.label.size() + 32;
+    }
+    for (const auto& [className, definition] : chart.classDefinitions) {
+        size += className.size() + definition.size() + 16;
+    }
+    for (const auto& [nodeId, classes] : chart.nodeClasses) {
+        for (const auto& className : classes) {
+            size += nodeId.size() + className.size() + 12;
+        }
+    }
+    return size;
+}
+
+} // namespace
+
 std::string MermaidWriter::generateContent(const Chart& chart) {
-    std::stringstream ss;
+    std::string out;
+    generateContent(chart, out);
+    return out;
+}
+
+void MermaidWriter::generateContent(const Chart& chart, std::string& out) {
+    out.reserve(out.size() + estimateContentSize(chart));
+    writeContent(chart, out);
+}
+
+// Out is a std::string or a MermaidSink; both take += and append(count, c)
+template <typename Out>
+void MermaidWriter::writeContent(const Chart& chart, Out& out) {
+    constexpr uint32_t none = UINT32_MAX;
 
     // Write flowchart header
-    ss << "flowchart " << (chart.direction == Direction::LR ? "LR" : "TD") << "\n";
+    out += "flowchart ";
+    out += chart.direction == Direction::LR ? "LR" : "TD";
+    out += "\n";
 
-    // Collect all nodes that belong to subgraphs
-    std::set<std::string> subgraphNodes;
+    // Index the subgraphs each node belongs to: the first membership is in
+    // the map, any further ones are chained through next. Members of a
+    // subgraph are contiguous, in nodeIds order.
+    struct Membership {
+        uint32_t group;
+        uint32_t next;
+        const Node* node; // null for ids that are not in chart.nodes
+    };
+    std::vector<const SubGraph*> groups;
+    std::vector<uint32_t> groupStart;
+    std::vector<Membership> memberships;
+    std::unordered_map<std::string_view, uint32_t> firstMembership;
+    groups.reserve(chart.subgraphs.size());
+    groupStart.reserve(chart.subgraphs.size() + 1);
+    size_t memberCount = 0;
+    for (const auto& [id, subgraph] : chart.subgraphs) {
+        memberCount += subgraph.nodeIds.size();
+    }
+    memberships.reserve(memberCount);
+    firstMembership.reserve(memberCount);
     for (const auto& [id, subgraph] : chart.subgraphs) {
+        uint32_t group = static_cast<uint32_t>(groups.size());
+        groups.push_back(&subgraph);
+        groupStart.push_back(static_cast<uint32_t>(memberships.size()));
         for (const auto& nodeId : subgraph.nodeIds) {
-            subgraphNodes.insert(nodeId);
+            uint32_t index = static_cast<uint32_t>(memberships.size());
+            auto [it, inserted] = firstMembership.emplace(nodeId, index);
+            memberships.push_back(Membership{group, inserted ? none : it->second, nullptr});
+            if (!inserted) it->second = index;
         }
     }
+    groupStart.push_back(static_cast<uint32_t>(memberships.size()));
+    auto isMember = [&](std::string_view nodeId, uint32_t group) {
+        auto it = firstMembership.find(nodeId);
+        for (uint32_t m = it == firstMembership.end() ? none : it->second; m != none; m = memberships[m].next) {
+            if (memberships[m].group == group) return true;
+        }
+        return false;
+    };
 
-    // Write standalone nodes (not in any subgraph)
+    // Write standalone nodes (not in any subgraph), and resolve the members
+    // to their nodes on the way
     for (const auto& [id, node] : chart.nodes) {
-        if (subgraphNodes.find(id) == subgraphNodes.end()) {
-            writeNodeDefinition(ss, node, 4);
+        auto it = firstMembership.find(id);
+        if (it == firstMembership.end()) {
+            writeNodeDefinition(out, node, 4);
+            continue;
+        }
+        for (uint32_t m = it->second; m != none; m = memberships[m].next) {
+            memberships[m].node = &node;
         }
     }
 
+    // Bucket connections by every subgraph holding both ends, in one pass;
+    // the rest are cross-subgraph connections
+    std::vector<std::pair<uint32_t, uint32_t>> placed; // (group, connection)
+    std::vector<uint32_t> crossing;
+    if (!groups.empty()) {
+        for (uint32_t c = 0; c < chart.connections.size(); ++c) {
+            const Connection& conn = chart.connections[c];
+            bool isIntraSubgraph = false;
+            auto it = firstMembership.find(conn.from);
+            for (uint32_t m = it == firstMembership.end() ? none : it->second; m != none; m = memberships[m].next) {
+                if (isMember(conn.to, memberships[m].group)) {
+                    placed.emplace_back(memberships[m].group, c);
+                    isIntraSubgraph = true;
+                }
+            }
+            if (!isIntraSubgraph) crossing.push_back(c);
+        }
+    }
+
+    // Counting sort by group keeps each bucket in connection order
+    std::vector<uint32_t> bucketStart(groups.size() + 1, 0);
+    for (const auto& [group, c] : placed) ++bucketStart[group + 1];
+    for (size_t g = 0; g < groups.size(); ++g) bucketStart[g + 1] += bucketStart[g];
+    std::vector<uint32_t> buckets(placed.size());
+    {
+        std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (const auto& [group, c] : placed) buckets[fill[group]++] = c;
+    }
+
     // Write subgraphs
-    if (!chart.subgraphs.empty()) {
-        ss << "\n";
-        for (const auto& [id, subgraph] : chart.subgraphs) {
-            ss << "    subgraph " << id;
+    if (!groups.empty()) {
+        out += "\n";
+        for (uint32_t group = 0; group < groups.size(); ++group) {
+            const SubGraph& subgraph = *groups[group];
+            out += "    subgraph ";
+            out += subgraph.id;
             if (!subgraph.label.empty()) {
-                ss << "[" << subgraph.label << "]";
+                out += "[";
+                out += subgraph.label;
+                out += "]";
             }
-            ss << "\n";
+            out += "\n";
 
             // Write nodes within this subgraph
-            for (const auto& nodeId : subgraph.nodeIds) {
-                auto nodeIt = chart.nodes.find(nodeId);
-                if (nodeIt != chart.nodes.end()) {
-                    writeNodeDefinition(ss, nodeIt->second, 8);
+            for (uint32_t m = groupStart[group]; m < groupStart[group + 1]; ++m) {
+                if (memberships[m].node) {
+                    writeNodeDefinition(out, *memberships[m].node, 8);
                 }
             }
 
             // Write connections within this subgraph
-            for (const auto& conn : chart.connections) {
-                if (subgraph.nodeIds.count(conn.from) && subgraph.nodeIds.count(conn.to)) {
-                    writeConnection(ss, conn, 8);
-                }
+            for (uint32_t i = bucketStart[group]; i < bucketStart[group + 1]; ++i) {
+                writeConnection(out, chart.connections[buckets[i]], 8);
             }
 
-            ss << "    end\n";
+            out += "    end\n";
         }
     }
 
     // Write connections (cross-subgraph and standalone)
-    if (!chart.subgraphs.empty()) {
-        ss << "\n    %% Cross-subgraph connections\n";
-        for (const auto& conn : chart.connections) {
-            bool isIntraSubgraph = false;
-            for (const auto& [id, subgraph] : chart.subgraphs) {
-                if (subgraph.nodeIds.count(conn.from) && subgraph.nodeIds.count(conn.to)) {
-                    isIntraSubgraph = true;
-                    break;
-                }
-            }
-            if (!isIntraSubgraph) {
-                writeConnection(ss, conn, 4);
-            }
+    if (!groups.empty()) {
+        out += "\n    %% Cross-subgraph connections\n";
+        for (uint32_t c : crossing) {
+            writeConnection(out, chart.connections[c], 4);
         }
     } else {
-        ss << "\n";
+        out += "\n";
         // Write all connections if no subgraphs
         for (const auto& conn : chart.connections) {
-            writeConnection(ss, conn, 4);
+            writeConnection(out, conn, 4);
         }
     }
 
     // Write class definitions
     if (!chart.classDefinitions.empty()) {
-        ss << "\n";
+        out += "\n";
         for (const auto& [className, definition] : chart.classDefinitions) {
-            ss << "    classDef " << className << " " << definition << "\n";
+            out += "    classDef ";
+            out += className;
+            out += " ";
+            out += definition;
+            out += "\n";
         }
     }
 
     // Write node class assignments
     if (!chart.nodeClasses.empty()) {
-        ss << "\n";
+        out += "\n";
         // Group nodes by class for compact output
-        std::map<std::string, std::vector<std::string>> classByNodes;
+        std::map<std::string_view, std::vector<std::string_view>> classByNodes;
         for (const auto& [nodeId, classes] : chart.nodeClasses) {
             for (const auto& className : classes) {
                 classByNodes[className].push_back(nodeId);
@@ -407,41 +1003,56 @@ std::string MermaidWriter::generateContent(const Chart& chart) {
         }
         
         for (const auto& [className, nodeIds] : classByNodes) {
-            ss << "    class ";
+            out += "    class ";
             for (size_t i = 0; i < nodeIds.size(); ++i) {
-                ss << nodeIds[i];
-                if (i < nodeIds.size() - 1) ss << ",";
+                out += nodeIds[i];
+                if (i < nodeIds.size() - 1) out += ",";
             }
-            ss << " " << className << "\n";
+            out += " ";
+            out += className;
+            out += "\n";
         }
     }
-
-    return ss.str();
 }
 
-void MermaidWriter::writeNodeDefinition(std::stringstream& ss, const Node& node, int indentation) {
-    std::string indent(indentation, ' ');
+template <typename Out>
+void MermaidWriter::writeNodeDefinition(Out& out, const Node& node, int indentation) {
+    out.append(indentation, ' ');
+    out += node.id;
     if (!node.label.empty()) {
         // Check if label already has quotes
         if (node.label.front() == '"' && node.label.back() == '"') {
-            ss << indent << node.id << "[" << node.label << "]\n";
+            out += "[";
+            out += node.label;
+            out += "]\n";
         } else {
-            ss << indent << node.id << "[\"" << node.label << "\"]\n";
+            out += "[\"";
+            out += node.label;
+            out += "\"]\n";
         }
     } else {
-        ss << indent << node.id << "\n";
+        out += "\n";
     }
 }
 
-void MermaidWriter::writeConnection(std::stringstream& ss, const Connection& conn, int indentation) {
-    std::string indent(indentation, ' ');
-    std::string connStyle = !conn.style.empty() ? conn.style : "-->";
-    
-    ss << indent << conn.from << " " << connStyle << " " << conn.to;
+template <typename Out>
+void MermaidWriter::writeConnection(Out& out, const Connection& conn, int indentation) {
+    out.append(indentation, ' ');
+    out += conn.from;
+    out += " ";
+    out += !conn.style.empty() ? conn.style : "-->";
     if (!conn.label.empty()) {
-        ss << " |\"" << conn.label << "\"|";
+        // The label goes between pipes after the arrow; it is quoted only if
+        // it would otherwise end early
+        bool quote = conn.label.find('|') != std::string::npos &&
+                     !(conn.label.size() > 1 && conn.label.front() == '"' && conn.label.back() == '"');
+        out += quote ? "|\"" : "|";
+        out += conn.label;
+        out += quote ? "\"|" : "|";
     }
-    ss << "\n";
+    out += " ";
+    out += conn.to;
+    out += "\n";
 }
 
 std::string MermaidParser::trim(const std::string& str) {
@@ -451,13 +1062,8 @@ std::string MermaidParser::trim(const std::string& str) {
     return str.substr(first, last - first + 1);
 }
 
-// Alternative implementation for parseFile with verbose support
+// The parser reads straight from the mapping, so no copy of the file is made
 Chart MermaidParser::parseFile(const std::string& filename, bool verbose) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
-    }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return parseContent(buffer.str(), verbose);
+    MappedFile file(filename);
+    return parseContent(file.contents(), verbose);
 }
@@ -1,7 +1,10 @@
 #ifndef MERMAID_PARSER_H
 #define MERMAID_PARSER_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <map>
 #include <set>
@@ -80,21 +83,42 @@ public:
     }
 };
 
+// 128-bit content hash
+struct Fingerprint {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const Fingerprint& other) const {
+        return high == other.high && low == other.low;
+    }
+
+    bool operator!=(const Fingerprint& other) const {
+        return !(*this == other);
+    }
+
+    // 32 lowercase hex digits, suitable as a cache key
+    std::string toString() const;
+};
+
 // Chart class - represents the entire flowchart
 class Chart {
 public:
     Direction direction = Direction::LR;
-    std::map<std::string, Node> nodes;
-    std::map<std::string, std::string> nameToId;
+    // Maps use transparent comparators so they can be searched with a
+    // std::string_view without materializing a key.
+    std::map<std::string, Node, std::less<>> nodes;
+    std::map<std::string, std::string, std::less<>> nameToId;
     std::vector<Connection> connections;
-    std::map<std::string, std::vector<std::string>> predecessors;
-    std::map<std::string, std::vector<std::string>> successors;
-    std::map<std::string, std::string> classDefinitions;
-    std::map<std::string, std::vector<std::string>> nodeClasses;
-    std::map<std::string, SubGraph> subgraphs;
-
-    void addNode(const Node& node);
-    void addConnection(const Connection& conn);
+    std::map<std::string, std::vector<std::string>, std::less<>> predecessors;
+    std::map<std::string, std::vector<std::string>, std::less<>> successors;
+    std::map<std::string, std::string, std::less<>> classDefinitions;
+    std::map<std::string, std::vector<std::string>, std::less<>> nodeClasses;
+    std::map<std::string, SubGraph, std::less<>> subgraphs;
+
+    void addNode(Node node);
+    // Returns false, leaving the chart unchanged, when duplicate suppression
+    // is on and an identical connection is already present
+    bool addConnection(Connection conn);
     void addClass(const std::string& className, const std::string& definition);
     void addNodeClass(const std::string& nodeId, const std::string& className);
     void addSubgraph(const SubGraph& subgraph);
@@ -103,32 +127,150 @@ public:
     bool operator==(const Chart& other) const;
     bool operator!=(const Chart& other) const;
     bool semanticEquals(const Chart& other) const;
+
+    // Replaces a node's label without registering it in nameToId, the way a
+    // later reference relabels a node during parsing
+    void setNodeLabel(std::string_view id, std::string_view label);
+
+    // Duplicate suppression. While enabled, addConnection drops a connection
+    // equal in from, to, label and style to one already present, found in
+    // O(1) through a hash index over connections, and counts it in
+    // suppressedConnections(). Enabling also removes duplicates already in
+    // the chart, keeping the first of each, and counts them too. Code that
+    // removes or reorders connections directly must enable it again to
+    // resync the index; until then some duplicates may slip through.
+    void setDeduplicateConnections(bool enabled);
+    bool deduplicatesConnections() const { return deduplicate; }
+    size_t suppressedConnections() const { return suppressed; }
+
+    // Order-independent hash of exactly what semanticEquals compares, so
+    // semantically equal charts have equal fingerprints. Each node, edge,
+    // subgraph, class definition and class assignment contributes a 128-bit
+    // hash to a per-category sum; the add* methods keep the sums up to date,
+    // so reading the fingerprint is O(1). Code that edits the public members
+    // directly must call refreshFingerprint() afterwards.
+    Fingerprint fingerprint() const;
+    // One linear pass over the members, ignoring the maintained sums
+    Fingerprint computeFingerprint() const;
+    void refreshFingerprint();
     
 private:
+    friend class MermaidDocument;
+    friend class ChartSnapshot;
+    friend class ChartBuilder;
+    friend class ChartDiff;
+    friend class ChartPatch;
+    friend class PersistentChart;
+
+    // Per-category sums of element hashes
+    struct FingerprintSums {
+        Fingerprint nodes;
+        Fingerprint connections;
+        Fingerprint subgraphs;
+        Fingerprint classDefinitions;
+        Fingerprint nodeClasses;
+    };
+
+    FingerprintSums fingerprintSums() const;
+    Fingerprint fingerprintOf(const FingerprintSums& sums) const;
+    // Add (add = true) or remove an element's contribution
+    void hashNode(const Node& node, bool add);
+    void hashConnection(const Connection& conn, bool add);
+    void hashSubgraphHeader(const SubGraph& subgraph, bool add);
+    void hashSubgraphMember(const std::string& subgraphId, const std::string& nodeId, bool add);
+    void hashClassDefinition(const std::string& className, const std::string& definition, bool add);
+    void hashNodeClassKey(const std::string& nodeId, bool add);
+    void hashNodeClass(const std::string& nodeId, const std::string& className, bool add);
+
+    FingerprintSums sums;
+
+    // Rebuilds connectionIndex after connections were removed or moved
+    void indexConnections();
+    // Drop or add the entry for connections[index] around removing it or
+    // changing its fields; no-ops unless deduplicating
+    void unindexConnection(size_t index);
+    void indexConnection(size_t index);
+    bool containsConnection(const Connection& conn, size_t hash) const;
+
+    bool deduplicate = false;
+    size_t suppressed = 0;
+    // Connection hash -> position in connections, while deduplicating
+    std::unordered_multimap<size_t, uint32_t> connectionIndex;
+
     std::string normalizeCss(const std::string& css) const;
-    std::string normalizeLabel(const std::string& label) const;
+    std::string_view normalizeLabel(std::string_view label) const;
 };
 
 // Parser class
+class MermaidHandler;
+
 class MermaidParser {
 public:
+    static constexpr size_t defaultStreamBlockSize = 64 * 1024;
+
+    // Regular files are memory-mapped; "-" reads standard input
     static Chart parseFile(const std::string& filename);
     static Chart parseFile(const std::string& filename, bool verbose);
-    static Chart parseContent(const std::string& content, bool verbose = false);
+    // Parses directly over the caller's buffer; strings are only created for
+    // the ids, labels and styles that end up in the Chart.
+    static Chart parseContent(std::string_view content, bool verbose = false);
+
+    // Splits the input at line boundaries and scans the pieces on separate
+    // threads; the result is identical to parseContent. threads = 0 uses one
+    // thread per core, for inputs large enough to benefit.
+    static Chart parseContentParallel(std::string_view content, unsigned threads = 0);
+
+    // Reads in blockSize bytes at a time and reports the flowchart to handler
+    // as it goes, for inputs of any length. Only the node ids seen so far and
+    // the open subgraphs are kept, so memory grows with the number of
+    // distinct nodes (and the longest line), not with the input. Events are
+    // MermaidReader's, except that node() is only called when an id is first
+    // seen and when a later reference gives it a label. Node ids passed to
+    // node() and edge() stay valid until parseStream returns; other views
+    // only during the callback. Throws std::runtime_error on a read error or,
+    // at the end, if there was no flowchart declaration.
+    static void parseStream(std::istream& in, MermaidHandler& handler,
+                            size_t blockSize = defaultStreamBlockSize);
+
+    // Reference implementation built on std::regex, for the original grammar:
+    // one A[x] --> B[y] connection per line, no edge labels, chains, "&"
+    // groups or shapes other than brackets. On that grammar parseContent
+    // produces the same Chart in a single pass without regular expressions;
+    // this path is kept for cross-checking and benchmarking.
+    static Chart parseContentRegex(const std::string& content, bool verbose = false);
 
 private:
     static std::string trim(const std::string& str);
 };
 
 // Writer class
+class MermaidSink;
+
 class MermaidWriter {
 public:
+    // Streams through a FileSink with the given buffer size; "-" writes to
+    // stdout
     static void writeToFile(const Chart& chart, const std::string& filename);
+    static void writeToFile(const Chart& chart, const std::string& filename, size_t bufferSize);
     static std::string generateContent(const Chart& chart);
+    // Appends to out, reserving room for the whole chart up front. Edges are
+    // bucketed by subgraph in one pass, so the cost is linear in the chart.
+    static void generateContent(const Chart& chart, std::string& out);
+    // Same output, streamed through the sink's fixed buffer and flushed at
+    // the end, so the text is never held in memory as a whole
+    static void write(const Chart& chart, MermaidSink& sink);
+
+    // Binary snapshot for fast loading with ChartSnapshot (chart_snapshot.h)
+    static void writeSnapshot(const Chart& chart, MermaidSink& sink);
+    static void writeSnapshotFile(const Chart& chart, const std::string& filename);
 
 private:
-    static void writeNodeDefinition(std::stringstream& ss, const Node& node, int indentation);
-    static void writeConnection(std::stringstream& ss, const Connection& conn, int indentation);
+    template <typename Out>
+    static void writeContent(const Chart& chart, Out& out);
+    template <typename Out>
+    static void writeNodeDefinition(Out& out, const Node& node, int indentation);
+    template <typename Out>
+    static void writeConnection(Out& out, const Connection& conn, int indentation);
 };
 
 #endif // MERMAID_PARSER_H
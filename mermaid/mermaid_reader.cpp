@@ -0,0 +1,159 @@
+#include "mermaid_reader.h"
+#include "mapped_file.h"
+#include "mermaid_lexer.h"
+#include <stdexcept>
+
+bool MermaidReader::next(MermaidEvent* event) {
+    for (;;) {
+        if (pendingNext < pendingCount) {
+            *event = pending[pendingNext++];
+            return true;
+        }
+
+        if (vertexNext < statement.vertices.size()) {
+            const MermaidVertex& vertex = statement.vertices[vertexNext++];
+            *event = MermaidEvent();
+            event->type = MermaidEvent::Type::Node;
+            event->id = vertex.id;
+            event->label = vertex.label;
+            event->subgraph = connectionSubgraph;
+            return true;
+        }
+        if (edgeNext < statement.edges.size()) {
+            const MermaidEdge& edge = statement.edges[edgeNext++];
+            *event = MermaidEvent();
+            event->type = MermaidEvent::Type::Edge;
+            event->id = statement.vertices[edge.from].id;
+            event->target = statement.vertices[edge.to].id;
+            event->style = edge.style;
+            event->label = edge.label;
+            return true;
+        }
+
+        // Class lists are walked lazily so a long list never gets buffered
+        while (!classList.empty()) {
+            size_t comma = classList.find(',');
+            std::string_view nodeId = classList.substr(0, comma);
+            classList = comma == std::string_view::npos ? std::string_view() : classList.substr(comma + 1);
+            if (!nodeId.empty()) {
+                *event = MermaidEvent();
+                event->type = MermaidEvent::Type::Class;
+                event->id = nodeId;
+                event->className = classListName;
+                return true;
+            }
+        }
+
+        if (!readStatement()) {
+            if (!sawFlowchart) {
+                throw std::runtime_error("No valid flowchart declaration found");
+            }
+            return false;
+        }
+    }
+}
+
+bool MermaidReader::readStatement() {
+    if (rest.empty()) return false;
+
+    size_t newline = rest.find('\n');
+    std::string_view text = rest.substr(0, newline);
+    rest = newline == std::string_view::npos ? std::string_view() : rest.substr(newline + 1);
+    ++line;
+
+    pendingCount = 0;
+    pendingNext = 0;
+    auto push = [&](MermaidEvent::Type type) -> MermaidEvent& {
+        MermaidEvent& event = pending[pendingCount++];
+        event = MermaidEvent();
+        event.type = type;
+        return event;
+    };
+
+    // The first non-comment line naming a flowchart sets the direction
+    Direction direction;
+    if (!sawFlowchart && scanFlowchartHeader(text, &direction)) {
+        sawFlowchart = true;
+        push(MermaidEvent::Type::Flowchart).direction = direction;
+    }
+
+    std::string_view subgraph = subgraphStack.empty() ? std::string_view() : subgraphStack.back();
+    MermaidStatement& st = statement;
+    scanStatement(text, &st);
+    vertexNext = 0;
+    edgeNext = 0;
+    switch (st.kind) {
+    case MermaidStatement::Kind::None:
+        break;
+    case MermaidStatement::Kind::Subgraph: {
+        MermaidEvent& event = push(MermaidEvent::Type::SubgraphBegin);
+        event.id = st.id;
+        event.label = st.label;
+        subgraphStack.push_back(st.id);
+        break;
+    }
+    case MermaidStatement::Kind::End:
+        if (!subgraphStack.empty()) {
+            push(MermaidEvent::Type::SubgraphEnd).id = subgraphStack.back();
+            subgraphStack.pop_back();
+        }
+        break;
+    case MermaidStatement::Kind::Connection:
+        // Its vertices and edges are returned by next()
+        connectionSubgraph = subgraph;
+        break;
+    case MermaidStatement::Kind::ClassDef: {
+        MermaidEvent& event = push(MermaidEvent::Type::ClassDef);
+        event.className = st.id;
+        event.label = st.label;
+        break;
+    }
+    case MermaidStatement::Kind::Class:
+        classList = st.list;
+        classListName = st.id;
+        break;
+    case MermaidStatement::Kind::Node: {
+        MermaidEvent& event = push(MermaidEvent::Type::Node);
+        event.id = st.id;
+        event.label = st.label;
+        event.subgraph = subgraph;
+        break;
+    }
+    }
+    return true;
+}
+
+void MermaidReader::parse(std::string_view content, MermaidHandler& handler) {
+    MermaidReader reader(content);
+    MermaidEvent event;
+    while (reader.next(&event)) {
+        switch (event.type) {
+        case MermaidEvent::Type::Flowchart:
+            handler.flowchart(event.direction);
+            break;
+        case MermaidEvent::Type::Node:
+            handler.node(event.id, event.label, event.subgraph);
+            break;
+        case MermaidEvent::Type::Edge:
+            handler.edge(event.id, event.target, event.style, event.label);
+            break;
+        case MermaidEvent::Type::SubgraphBegin:
+            handler.subgraphBegin(event.id, event.label);
+            break;
+        case MermaidEvent::Type::SubgraphEnd:
+            handler.subgraphEnd(event.id);
+            break;
+        case MermaidEvent::Type::ClassDef:
+            handler.classDef(event.className, event.label);
+            break;
+        case MermaidEvent::Type::Class:
+            handler.nodeClass(event.id, event.className);
+            break;
+        }
+    }
+}
+
+void MermaidReader::parseFile(const std::string& filename, MermaidHandler& handler) {
+    MappedFile file(filename);
+    parse(file.contents(), handler);
+}
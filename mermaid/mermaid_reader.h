@@ -0,0 +1,103 @@
+#ifndef MERMAID_READER_H
+#define MERMAID_READER_H
+
+#include "mermaid_lexer.h"
+#include "mermaid_parser.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One statement-level event from a flowchart. Views point into the buffer
+// being read and stay valid as long as that buffer does; the one exception
+// is a dotted edge's style, as described in mermaid_lexer.h.
+struct MermaidEvent {
+    enum class Type {
+        Flowchart,     // direction
+        Node,          // id, label, subgraph (innermost open subgraph, empty at top level)
+        Edge,          // id is the source, target the destination, style the arrow, label its text
+        SubgraphBegin, // id, label
+        SubgraphEnd,   // id of the subgraph being closed
+        ClassDef,      // className, label is the definition
+        Class          // id is the node, className the class assigned to it
+    };
+
+    Type type = Type::Node;
+    Direction direction = Direction::TD;
+    std::string_view id;
+    std::string_view label;
+    std::string_view target;
+    std::string_view style;
+    std::string_view className;
+    std::string_view subgraph;
+};
+
+// Receives events from MermaidReader::parse. Every callback defaults to doing
+// nothing, so a handler only overrides what it needs.
+class MermaidHandler {
+public:
+    virtual ~MermaidHandler() = default;
+
+    virtual void flowchart(Direction /*direction*/) {}
+    virtual void node(std::string_view /*id*/, std::string_view /*label*/, std::string_view /*subgraph*/) {}
+    virtual void edge(std::string_view /*from*/, std::string_view /*to*/, std::string_view /*style*/,
+                      std::string_view /*label*/) {}
+    virtual void subgraphBegin(std::string_view /*id*/, std::string_view /*label*/) {}
+    virtual void subgraphEnd(std::string_view /*id*/) {}
+    virtual void classDef(std::string_view /*className*/, std::string_view /*definition*/) {}
+    virtual void nodeClass(std::string_view /*nodeId*/, std::string_view /*className*/) {}
+};
+
+// Streams a flowchart as events without building a Chart. The only state kept
+// is the stack of open subgraphs, so memory does not grow with the input.
+//
+// A connection produces a Node event for every node it names, left to right,
+// then its edges: "A[a] --> B" gives Node(A), Node(B), Edge(A, B), and
+// "A & B -->|x| C --> D" gives Nodes A, B, C, D then Edges A->C and B->C
+// labeled x, and C->D. A class statement produces one Class event per listed
+// node. Nodes are reported on every reference, so a consumer that wants
+// first-sighting semantics (as parseContent does) keeps track of the ids it
+// has seen. Once the input is exhausted, a missing flowchart declaration
+// throws std::runtime_error.
+//
+// Pull:
+//     MermaidReader reader(content);
+//     MermaidEvent event;
+//     while (reader.next(&event)) { ... }
+//
+// Push:
+//     MermaidReader::parse(content, handler);
+class MermaidReader {
+public:
+    explicit MermaidReader(std::string_view content) : rest(content) {}
+
+    bool next(MermaidEvent* event);
+    // 1-based line of the statement that produced the last event
+    size_t lineNumber() const { return line; }
+
+    static void parse(std::string_view content, MermaidHandler& handler);
+    // Regular files are memory-mapped; "-" reads standard input
+    static void parseFile(const std::string& filename, MermaidHandler& handler);
+
+private:
+    bool readStatement();
+
+    std::string_view rest;
+    size_t line = 0;
+    bool sawFlowchart = false;
+    std::vector<std::string_view> subgraphStack;
+
+    // Events produced by the current line that have not been returned yet
+    MermaidEvent pending[2];
+    unsigned pendingCount = 0;
+    unsigned pendingNext = 0;
+    // The current connection, walked after pending; its vectors are reused
+    // from line to line
+    MermaidStatement statement;
+    size_t vertexNext = 0;
+    size_t edgeNext = 0;
+    std::string_view connectionSubgraph;
+    std::string_view classList;
+    std::string_view classListName;
+};
+
+#endif // MERMAID_READER_H
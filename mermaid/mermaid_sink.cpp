@@ -0,0 +1,96 @@
+#include "mermaid_sink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+MermaidSink::MermaidSink(size_t bufferSize) : buffer(std::max<size_t>(bufferSize, 1)) {}
+
+void MermaidSink::appendSlow(std::string_view str) {
+    // Top up the buffer, then pass large pieces straight through
+    size_t room = buffer.size() - used;
+    str.copy(buffer.data() + used, room);
+    used += room;
+    str.remove_prefix(room);
+    flush();
+    if (str.size() >= buffer.size()) {
+        writeBytes(str.data(), str.size());
+        written += str.size();
+        return;
+    }
+    str.copy(buffer.data(), str.size());
+    used = str.size();
+}
+
+void MermaidSink::append(size_t count, char c) {
+    while (count > 0) {
+        if (used == buffer.size()) flush();
+        size_t n = std::min(count, buffer.size() - used);
+        std::fill_n(buffer.data() + used, n, c);
+        used += n;
+        count -= n;
+    }
+}
+
+void MermaidSink::flush() {
+    if (used == 0) return;
+    // Reset first so a throwing writeBytes does not resend the same bytes
+    size_t size = used;
+    used = 0;
+    writeBytes(buffer.data(), size);
+    written += size;
+}
+
+FdSink::~FdSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void FdSink::writeBytes(const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int count = ::_write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+        ssize_t count = ::write(fd, data, size);
+#endif
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Failed to write output: ") + std::strerror(errno));
+        }
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+}
+
+FileSink::~FileSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void FileSink::writeBytes(const char* data, size_t size) {
+    if (std::fwrite(data, 1, size, file) != size) {
+        throw std::runtime_error("Failed to write output");
+    }
+}
+
+CallbackSink::~CallbackSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void CallbackSink::writeBytes(const char* data, size_t size) {
+    callback(std::string_view(data, size));
+}
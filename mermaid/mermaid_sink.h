@@ -0,0 +1,100 @@
+#ifndef MERMAID_SINK_H
+#define MERMAID_SINK_H
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Buffered byte sink for MermaidWriter::write. Output collects in a fixed
+// buffer that is handed to writeBytes whenever it fills, so memory use does
+// not depend on how much is written. Derived sinks flush in their destructor
+// but swallow errors there; call flush() to see them.
+class MermaidSink {
+public:
+    static constexpr size_t defaultBufferSize = 64 * 1024;
+
+    explicit MermaidSink(size_t bufferSize = defaultBufferSize);
+    virtual ~MermaidSink() = default;
+
+    MermaidSink(const MermaidSink&) = delete;
+    MermaidSink& operator=(const MermaidSink&) = delete;
+
+    void append(std::string_view str) {
+        if (str.size() <= buffer.size() - used) {
+            str.copy(buffer.data() + used, str.size());
+            used += str.size();
+        } else {
+            appendSlow(str);
+        }
+    }
+
+    void append(size_t count, char c);
+
+    MermaidSink& operator+=(std::string_view str) {
+        append(str);
+        return *this;
+    }
+
+    // Hands everything buffered so far to writeBytes
+    void flush();
+
+    // Bytes accepted so far, flushed or not
+    size_t bytesWritten() const { return written + used; }
+
+protected:
+    virtual void writeBytes(const char* data, size_t size) = 0;
+
+private:
+    void appendSlow(std::string_view str);
+
+    std::vector<char> buffer;
+    size_t used = 0;
+    size_t written = 0;
+};
+
+// Writes to a file descriptor (a file, pipe or socket), retrying partial
+// writes. The descriptor is not closed.
+class FdSink : public MermaidSink {
+public:
+    explicit FdSink(int fd, size_t bufferSize = defaultBufferSize) : MermaidSink(bufferSize), fd(fd) {}
+    ~FdSink() override;
+
+protected:
+    void writeBytes(const char* data, size_t size) override;
+
+private:
+    int fd;
+};
+
+// Writes to a stdio stream. The stream is not closed.
+class FileSink : public MermaidSink {
+public:
+    explicit FileSink(FILE* file, size_t bufferSize = defaultBufferSize) : MermaidSink(bufferSize), file(file) {}
+    ~FileSink() override;
+
+protected:
+    void writeBytes(const char* data, size_t size) override;
+
+private:
+    FILE* file;
+};
+
+// Hands each filled buffer to a callback
+class CallbackSink : public MermaidSink {
+public:
+    using Callback = std::function<void(std::string_view)>;
+
+    explicit CallbackSink(Callback callback, size_t bufferSize = defaultBufferSize)
+        : MermaidSink(bufferSize), callback(std::move(callback)) {}
+    ~CallbackSink() override;
+
+protected:
+    void writeBytes(const char* data, size_t size) override;
+
+private:
+    Callback callback;
+};
+
+#endif // MERMAID_SINK_H
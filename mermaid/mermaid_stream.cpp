@@ -0,0 +1,131 @@
+#include "mermaid_parser.h"
+#include "chart_graph.h"
+#include "mermaid_lexer.h"
+#include "mermaid_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Block-wise streaming parse.
+//
+// Input is read into one buffer of blockSize bytes. The complete lines in it
+// are scanned and reported, and the unfinished last line is moved to the
+// front to be completed by the next read; the buffer only grows when a
+// single line does not fit. Node ids are interned, both to tell first
+// sightings from repeats and to give the handler views that outlive the
+// buffer, and the open subgraph ids are owned copies. Nothing else survives
+// a line.
+
+namespace {
+
+class StreamParser {
+public:
+    explicit StreamParser(MermaidHandler& handler) : handler(handler) {}
+
+    void scanLines(std::string_view lines);
+    void finish() const;
+
+private:
+    // Interns id and reports it if it is new or gets a label; returns the
+    // interned view
+    std::string_view sight(std::string_view id, std::string_view label);
+
+    MermaidHandler& handler;
+    StringInterner ids;
+    std::vector<std::string> subgraphStack;
+    bool sawFlowchart = false;
+    MermaidStatement st;
+    std::vector<std::string_view> vertexIds;
+};
+
+std::string_view StreamParser::sight(std::string_view id, std::string_view label) {
+    size_t known = ids.size();
+    StringId handle = ids.intern(id);
+    std::string_view interned = ids.str(handle);
+    if (handle == known || !label.empty()) {
+        handler.node(interned, label, subgraphStack.empty() ? std::string_view() : subgraphStack.back());
+    }
+    return interned;
+}
+
+void StreamParser::scanLines(std::string_view lines) {
+    LineCursor cursor(lines);
+    std::string_view line;
+    while (cursor.next(&line)) {
+        Direction direction;
+        if (!sawFlowchart && scanFlowchartHeader(line, &direction)) {
+            sawFlowchart = true;
+            handler.flowchart(direction);
+        }
+
+        scanStatement(line, &st);
+        switch (st.kind) {
+        case MermaidStatement::Kind::None:
+            break;
+        case MermaidStatement::Kind::Subgraph:
+            handler.subgraphBegin(st.id, st.label);
+            subgraphStack.emplace_back(st.id);
+            break;
+        case MermaidStatement::Kind::End:
+            if (!subgraphStack.empty()) {
+                handler.subgraphEnd(subgraphStack.back());
+                subgraphStack.pop_back();
+            }
+            break;
+        case MermaidStatement::Kind::Connection:
+            vertexIds.clear();
+            for (const MermaidVertex& vertex : st.vertices) {
+                vertexIds.push_back(sight(vertex.id, vertex.label));
+            }
+            for (const MermaidEdge& edge : st.edges) {
+                handler.edge(vertexIds[edge.from], vertexIds[edge.to], edge.style, edge.label);
+            }
+            break;
+        case MermaidStatement::Kind::ClassDef:
+            handler.classDef(st.id, st.label);
+            break;
+        case MermaidStatement::Kind::Class:
+            forEachListItem(st.list, [&](std::string_view nodeId) { handler.nodeClass(nodeId, st.id); });
+            break;
+        case MermaidStatement::Kind::Node:
+            sight(st.id, st.label);
+            break;
+        }
+    }
+}
+
+void StreamParser::finish() const {
+    if (!sawFlowchart) {
+        throw std::runtime_error("No valid flowchart declaration found");
+    }
+}
+
+} // namespace
+
+void MermaidParser::parseStream(std::istream& in, MermaidHandler& handler, size_t blockSize) {
+    StreamParser parser(handler);
+    std::vector<char> buffer(std::max<size_t>(blockSize, 1));
+    size_t held = 0; // start of an unfinished line, carried over from the last read
+    for (bool more = true; more;) {
+        if (held == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        in.read(buffer.data() + held, static_cast<std::streamsize>(buffer.size() - held));
+        if (in.bad()) {
+            throw std::runtime_error("Error reading the flowchart stream");
+        }
+        more = static_cast<bool>(in);
+        size_t filled = held + static_cast<size_t>(in.gcount());
+
+        std::string_view data(buffer.data(), filled);
+        size_t cut = filled;
+        if (more) {
+            size_t newline = data.rfind('\n');
+            cut = newline == std::string_view::npos ? 0 : newline + 1;
+        }
+        parser.scanLines(data.substr(0, cut));
+        held = filled - cut;
+        std::memmove(buffer.data(), buffer.data() + cut, held);
+    }
+    parser.finish();
+}
@@ -1,5 +1,26 @@
 #include "mermaid_parser.h"
+#include "arena_chart.h"
+#include "lazy_chart.h"
+#include "chart_builder.h"
+#include "chart_diff.h"
+#include "chart_patch.h"
+#include "persistent_map.h"
+#include "chart_store.h"
+#include "chart_graph.h"
+#include "chart_algorithms.h"
+#include "reachability_index.h"
+#include "mapped_file.h"
+#include "mermaid_reader.h"
+#include "sequence_tree.h"
+#include "mermaid_document.h"
+#include "mermaid_sink.h"
+#include "chart_snapshot.h"
+#include "parallel_for.h"
+#include <cstdio>
 #include <iostream>
+#include <random>
+#include <atomic>
+#include <thread>
 #include <string>
 
 // Simple test framework
@@ -451,12 +472,1718 @@ flowchart TD
     }
 }
 
+// Every parser path must build exactly the same chart
+void expectSameChart(const Chart& a, const Chart& b, const std::string& what) {
+    if (a != b || a.nameToId != b.nameToId ||
+        a.predecessors != b.predecessors || a.successors != b.successors) {
+        throw std::runtime_error("Parsers disagree on " + what);
+    }
+}
+
+void testLexerMatchesRegex() {
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string sample = buffer.str();
+    expectSameChart(MermaidParser::parseContent(sample), MermaidParser::parseContentRegex(sample), "sample.mermaid");
+
+    std::string quirks = R"(
+    A[early] --> B
+  %% graph LR in a comment does not count
+graph TD
+    subgraph One [First Group]
+        C[x] ==> D[y] %% trailing comment
+        E.-->F
+        G-->H[]
+        X[a-->b]
+    end
+    end
+    subgraph Two
+        C --> E[relabel]
+        I ---> J
+        K[only node]
+        L
+    end
+    classDef wide   fill : #fff ,  stroke:#000
+    classDef broken
+    class C,,D,E wide
+    class A narrow extra
+    end
+)";
+    expectSameChart(MermaidParser::parseContent(quirks), MermaidParser::parseContentRegex(quirks), "quirks");
+
+    bool threw = false;
+    try {
+        MermaidParser::parseContent("%% flowchart LR\nA --> B\n");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("Missing flowchart declaration was accepted");
+    }
+}
+
+void testEdgeSyntax() {
+    std::string content = R"(flowchart LR
+    A -->|yes| B
+    B -- no way --> C(Round)
+    C == big ==> D{Choice} -. maybe .-> E((Circle))
+    F & G --> H & I
+    J -->| "a|b" | K --> L([Stadium])
+    M[[Sub]] --> N[(Db)]
+    O{{Hex}} --> P[x]] --> Q
+    R(Alone)
+    S -.-> T
+)";
+    Chart chart = MermaidParser::parseContent(content);
+
+    std::vector<Connection> expected = {
+        {"A", "B", "yes", "-->"},     {"B", "C", "no way", "-->"}, {"C", "D", "big", "==>"},
+        {"D", "E", "maybe", "-.->"},  {"F", "H", "", "-->"},       {"F", "I", "", "-->"},
+        {"G", "H", "", "-->"},        {"G", "I", "", "-->"},       {"J", "K", "\"a|b\"", "-->"},
+        {"K", "L", "", "-->"},        {"M", "N", "", "-->"},       {"O", "P", "", "-->"},
+        {"S", "T", "", "-.->"},
+    };
+    if (chart.connections != expected) {
+        throw std::runtime_error("Edge labels, chains or groups were parsed wrongly");
+    }
+    std::map<std::string, std::string> labels = {{"C", "Round"}, {"D", "Choice"}, {"E", "Circle"},
+                                                 {"L", "Stadium"}, {"M", "Sub"},   {"N", "Db"},
+                                                 {"O", "Hex"},   {"P", "x"},     {"R", "Alone"}};
+    for (const auto& [id, label] : labels) {
+        if (chart.nodes.at(id).label != label) {
+            throw std::runtime_error("Shape label of " + id + " was parsed wrongly");
+        }
+    }
+    if (chart.successors.at("F") != std::vector<std::string>{"H", "I"} ||
+        chart.predecessors.at("I") != std::vector<std::string>{"F", "G"}) {
+        throw std::runtime_error("Group adjacency is wrong");
+    }
+
+    // Every reader-based path agrees
+    for (unsigned threads = 2; threads <= 4; ++threads) {
+        expectSameChart(chart, MermaidParser::parseContentParallel(content, threads),
+                        "edge syntax with " + std::to_string(threads) + " threads");
+    }
+    expectSameChart(chart, ArenaChart::parse(content).toChart(), "edge syntax in an arena");
+    LazyChart lazy = LazyChart::parse(content);
+    expectSameChart(chart, lazy.toChart(), "edge syntax in a lazy chart");
+    if (lazy.edgeStyle(3) != "-.->" || lazy.edgeStyle(12) != "-.->") {
+        throw std::runtime_error("Lazy chart lost a dotted arrow style");
+    }
+
+    // A statement's nodes come first, then its edges
+    MermaidReader reader("flowchart LR\nF & G -->|x| H --> I\n");
+    MermaidEvent event;
+    std::string trace;
+    while (reader.next(&event)) {
+        if (event.type == MermaidEvent::Type::Node) trace += std::string(event.id) + " ";
+        if (event.type == MermaidEvent::Type::Edge) {
+            trace += std::string(event.id) + ">" + std::string(event.target) + ":" + std::string(event.label) + " ";
+        }
+    }
+    if (trace != "F G H I F>H:x G>H:x H>I: ") {
+        throw std::runtime_error("Unexpected connection events: " + trace);
+    }
+
+    // Edits that change the number of edges on a line
+    MermaidDocument doc(content);
+    expectSameChart(MermaidParser::parseContent(doc.text()), doc.chart(), "edge syntax document");
+    auto replaceText = [&](const std::string& from, const std::string& to) {
+        doc.edit(doc.text().find(from), from.size(), to);
+        expectSameChart(MermaidParser::parseContent(doc.text()), doc.chart(), "edit of " + from);
+    };
+    replaceText("H & I", "H");
+    replaceText("-->|yes| B", "-- yes --> B --> A");
+    replaceText("F & G", "F & G & Z");
+    replaceText("no way", "any way");
+    if (doc.rebuildCount() != 0) {
+        throw std::runtime_error("Edge edits should not rebuild the document");
+    }
+
+    // Labels survive a round trip through the writer, which writes dotted
+    // arrows the way Mermaid spells them
+    std::string written = MermaidWriter::generateContent(chart);
+    Chart reparsed = MermaidParser::parseContent(written);
+    if (reparsed.connections != chart.connections) {
+        throw std::runtime_error("Edge labels did not survive a round trip");
+    }
+    if (written.find("D -.->|maybe| E") == std::string::npos || written.find("S -.-> T") == std::string::npos) {
+        throw std::runtime_error("Dotted arrows were written wrongly:\n" + written);
+    }
+}
+
+void testMappedFile() {
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    MappedFile mapped("sample.mermaid");
+    if (!mapped.isMapped() || mapped.contents() != buffer.str()) {
+        throw std::runtime_error("Mapped contents differ from the file");
+    }
+
+    MappedFile moved(std::move(mapped));
+    if (moved.contents() != buffer.str() || !mapped.contents().empty()) {
+        throw std::runtime_error("Moving a MappedFile lost its contents");
+    }
+
+    std::ofstream("empty.mermaid").close();
+    bool empty = MappedFile("empty.mermaid").contents().empty();
+    std::remove("empty.mermaid");
+    if (!empty) {
+        throw std::runtime_error("Empty file produced contents");
+    }
+
+    bool threw = false;
+    try {
+        MappedFile missing("does_not_exist.mermaid");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("Opening a missing file did not throw");
+    }
+}
+
+void testChartGraph() {
+    Chart chart = MermaidParser::parseFile("sample.mermaid");
+    ChartGraph graph(chart);
+
+    if (graph.nodeCount() != chart.nodes.size() || graph.edgeCount() != chart.connections.size()) {
+        throw std::runtime_error("ChartGraph size differs from the chart");
+    }
+
+    for (const auto& [id, node] : chart.nodes) {
+        ChartGraph::NodeHandle handle = graph.find(id);
+        if (handle == ChartGraph::npos || graph.id(handle) != id || graph.label(handle) != node.label) {
+            throw std::runtime_error("Node '" + id + "' not interned correctly");
+        }
+
+        // Neighbor runs must match the string maps element for element
+        auto expectSame = [&](const ChartGraph::IdRange& range, const std::vector<std::string>& expected,
+                              const char* what) {
+            std::vector<std::string> actual(range.begin(), range.end());
+            if (actual != expected) {
+                throw std::runtime_error(std::string(what) + " of '" + id + "' differ");
+            }
+        };
+        auto succ = chart.successors.find(id);
+        auto pred = chart.predecessors.find(id);
+        expectSame(graph.successorIds(id), succ == chart.successors.end() ? std::vector<std::string>() : succ->second,
+                   "Successors");
+        expectSame(graph.predecessorIds(id), pred == chart.predecessors.end() ? std::vector<std::string>() : pred->second,
+                   "Predecessors");
+    }
+
+    for (size_t e = 0; e < chart.connections.size(); ++e) {
+        const Connection& conn = chart.connections[e];
+        if (graph.id(graph.from(e)) != conn.from || graph.id(graph.to(e)) != conn.to ||
+            graph.edgeStyle(e) != conn.style || graph.edgeLabel(e) != conn.label) {
+            throw std::runtime_error("Edge " + std::to_string(e) + " differs");
+        }
+    }
+
+    if (graph.find("missing") != ChartGraph::npos || !graph.successorIds("missing").empty()) {
+        throw std::runtime_error("Unknown id resolved to a node");
+    }
+
+    // Styles are shared strings, not node ids
+    if (graph.find("-->") != ChartGraph::npos) {
+        throw std::runtime_error("Edge style resolved to a node");
+    }
+
+    ChartGraphBuilder builder;
+    builder.addEdge("X", "Y", "", "-->");
+    builder.addNode("X", "Label X");
+    builder.addEdge("X", "Z");
+    ChartGraph built = builder.build();
+    if (built.nodeCount() != 3 || built.label(built.find("X")) != "Label X" ||
+        built.successors(built.find("X")).size() != 2 || built.predecessors(built.find("Z"))[0] != built.find("X")) {
+        throw std::runtime_error("ChartGraphBuilder produced the wrong graph");
+    }
+}
+
+void testGraphAlgorithms() {
+    // A feeds a cycle B -> C -> D -> B; E hangs off D
+    ChartGraphBuilder builder;
+    for (const char* id : {"A", "B", "C", "D", "E"}) builder.addNode(id);
+    builder.addEdge("A", "B");
+    builder.addEdge("B", "C");
+    builder.addEdge("A", "C");
+    builder.addEdge("C", "D");
+    builder.addEdge("D", "B");
+    builder.addEdge("D", "E");
+    ChartGraph cyclic = builder.build();
+    auto h = [&](const ChartGraph& graph, const char* id) { return graph.find(id); };
+
+    StronglyConnected scc = GraphAlgorithms::stronglyConnectedComponents(cyclic);
+    const auto& component = scc.component;
+    if (scc.count != 3 || component[h(cyclic, "B")] != component[h(cyclic, "C")] ||
+        component[h(cyclic, "C")] != component[h(cyclic, "D")] ||
+        component[h(cyclic, "A")] <= component[h(cyclic, "B")] ||
+        component[h(cyclic, "D")] <= component[h(cyclic, "E")]) {
+        throw std::runtime_error("Wrong strongly connected components");
+    }
+    if (GraphAlgorithms::isAcyclic(cyclic) || GraphAlgorithms::topologicalSort(cyclic).size() != 1) {
+        throw std::runtime_error("Topological sort accepted a cycle");
+    }
+    bool threw = false;
+    try {
+        GraphAlgorithms::longestPath(cyclic);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) throw std::runtime_error("Longest path accepted a cycle");
+
+    NodeSet down = GraphAlgorithms::reachable(cyclic, h(cyclic, "C"));
+    NodeSet up = GraphAlgorithms::reaching(cyclic, {h(cyclic, "E")});
+    if (down.count() != 4 || down.contains(h(cyclic, "A")) || up.count() != 5) {
+        throw std::runtime_error("Wrong reachable set");
+    }
+
+    // The sample is a DAG: every edge must go forward in the order, and the
+    // longest path must be a real path
+    Chart chart = MermaidParser::parseFile("sample.mermaid");
+    ChartGraph graph(chart);
+    std::vector<ChartGraph::NodeHandle> order = GraphAlgorithms::topologicalSort(graph);
+    if (order.size() != graph.nodeCount()) throw std::runtime_error("Sample should be acyclic");
+    std::vector<size_t> position(graph.nodeCount());
+    for (size_t i = 0; i < order.size(); ++i) position[order[i]] = i;
+    for (size_t e = 0; e < graph.edgeCount(); ++e) {
+        if (position[graph.from(e)] >= position[graph.to(e)]) {
+            throw std::runtime_error("Topological order breaks edge " + std::to_string(e));
+        }
+    }
+    if (GraphAlgorithms::stronglyConnectedComponents(graph).count != graph.nodeCount()) {
+        throw std::runtime_error("A DAG has one component per node");
+    }
+    std::vector<ChartGraph::NodeHandle> path = GraphAlgorithms::longestPath(graph);
+    std::vector<uint32_t> lengths = GraphAlgorithms::longestPathLengths(graph);
+    if (path.size() != *std::max_element(lengths.begin(), lengths.end()) + 1) {
+        throw std::runtime_error("Longest path has the wrong length");
+    }
+    for (size_t i = 1; i < path.size(); ++i) {
+        auto successors = graph.successors(path[i - 1]);
+        if (std::find(successors.begin(), successors.end(), path[i]) == successors.end()) {
+            throw std::runtime_error("Longest path is not a path");
+        }
+    }
+
+    // Reachability agrees with a walk over the string maps
+    ChartGraph::NodeHandle start = graph.find("usdCore");
+    std::set<std::string> seen{"usdCore"};
+    std::vector<std::string> stack{"usdCore"};
+    while (!stack.empty()) {
+        std::string node = stack.back();
+        stack.pop_back();
+        auto it = chart.successors.find(node);
+        if (it == chart.successors.end()) continue;
+        for (const auto& next : it->second) {
+            if (seen.insert(next).second) stack.push_back(next);
+        }
+    }
+    NodeSet reached = GraphAlgorithms::reachable(graph, start);
+    size_t matched = 0;
+    reached.forEach([&](ChartGraph::NodeHandle node) { matched += seen.count(std::string(graph.id(node))); });
+    if (reached.count() != seen.size() || matched != seen.size()) {
+        throw std::runtime_error("Reachable set differs from the map walk");
+    }
+}
+
+void testConnectionDedup() {
+    // Off by default: repeats are kept
+    Chart plain;
+    plain.addConnection(Connection("A", "B"));
+    if (!plain.addConnection(Connection("A", "B")) || plain.connections.size() != 2 || plain.suppressedConnections()) {
+        throw std::runtime_error("Connections were deduplicated without being asked to");
+    }
+
+    auto consistent = [](const Chart& chart) {
+        ChartBuilder builder;
+        builder.addConnections(chart.connections);
+        Chart adjacency = builder.build();
+        return chart.successors == adjacency.successors && chart.predecessors == adjacency.predecessors &&
+               chart.fingerprint() == chart.computeFingerprint();
+    };
+
+    // Enabling collapses existing repeats, keeping the first of each
+    Chart chart = MermaidParser::parseContent("flowchart TD\n"
+                                              "A --> B\nB --> C\nA --> B\nA ==> B\nC --> A\nB --> C\nA --> B\n");
+    chart.setDeduplicateConnections(true);
+    std::vector<Connection> expected = {Connection("A", "B", "", "-->"), Connection("B", "C", "", "-->"),
+                                        Connection("A", "B", "", "==>"), Connection("C", "A", "", "-->")};
+    if (!chart.deduplicatesConnections() || chart.connections != expected || chart.suppressedConnections() != 3 ||
+        !consistent(chart)) {
+        throw std::runtime_error("Enabling deduplication did not collapse existing repeats");
+    }
+
+    // Only exact repeats are suppressed: label and style both count
+    bool repeat = chart.addConnection(Connection("B", "C", "", "-->"));
+    bool labeled = chart.addConnection(Connection("B", "C", "yes", "-->"));
+    bool styled = chart.addConnection(Connection("B", "C", "", "==>"));
+    if (repeat || !labeled || !styled || chart.connections.size() != 6 || chart.suppressedConnections() != 4 ||
+        !consistent(chart)) {
+        throw std::runtime_error("Deduplication suppressed the wrong connections");
+    }
+
+    // Copies keep the index, and edits through ChartPatch and ChartDiff keep
+    // it in step
+    Chart copy = chart;
+    if (copy.addConnection(Connection("C", "A", "", "-->")) || copy.suppressedConnections() != 5) {
+        throw std::runtime_error("A copied chart lost its deduplication index");
+    }
+    {
+        ChartPatch patch(chart);
+        patch.removeConnection("C", "A");
+        if (!patch.addConnection(Connection("C", "A", "", "-->")) || patch.addConnection(Connection("C", "A", "", "-->"))) {
+            throw std::runtime_error("A removed connection still blocked its re-addition");
+        }
+        patch.renameNode("C", "D");
+        if (patch.addConnection(Connection("B", "D", "yes", "-->"))) {
+            throw std::runtime_error("A renamed connection escaped deduplication");
+        }
+    }
+    if (chart.addConnection(Connection("D", "A", "", "-->")) || !consistent(chart)) {
+        throw std::runtime_error("Deduplication went stale after a patch commit");
+    }
+    Chart target = chart;
+    target.connections.erase(target.connections.begin());
+    target.refreshFingerprint();
+    ChartDiff::compute(chart, target).apply(chart);
+    if (!chart.addConnection(Connection("A", "B", "", "-->")) || chart.addConnection(Connection("A", "B", "", "==>"))) {
+        throw std::runtime_error("Deduplication went stale after applying a diff");
+    }
+
+    chart.setDeduplicateConnections(false);
+    if (!chart.addConnection(Connection("A", "B", "", "-->"))) {
+        throw std::runtime_error("Disabling deduplication had no effect");
+    }
+}
+
+void testChartBuilder() {
+    // Same records through Chart's add* methods and through the builder
+    std::vector<Node> nodes = {Node("b", "Bee"), Node("a", "Ay"), Node("c"), Node("b", "Bee2", "fill:red"),
+                               Node("d", "Ay"), Node("e", "Bee")};
+    std::vector<Connection> connections = {Connection("a", "b"), Connection("b", "c", "x", "-.->"),
+                                           Connection("a", "b"), Connection("ghost", "a"),
+                                           Connection("c", "a"), Connection("a", "c")};
+    Chart expected;
+    expected.direction = Direction::TD;
+    for (const auto& node : nodes) expected.addNode(node);
+    for (const auto& conn : connections) expected.addConnection(conn);
+
+    ChartBuilder builder(Direction::TD);
+    builder.reserve(nodes.size(), connections.size());
+    builder.addNode(nodes[0]);
+    builder.addNodes(std::vector<Node>(nodes.begin() + 1, nodes.end()));
+    builder.addConnections(connections);
+    Chart built = builder.build();
+    if (built != expected || built.nameToId != expected.nameToId || built.successors != expected.successors ||
+        built.predecessors != expected.predecessors) {
+        throw std::runtime_error("ChartBuilder differs from sequential construction");
+    }
+    if (built.nodes.at("b").label != "Bee2" || built.nameToId.at("Bee") != "e" || built.nameToId.at("Ay") != "d") {
+        throw std::runtime_error("ChartBuilder did not keep the last duplicate");
+    }
+    if (built.fingerprint() != expected.fingerprint() || built.fingerprint() != built.computeFingerprint()) {
+        throw std::runtime_error("ChartBuilder fingerprint is wrong");
+    }
+    if (builder.nodeCount() != 0 || builder.connectionCount() != 0 || !builder.build().nodes.empty()) {
+        throw std::runtime_error("ChartBuilder was not emptied by build");
+    }
+
+    // A parsed chart rebuilt from its own records
+    Chart sample = MermaidParser::parseFile("sample.mermaid");
+    ChartBuilder again(sample.direction);
+    for (const auto& [id, node] : sample.nodes) again.addNode(node);
+    again.addConnections(sample.connections);
+    Chart rebuilt = again.build();
+    if (rebuilt.nodes != sample.nodes || rebuilt.connections != sample.connections ||
+        rebuilt.successors != sample.successors || rebuilt.predecessors != sample.predecessors) {
+        throw std::runtime_error("ChartBuilder does not rebuild sample.mermaid");
+    }
+}
+
+void testArenaChart() {
+    auto sameChart = [](const Chart& a, const Chart& b) {
+        return a == b && a.nameToId == b.nameToId && a.successors == b.successors &&
+               a.predecessors == b.predecessors && a.fingerprint() == b.fingerprint();
+    };
+
+    const char* files[] = {"sample.mermaid", "subgraph_test.mermaid"};
+    for (const char* file : files) {
+        MappedFile mapped(file);
+        std::string_view content = mapped.contents();
+        ArenaChart arena = ArenaChart::parse(content, 256);
+        if (!sameChart(arena.toChart(), MermaidParser::parseContent(content))) {
+            throw std::runtime_error(std::string("ArenaChart differs from parseContent on ") + file);
+        }
+    }
+
+    // Nothing may escape the arena: with the default resource disabled, any
+    // allocation that is not routed through it throws
+    std::string content = "flowchart TD\n"
+                          "subgraph outer [Outer]\n"
+                          "A[A long label that does not fit in a small string] --> B\n"
+                          "end\n"
+                          "classDef important fill:#f96,stroke:#333\n"
+                          "class A,B important\n"
+                          "B --> C[Third node with its own long label]\n";
+    std::pmr::memory_resource* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    try {
+        ArenaChart arena = ArenaChart::parse(content, 64);
+        ArenaChart moved = std::move(arena);
+        moved.addConnection("C", "A with another long identifier that is not short", "label", "-.->");
+        moved.addSubgraph("outer", "Replaced");
+        std::pmr::set_default_resource(previous);
+        if (moved.nodes().size() != 3 || moved.connections().size() != 3 || moved.nameToId().size() != 2 ||
+            moved.subgraphs().at("outer").label != "Replaced" || !moved.subgraphs().at("outer").nodeIds.empty() ||
+            moved.successors().at("C").front() != "A with another long identifier that is not short") {
+            throw std::runtime_error("ArenaChart add* methods do not behave like Chart's");
+        }
+
+        // Self-move keeps the contents; a moved-from chart can be assigned again
+        ArenaChart& self = moved;
+        moved = std::move(self);
+        arena = std::move(moved);
+        if (arena.nodes().size() != 3 || arena.connections().size() != 3) {
+            throw std::runtime_error("Moving an ArenaChart lost its contents");
+        }
+    } catch (const std::bad_alloc&) {
+        std::pmr::set_default_resource(previous);
+        throw std::runtime_error("ArenaChart allocated outside its arena");
+    }
+}
+
+void testLazyChart() {
+    auto sameChart = [](const Chart& a, const Chart& b) {
+        return a == b && a.nameToId == b.nameToId && a.successors == b.successors &&
+               a.predecessors == b.predecessors && a.fingerprint() == b.fingerprint();
+    };
+
+    const char* files[] = {"sample.mermaid", "subgraph_test.mermaid"};
+    for (const char* file : files) {
+        LazyChart lazy = LazyChart::parseFile(file);
+        if (!sameChart(lazy.toChart(), MermaidParser::parseFile(file))) {
+            throw std::runtime_error(std::string("LazyChart differs from parseContent on ") + file);
+        }
+    }
+
+    // Relabeling, redeclared and nested subgraphs, chains and edge labels
+    std::string content = "flowchart TD\n"
+                          "subgraph S [First]\n"
+                          "  A[\"Quoted\"] -->|go| B\n"
+                          "  subgraph S [Second]\n"
+                          "    C\n"
+                          "  end\n"
+                          "  D --> A[Relabeled] --> C\n"
+                          "end\n"
+                          "subgraph T\n"
+                          "  B[Bee] ==> E\n"
+                          "end\n"
+                          "classDef k fill:#fff\n"
+                          "class A,E k\n";
+    LazyChart lazy = LazyChart::parse(content);
+    if (!sameChart(lazy.toChart(), MermaidParser::parseContent(content))) {
+        throw std::runtime_error("LazyChart differs from parseContent on nested subgraphs");
+    }
+
+    LazyChart::NodeHandle a = lazy.find("A");
+    LazyChart::NodeHandle b = lazy.find("B");
+    if (lazy.nodeCount() != 5 || lazy.edgeCount() != 4 || a != 0 || lazy.find("Z") != LazyChart::npos ||
+        lazy.id(b) != "B" || lazy.label(a) != "Relabeled" || lazy.label(b) != "Bee" ||
+        !lazy.label(lazy.find("E")).empty() || lazy.edgeLabel(0) != "go" || lazy.edgeStyle(3) != "==>") {
+        throw std::runtime_error("LazyChart node or edge queries are wrong");
+    }
+    LazyChart first = LazyChart::parse("flowchart LR\nA[\"Quoted\"] --> B\n");
+    if (first.rawLabel(0) != "\"Quoted\"" || first.label(0) != "Quoted" || first.direction() != Direction::LR) {
+        throw std::runtime_error("LazyChart does not strip label quotes");
+    }
+
+    std::vector<LazyChart::NodeHandle> successors(lazy.successors(a).begin(), lazy.successors(a).end());
+    std::vector<LazyChart::NodeHandle> predecessors(lazy.predecessors(a).begin(), lazy.predecessors(a).end());
+    if (successors != std::vector<LazyChart::NodeHandle>{b, lazy.find("C")} ||
+        predecessors != std::vector<LazyChart::NodeHandle>{lazy.find("D")}) {
+        throw std::runtime_error("LazyChart adjacency is wrong");
+    }
+}
+
+void testChartDiff() {
+    Chart sample = MermaidParser::parseFile("sample.mermaid");
+    if (!ChartDiff::compute(sample, sample).empty()) {
+        throw std::runtime_error("Diff of a chart with itself is not empty");
+    }
+
+    Chart before = MermaidParser::parseContent("flowchart TD\n"
+                                               "subgraph s1 [One]\n A[Alpha]\n B[Beta]\nend\n"
+                                               "subgraph s2 [Two]\n C\nend\n"
+                                               "classDef hot fill:#f00\nclassDef cold fill:#00f\n"
+                                               "A --> B\nA --> B\nB --> C\nC --> A\n"
+                                               "class A,B hot\n");
+    Chart after = MermaidParser::parseContent("flowchart LR\n"
+                                              "subgraph s1 [Uno]\n A[\"Alpha\"]\n D[Delta]\nend\n"
+                                              "subgraph s3 [Three]\n C\nend\n"
+                                              "classDef hot fill: #f00\nclassDef warm fill:#fa0\n"
+                                              "A ==> B\nB --> C\nC --> D\n"
+                                              "class A warm\nclass B hot\n");
+    ChartDiff diff = ChartDiff::compute(before, after);
+    using Pair = ChartDiff::Pair;
+    if (!diff.directionChanged || diff.addedNodes.size() != 1 || diff.addedNodes[0].id != "D" ||
+        !diff.removedNodes.empty() || diff.relabeledNodes.size() != 1 || diff.relabeledNodes[0].key != "B" ||
+        diff.relabeledNodes[0].after != "") {
+        throw std::runtime_error("Diff reports the wrong node changes");
+    }
+    if (diff.addedConnections.size() != 1 || diff.addedConnections[0] != Connection("C", "D", "", "-->") ||
+        diff.removedConnections.size() != 2 || diff.removedConnections[0].to != "B" ||
+        diff.removedConnections[1].from != "C") {
+        throw std::runtime_error("Diff reports the wrong connection changes");
+    }
+    if (diff.addedSubgraphs.size() != 1 || diff.addedSubgraphs[0].id != "s3" || diff.removedSubgraphs.size() != 1 ||
+        diff.relabeledSubgraphs.size() != 1 || diff.addedMembers != std::vector<Pair>{{"s1", "D"}} ||
+        diff.removedMembers != std::vector<Pair>{{"s1", "B"}}) {
+        throw std::runtime_error("Diff reports the wrong subgraph changes");
+    }
+    if (diff.addedClasses.size() != 1 || diff.removedClasses.size() != 1 || !diff.changedClasses.empty() ||
+        diff.addedNodeClasses != std::vector<Pair>{{"A", "warm"}} ||
+        diff.removedNodeClasses != std::vector<Pair>{{"A", "hot"}}) {
+        throw std::runtime_error("Diff reports the wrong class changes");
+    }
+    if (diff.size() != 15) {
+        throw std::runtime_error("Diff has the wrong size: " + std::to_string(diff.size()));
+    }
+
+    // Applying a diff reaches the target, with consistent adjacency and a
+    // maintained fingerprint
+    auto checkApply = [](const Chart& from, const Chart& to) {
+        Chart patched = from;
+        ChartDiff::compute(from, to).apply(patched);
+        ChartBuilder rebuilt;
+        rebuilt.addConnections(patched.connections);
+        Chart adjacency = rebuilt.build();
+        if (!patched.semanticEquals(to) || patched.fingerprint() != to.fingerprint() ||
+            patched.fingerprint() != patched.computeFingerprint() || patched.successors != adjacency.successors ||
+            patched.predecessors != adjacency.predecessors) {
+            throw std::runtime_error("Applying a diff does not reproduce the target chart");
+        }
+    };
+    checkApply(before, after);
+    checkApply(after, before);
+    checkApply(before, sample);
+
+    // Random charts over a small alphabet, so versions overlap heavily
+    std::mt19937 random(17);
+    auto randomChart = [&]() {
+        Chart chart;
+        chart.direction = random() % 2 ? Direction::LR : Direction::TD;
+        auto id = [&] { return std::string(1, static_cast<char>('a' + random() % 6)); };
+        for (int i = 0; i < 5; ++i) chart.addNode(Node(id(), random() % 3 ? "" : "L" + id()));
+        for (int i = 0; i < 8; ++i) chart.addConnection(Connection(id(), id(), random() % 4 ? "" : "x"));
+        for (int i = 0; i < 2; ++i) chart.addSubgraph(SubGraph("s" + id(), random() % 2 ? "" : "S"));
+        for (const auto& [nodeId, node] : chart.nodes) {
+            if (random() % 2) chart.addNodeToSubgraph(nodeId, "s" + id());
+        }
+        for (int i = 0; i < 2; ++i) chart.addClass("c" + id(), random() % 2 ? "fill:#f00" : "fill : #f00");
+        for (int i = 0; i < 3; ++i) chart.addNodeClass(id(), "c" + id());
+        return chart;
+    };
+    for (int round = 0; round < 200; ++round) {
+        Chart a = randomChart();
+        Chart b = randomChart();
+        if (ChartDiff::compute(a, b).empty() != a.semanticEquals(b) || !ChartDiff::compute(a, Chart(a)).empty()) {
+            throw std::runtime_error("Diff disagrees with semanticEquals");
+        }
+        checkApply(a, b);
+    }
+}
+
+void testChartPatch() {
+    // Reference edits: rewrite the fields directly, then rebuild adjacency
+    // from the connections and recompute the fingerprint
+    auto rebuildAdjacency = [](Chart& chart) {
+        ChartBuilder builder;
+        builder.addConnections(chart.connections);
+        Chart adjacency = builder.build();
+        chart.successors = std::move(adjacency.successors);
+        chart.predecessors = std::move(adjacency.predecessors);
+        chart.refreshFingerprint();
+    };
+    auto removeConnection = [&](Chart& chart, const std::string& from, const std::string& to) {
+        for (size_t i = chart.connections.size(); i-- > 0;) {
+            if (chart.connections[i].from == from && chart.connections[i].to == to) {
+                chart.connections.erase(chart.connections.begin() + i);
+                break;
+            }
+        }
+        rebuildAdjacency(chart);
+    };
+    auto removeNode = [&](Chart& chart, const std::string& id) {
+        auto touches = [&](const Connection& conn) { return conn.from == id || conn.to == id; };
+        chart.connections.erase(std::remove_if(chart.connections.begin(), chart.connections.end(), touches),
+                                chart.connections.end());
+        auto node = chart.nodes.find(id);
+        if (node != chart.nodes.end()) {
+            auto name = chart.nameToId.find(node->second.label);
+            if (name != chart.nameToId.end() && name->second == id) chart.nameToId.erase(name);
+            chart.nodes.erase(node);
+        }
+        for (auto& [subgraphId, subgraph] : chart.subgraphs) subgraph.nodeIds.erase(id);
+        chart.nodeClasses.erase(id);
+        rebuildAdjacency(chart);
+    };
+    auto renameNode = [&](Chart& chart, const std::string& from, const std::string& to) {
+        for (auto& conn : chart.connections) {
+            if (conn.from == from) conn.from = to;
+            if (conn.to == from) conn.to = to;
+        }
+        if (auto node = chart.nodes.extract(from)) {
+            node.key() = to;
+            node.mapped().id = to;
+            auto name = chart.nameToId.find(node.mapped().label);
+            if (name != chart.nameToId.end() && name->second == from) name->second = to;
+            chart.nodes.insert(std::move(node));
+        }
+        for (auto& [subgraphId, subgraph] : chart.subgraphs) {
+            if (subgraph.nodeIds.erase(from)) subgraph.nodeIds.insert(to);
+        }
+        if (auto classes = chart.nodeClasses.extract(from)) {
+            classes.key() = to;
+            chart.nodeClasses.insert(std::move(classes));
+        }
+        rebuildAdjacency(chart);
+    };
+    auto same = [](const Chart& a, const Chart& b) {
+        return a == b && a.nameToId == b.nameToId && a.successors == b.successors &&
+               a.predecessors == b.predecessors && a.fingerprint() == b.fingerprint() &&
+               a.fingerprint() == a.computeFingerprint();
+    };
+
+    std::mt19937 random(23);
+    auto id = [&] { return std::string(1, static_cast<char>('a' + random() % 8)); };
+    for (int round = 0; round < 300; ++round) {
+        Chart chart;
+        for (int i = 0; i < 6; ++i) chart.addNode(Node(id(), random() % 2 ? "" : "L" + id()));
+        for (int i = 0; i < 14; ++i) chart.addConnection(Connection(id(), id(), random() % 3 ? "" : "x"));
+        chart.addSubgraph(SubGraph("s", "S"));
+        for (const auto& [nodeId, node] : chart.nodes) {
+            if (random() % 2) chart.addNodeToSubgraph(nodeId, "s");
+        }
+        for (int i = 0; i < 4; ++i) chart.addNodeClass(id(), random() % 2 ? "hot" : "cold");
+
+        Chart expected = chart;
+        {
+            ChartPatch patch(chart);
+            for (int op = 0; op < 10; ++op) {
+                std::string a = id();
+                std::string b = id();
+                bool done = false;
+                bool wanted = false;
+                switch (random() % 4) {
+                case 0:
+                    wanted = std::any_of(expected.connections.begin(), expected.connections.end(),
+                                         [&](const Connection& conn) { return conn.from == a && conn.to == b; });
+                    done = patch.removeConnection(a, b);
+                    if (wanted) removeConnection(expected, a, b);
+                    break;
+                case 1:
+                    wanted = expected.nodes.count(a) || expected.successors.count(a) ||
+                             expected.predecessors.count(a) || expected.nodeClasses.count(a);
+                    done = patch.removeNode(a);
+                    if (wanted) removeNode(expected, a);
+                    break;
+                case 2: {
+                    auto used = [&](const std::string& x) {
+                        return expected.nodes.count(x) || expected.successors.count(x) || expected.predecessors.count(x);
+                    };
+                    wanted = used(a) && (a == b || (!used(b) && !expected.nodeClasses.count(b)));
+                    done = patch.renameNode(a, b);
+                    if (wanted && a != b) renameNode(expected, a, b);
+                    break;
+                }
+                default:
+                    wanted = true;
+                    done = true;
+                    patch.addConnection(Connection(a, b));
+                    expected.addConnection(Connection(a, b));
+                    break;
+                }
+                if (done != wanted) {
+                    throw std::runtime_error("ChartPatch reported the wrong outcome in round " + std::to_string(round));
+                }
+                if (random() % 3 == 0) {
+                    patch.commit();
+                    if (patch.tombstoneCount() != 0 || !same(chart, expected)) {
+                        throw std::runtime_error("ChartPatch diverged in round " + std::to_string(round));
+                    }
+                }
+            }
+        }
+        if (!same(chart, expected)) {
+            throw std::runtime_error("ChartPatch diverged after the patch closed in round " + std::to_string(round));
+        }
+    }
+
+    // Views into the chart itself stay safe to pass
+    Chart sample = MermaidParser::parseFile("sample.mermaid");
+    ChartPatch patch(sample);
+    const Connection& first = sample.connections.front();
+    std::string from = first.from;
+    if (!patch.removeConnection(sample.successors.at(from).front(), sample.predecessors.begin()->first) &&
+        !patch.removeNode(sample.successors.begin()->first)) {
+        throw std::runtime_error("ChartPatch could not edit sample.mermaid");
+    }
+    patch.commit();
+    if (sample.fingerprint() != sample.computeFingerprint()) {
+        throw std::runtime_error("ChartPatch broke the fingerprint of sample.mermaid");
+    }
+}
+
+void testPersistentMap() {
+    // Random edits against std::map, keeping every tenth copy to check that
+    // later edits never reach it
+    PersistentMap<int, int> map;
+    std::map<int, int> reference;
+    std::vector<std::pair<PersistentMap<int, int>, std::map<int, int>>> copies;
+    std::mt19937 random(7);
+    auto same = [](const PersistentMap<int, int>& map, const std::map<int, int>& reference) {
+        std::vector<std::pair<int, int>> entries;
+        map.forEach([&](int key, int value) { entries.emplace_back(key, value); });
+        return map.size() == reference.size() &&
+               entries == std::vector<std::pair<int, int>>(reference.begin(), reference.end());
+    };
+    for (int i = 0; i < 2000; ++i) {
+        int key = static_cast<int>(random() % 300);
+        if (random() % 3 == 0) {
+            if (map.erase(key) != (reference.erase(key) == 1)) {
+                throw std::runtime_error("PersistentMap erased the wrong key " + std::to_string(key));
+            }
+        } else {
+            map.set(key, i);
+            reference[key] = i;
+        }
+        const int* found = map.find(key);
+        auto it = reference.find(key);
+        if ((found == nullptr) != (it == reference.end()) || (found && *found != it->second)) {
+            throw std::runtime_error("PersistentMap lost key " + std::to_string(key));
+        }
+        if (i % 10 == 0) copies.emplace_back(map, reference);
+    }
+    if (!same(map, reference)) {
+        throw std::runtime_error("PersistentMap diverged from std::map");
+    }
+    for (const auto& [copy, expected] : copies) {
+        if (!same(copy, expected)) {
+            throw std::runtime_error("PersistentMap changed a copy");
+        }
+    }
+
+    // Heterogeneous lookup, as with Chart's maps
+    PersistentMap<std::string, int> names;
+    names.set("b", 2);
+    names.set("a", 1);
+    if (!names.find(std::string_view("a")) || *names.find(std::string_view("b")) != 2 || names.find("c")) {
+        throw std::runtime_error("PersistentMap mishandled string_view lookups");
+    }
+}
+
+void testPersistentChart() {
+    // Converting a parsed chart round-trips it, fingerprint included
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    Chart sample = MermaidParser::parseContent(buffer.str());
+    PersistentChart converted(sample);
+    Chart back = converted.toChart();
+    if (!(back == sample) || back.nameToId != sample.nameToId || back.successors != sample.successors ||
+        back.predecessors != sample.predecessors || converted.fingerprint() != sample.fingerprint()) {
+        throw std::runtime_error("PersistentChart did not round-trip sample.mermaid");
+    }
+
+    // Every edit has the effect of the Chart method of the same name
+    Chart expected = sample;
+    PersistentChart edited = converted;
+    auto both = [&](auto edit) {
+        edit(expected);
+        edit(edited);
+    };
+    both([](auto& chart) { chart.addNode(Node("X", "Extra")); });
+    both([](auto& chart) { chart.addNode(Node("X", "Renamed", "stroke:red")); });
+    both([](auto& chart) { chart.setNodeLabel("X", "Relabelled"); });
+    both([](auto& chart) { chart.addConnection(Connection("X", "Y", "yes")); });
+    both([](auto& chart) { chart.addConnection(Connection("X", "Y", "yes")); });
+    both([](auto& chart) { chart.addClass("hot", "fill:#f00"); });
+    both([](auto& chart) { chart.addClass("hot", "fill:#f80"); });
+    both([](auto& chart) { chart.addNodeClass("X", "hot"); });
+    both([](auto& chart) { chart.addNodeClass("X", "hot"); });
+    both([](auto& chart) { chart.addSubgraph(SubGraph("box", "Box")); });
+    both([](auto& chart) { chart.addNodeToSubgraph("X", "box"); });
+    both([](auto& chart) { chart.addNodeToSubgraph("missing", "box"); });
+    both([](auto& chart) {
+        SubGraph replaced("box", "Other box");
+        replaced.nodeIds.insert("Y");
+        replaced.subgraphIds.insert("inner");
+        chart.addSubgraph(replaced);
+    });
+    Chart result = edited.toChart();
+    if (!(result == expected) || result.nameToId != expected.nameToId || result.successors != expected.successors ||
+        result.predecessors != expected.predecessors || edited.fingerprint() != expected.computeFingerprint()) {
+        throw std::runtime_error("PersistentChart edits differ from Chart's");
+    }
+    // The copy edited above shares its content with the original, unchanged
+    if (!(converted.toChart() == sample) || converted.fingerprint() != sample.fingerprint()) {
+        throw std::runtime_error("PersistentChart edits reached a copy");
+    }
+}
+
+void testChartStore() {
+    auto addEdge = [](int i) {
+        return [i](auto& chart) { chart.addConnection(Connection("n" + std::to_string(i), "n" + std::to_string(i + 1))); };
+    };
+    Chart initial;
+    initial.addNode(Node("n0", "Start"));
+    ChartStore store(initial);
+
+    // Old snapshots never change; every version matches the same edits
+    // applied to a plain chart
+    ChartStore::Snapshot first = store.snapshot();
+    Chart expected = initial;
+    std::vector<ChartStore::Snapshot> held;
+    for (int i = 0; i < 20; ++i) {
+        if (i % 5 == 2) held.push_back(store.snapshot());
+        uint64_t number = store.update(addEdge(i));
+        addEdge(i)(expected);
+        ChartStore::Snapshot now = store.snapshot();
+        if (number != static_cast<uint64_t>(i + 1) || now->number != number || !(now->chart.toChart() == expected) ||
+            now->chart.fingerprint() != expected.computeFingerprint()) {
+            throw std::runtime_error("ChartStore published the wrong version " + std::to_string(number));
+        }
+    }
+    if (first->number != 0 || !first->chart.connections.empty() || !(first->chart.toChart() == initial)) {
+        throw std::runtime_error("ChartStore changed a held snapshot");
+    }
+    for (const auto& snapshot : held) {
+        if (snapshot->chart.connections.size() != snapshot->number) {
+            throw std::runtime_error("ChartStore changed a held snapshot");
+        }
+    }
+
+    // A throwing edit publishes nothing and does not poison the next update
+    bool threw = false;
+    try {
+        store.update([](PersistentChart& chart) {
+            chart.addNode(Node("half", "done"));
+            throw std::runtime_error("edit failed");
+        });
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    addEdge(20)(expected);
+    if (!threw || store.snapshot()->number != 20 || store.update(addEdge(20)) != 21 ||
+        !(store.snapshot()->chart.toChart() == expected)) {
+        throw std::runtime_error("ChartStore mishandled a throwing edit");
+    }
+
+    // Edits run once, so they may capture locals by reference
+    ChartStore local;
+    for (int i = 0; i < 4; ++i) {
+        std::string id = "n" + std::to_string(i);
+        local.update([&](PersistentChart& chart) { chart.addNode(Node(id, "x")); });
+    }
+    const auto& nodes = local.snapshot()->chart.nodes;
+    if (nodes.size() != 4 || !nodes.find("n0") || !nodes.find("n2")) {
+        throw std::runtime_error("ChartStore lost an edit that captured by reference");
+    }
+
+    // Readers racing a writer only ever see whole versions, in order
+    const int updates = 2000;
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    auto reader = [&] {
+        uint64_t last = 0;
+        while (!done.load()) {
+            ChartStore::Snapshot snapshot = store.snapshot();
+            if (snapshot->number < last || snapshot->chart.connections.size() != snapshot->number ||
+                snapshot->chart.successors.size() != snapshot->number) {
+                ++failures;
+            }
+            last = snapshot->number;
+        }
+    };
+    std::thread a(reader);
+    std::thread b(reader);
+    for (int i = 21; i < updates; ++i) {
+        store.update(addEdge(i));
+    }
+    done = true;
+    a.join();
+    b.join();
+    if (failures.load() != 0 || store.snapshot()->chart.connections.size() != static_cast<size_t>(updates)) {
+        throw std::runtime_error("ChartStore readers saw an inconsistent version");
+    }
+}
+
+void testParallelFor() {
+    // Far more indices than cores: each still runs exactly once
+    std::vector<std::atomic<int>> runs(1000);
+    parallelFor(runs.size(), [&](size_t i) { runs[i].fetch_add(1); });
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (runs[i].load() != 1) {
+            throw std::runtime_error("parallelFor ran index " + std::to_string(i) + " " +
+                                     std::to_string(runs[i].load()) + " times");
+        }
+    }
+
+    // A throwing index does not stop the others
+    std::atomic<size_t> finished{0};
+    bool threw = false;
+    try {
+        parallelFor(100, [&](size_t i) {
+            if (i == 7) throw std::runtime_error("seven");
+            finished.fetch_add(1);
+        });
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()) == "seven";
+    }
+    if (!threw || finished.load() != 99) {
+        throw std::runtime_error("parallelFor lost an exception or skipped indices");
+    }
+    parallelFor(0, [](size_t) { throw std::runtime_error("ran an empty range"); });
+
+    // A team keeps its threads across runs and survives a failed one
+    WorkerTeam team(8);
+    std::vector<size_t> sums(team.size(), 0);
+    for (size_t round = 1; round <= 50; ++round) {
+        if (round == 20) {
+            try {
+                team.run([](size_t) { throw std::runtime_error("failed round"); });
+            } catch (const std::runtime_error&) {
+            }
+        }
+        team.run([&](size_t worker) { sums[worker] += round; });
+    }
+    for (size_t sum : sums) {
+        if (sum != 50 * 51 / 2) {
+            throw std::runtime_error("A WorkerTeam round skipped a worker");
+        }
+    }
+}
+
+void testParallelBfs() {
+    // Random graph with cycles, large enough for several bottom-up steps
+    std::mt19937 random(7);
+    ChartGraphBuilder builder;
+    const size_t n = 3000;
+    for (size_t i = 0; i < n; ++i) builder.addNode("n" + std::to_string(i));
+    for (size_t e = 0; e < 4 * n; ++e) {
+        builder.addEdge("n" + std::to_string(random() % n), "n" + std::to_string(random() % n));
+    }
+    ChartGraph graph = builder.build();
+
+    auto same = [](const NodeSet& a, const NodeSet& b) { return a.words() == b.words(); };
+    std::vector<ChartGraph::NodeHandle> sources;
+    for (size_t i = 0; i < 70; ++i) sources.push_back(static_cast<ChartGraph::NodeHandle>(random() % n));
+    sources.push_back(sources[0]);
+
+    // Over 64 sources takes the condensation sweep, under 64 the BFS
+    std::vector<NodeSet> down = GraphAlgorithms::downstreamOfEach(graph, sources, 2);
+    std::vector<NodeSet> up = GraphAlgorithms::upstreamOfEach(graph, sources);
+    std::vector<ChartGraph::NodeHandle> few(sources.begin(), sources.begin() + 10);
+    std::vector<NodeSet> fewDown = GraphAlgorithms::downstreamOfEach(graph, few);
+    std::vector<NodeSet> fewUp = GraphAlgorithms::upstreamOfEach(graph, few, 2);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        NodeSet expectDown = GraphAlgorithms::reachable(graph, sources[i]);
+        NodeSet expectUp = GraphAlgorithms::reaching(graph, {sources[i]});
+        for (unsigned threads : {1u, 3u}) {
+            if (!same(GraphAlgorithms::downstream(graph, sources[i], threads), expectDown) ||
+                !same(GraphAlgorithms::upstream(graph, sources[i], threads), expectUp)) {
+                throw std::runtime_error("Direction-optimizing BFS differs from reachable");
+            }
+        }
+        if (!same(down[i], expectDown) || !same(up[i], expectUp) ||
+            (i < few.size() && (!same(fewDown[i], expectDown) || !same(fewUp[i], expectUp)))) {
+            throw std::runtime_error("Batch BFS differs from reachable for source " + std::to_string(i));
+        }
+    }
+    if (!GraphAlgorithms::downstreamOfEach(graph, {}).empty()) {
+        throw std::runtime_error("Empty batch should give no sets");
+    }
+}
+
+void testReachabilityIndex() {
+    // A DAG with cross links and a graph with cycles, checked pair by pair
+    std::mt19937 random(11);
+    for (int shape = 0; shape < 2; ++shape) {
+        ChartGraphBuilder builder;
+        const size_t n = 600;
+        for (size_t i = 0; i < n; ++i) builder.addNode("n" + std::to_string(i));
+        for (size_t i = 0; i + 1 < n; ++i) {
+            for (int k = 0; k < 2; ++k) {
+                size_t to = shape == 0 ? i + 1 + random() % std::min<size_t>(40, n - i - 1) : random() % n;
+                builder.addEdge("n" + std::to_string(i), "n" + std::to_string(to));
+            }
+        }
+        ChartGraph graph = builder.build();
+        ReachabilityIndex index(graph);
+        for (ChartGraph::NodeHandle from = 0; from < n; ++from) {
+            NodeSet expected = GraphAlgorithms::reachable(graph, from);
+            for (ChartGraph::NodeHandle to = 0; to < n; ++to) {
+                if (index.reaches(from, to) != expected.contains(to)) {
+                    throw std::runtime_error("Reachability index wrong for " + std::string(graph.id(from)) +
+                                             " -> " + std::string(graph.id(to)));
+                }
+            }
+        }
+        if (shape == 1 && index.componentCount() >= n) {
+            throw std::runtime_error("Random graph should have a large component");
+        }
+    }
+
+    // A tree-shaped chart needs one interval per component
+    Chart chart = MermaidParser::parseFile("sample.mermaid");
+    ChartGraph graph(chart);
+    ReachabilityIndex index(graph);
+    if (!index.reaches(graph.find("usdCore"), graph.find("usdf")) ||
+        index.reaches(graph.find("usdf"), graph.find("usdCore")) || index.intervalCount() < index.componentCount()) {
+        throw std::runtime_error("Reachability index wrong on the sample");
+    }
+
+    bool threw = false;
+    try {
+        ReachabilityIndex tooSmall(graph, 1);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) throw std::runtime_error("Interval budget was not enforced");
+}
+
+void testParallelParse() {
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string sample = buffer.str();
+
+    // Subgraphs nest across chunk boundaries, are redeclared, and nodes are
+    // relabeled in later chunks
+    std::string nested = "flowchart TD\n";
+    for (int i = 0; i < 40; ++i) {
+        std::string n = std::to_string(i);
+        nested += "subgraph S" + std::to_string(i % 3) + "[Group " + n + "]\n";
+        nested += "  a" + n + "[A " + n + "] --> b" + n + "\n";
+        nested += "  subgraph Inner" + n + "\n    b" + n + " --> c" + std::to_string(i / 2) + "\n  end\n";
+        nested += "  a" + std::to_string(i / 3) + "[relabel " + n + "]\n";
+        if (i % 4 == 0) nested += "end\nend\n";
+        nested += "class a" + n + ",b" + n + " k" + std::to_string(i % 2) + "\n";
+    }
+    nested += "end\nclassDef k0 fill:#fff\nclassDef k1 fill:#000\n";
+
+    for (unsigned threads = 2; threads <= 8; ++threads) {
+        expectSameChart(MermaidParser::parseContent(sample), MermaidParser::parseContentParallel(sample, threads),
+                        "sample.mermaid with " + std::to_string(threads) + " threads");
+        expectSameChart(MermaidParser::parseContent(nested), MermaidParser::parseContentParallel(nested, threads),
+                        "nested subgraphs with " + std::to_string(threads) + " threads");
+    }
+}
+
+void testStreamingReader() {
+    std::string mermaidStr = R"(flowchart LR
+    subgraph Outer[Outer Group]
+        A[Start] --> B
+        subgraph Inner
+            C[Cee]
+        end
+    end
+    classDef hot fill:#f00
+    class A,,C hot
+    D[Dee]
+)";
+
+    // Pull: collect the event stream
+    std::vector<MermaidEvent> events;
+    MermaidReader reader(mermaidStr);
+    MermaidEvent event;
+    while (reader.next(&event)) events.push_back(event);
+
+    using Type = MermaidEvent::Type;
+    std::vector<Type> expected = {
+        Type::Flowchart, Type::SubgraphBegin, Type::Node, Type::Node, Type::Edge,
+        Type::SubgraphBegin, Type::Node, Type::SubgraphEnd, Type::SubgraphEnd,
+        Type::ClassDef, Type::Class, Type::Class, Type::Node
+    };
+    if (events.size() != expected.size()) {
+        throw std::runtime_error("Unexpected number of reader events: " + std::to_string(events.size()));
+    }
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (events[i].type != expected[i]) {
+            throw std::runtime_error("Unexpected reader event at index " + std::to_string(i));
+        }
+    }
+    if (events[0].direction != Direction::LR || events[1].label != "Outer Group" ||
+        events[2].id != "A" || events[2].label != "Start" || events[2].subgraph != "Outer" ||
+        events[4].id != "A" || events[4].target != "B" || events[4].style != "-->" ||
+        events[6].subgraph != "Inner" || events[7].id != "Inner" || events[8].id != "Outer" ||
+        events[11].id != "C" || events[11].className != "hot" || !events[12].subgraph.empty()) {
+        throw std::runtime_error("Reader event contents are wrong");
+    }
+
+    // Push: a handler that only counts
+    struct Counter : MermaidHandler {
+        size_t nodes = 0, edges = 0, classes = 0;
+        void node(std::string_view, std::string_view, std::string_view) override { ++nodes; }
+        void edge(std::string_view, std::string_view, std::string_view, std::string_view) override { ++edges; }
+        void nodeClass(std::string_view, std::string_view) override { ++classes; }
+    } counter;
+    MermaidReader::parse(mermaidStr, counter);
+    if (counter.nodes != 4 || counter.edges != 1 || counter.classes != 2) {
+        throw std::runtime_error("Handler saw the wrong number of events");
+    }
+
+    bool threw = false;
+    try {
+        MermaidReader::parse("A --> B\n", counter);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("Reader accepted input without a flowchart declaration");
+    }
+}
+
+void testStreamingParse() {
+    // Builds a Chart from the stream's events the way parseContent does
+    struct Builder : MermaidHandler {
+        Chart chart;
+        std::vector<std::string> reported;
+        std::vector<std::string_view> views;
+        bool stale = false;
+        void flowchart(Direction direction) override { chart.direction = direction; }
+        void node(std::string_view id, std::string_view label, std::string_view subgraph) override {
+            reported.emplace_back(id);
+            views.push_back(id);
+            if (chart.nodes.find(id) != chart.nodes.end()) {
+                chart.setNodeLabel(id, label);
+                return;
+            }
+            chart.addNode(Node(std::string(id), std::string(label)));
+            if (!subgraph.empty()) chart.addNodeToSubgraph(std::string(id), std::string(subgraph));
+        }
+        void edge(std::string_view from, std::string_view to, std::string_view style, std::string_view label) override {
+            chart.addConnection(Connection(std::string(from), std::string(to), std::string(label), std::string(style)));
+            // Ids handed out earlier must survive the blocks they came from
+            for (size_t i = 0; i < views.size(); ++i) stale |= views[i] != reported[i];
+        }
+        void subgraphBegin(std::string_view id, std::string_view label) override {
+            chart.addSubgraph(SubGraph(std::string(id), std::string(label)));
+        }
+        void classDef(std::string_view className, std::string_view definition) override {
+            chart.addClass(std::string(className), std::string(definition));
+        }
+        void nodeClass(std::string_view nodeId, std::string_view className) override {
+            chart.addNodeClass(std::string(nodeId), std::string(className));
+        }
+    };
+
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string inputs[] = {
+        buffer.str(),
+        "flowchart TD\n  subgraph S [A long label that spans blocks]\n    A[a] --> B -->|x| C & D\n  end\n"
+        "  B[relabeled] == y ==> A\r\n  A --> B\n  class A,B,C k\n  classDef k fill:#fff\n  E[no newline]",
+    };
+    for (const std::string& input : inputs) {
+        Chart expected = MermaidParser::parseContent(input);
+        for (size_t blockSize : {size_t(1), size_t(7), size_t(64), MermaidParser::defaultStreamBlockSize}) {
+            std::istringstream in(input);
+            Builder builder;
+            MermaidParser::parseStream(in, builder, blockSize);
+            expectSameChart(expected, builder.chart, "stream with " + std::to_string(blockSize) + " byte blocks");
+            if (builder.stale) {
+                throw std::runtime_error("Streamed node id did not stay valid");
+            }
+        }
+    }
+
+    // Unlabeled repeats of a known id are not reported again
+    std::istringstream repeats("flowchart LR\nA --> B\nB --> A\nA --> B[b]\n");
+    Builder builder;
+    MermaidParser::parseStream(repeats, builder, 8);
+    if (builder.reported != std::vector<std::string>{"A", "B", "B"}) {
+        throw std::runtime_error("Stream reported repeated node references");
+    }
+
+    bool threw = false;
+    try {
+        std::istringstream headless("A --> B\n");
+        Builder discard;
+        MermaidParser::parseStream(headless, discard);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) {
+        throw std::runtime_error("Stream accepted input without a flowchart declaration");
+    }
+}
+
+void testIncrementalEdit() {
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    MermaidDocument doc(buffer.str());
+    expectSameChart(MermaidParser::parseContent(doc.text()), doc.chart(), "initial document");
+
+    auto replaceText = [&](const std::string& from, const std::string& to) {
+        size_t offset = doc.text().find(from);
+        if (offset == std::string::npos) {
+            throw std::runtime_error("Test text not found: " + from);
+        }
+        doc.edit(offset, from.size(), to);
+        expectSameChart(MermaidParser::parseContent(doc.text()), doc.chart(), "edit of " + from);
+    };
+
+    // Relabel, add and remove connections, split and join lines, restyle
+    replaceText("\"usd.core\"", "\"usd.core.renamed\"");
+    replaceText("usdCore[", "usdCore --> usdf\n        usdExtra[\"extra\"] --> usd2505\n        usdCore[");
+    replaceText("usdf[\"usd.format\"]\n", "");
+    replaceText("fill:#f96", "fill:#000");
+    replaceText("]\n        usdc[", "] ==> usdc[");
+    doc.edit(doc.text().size(), 0, "    class usdExtra,usdCore terminal\n    zz[late] --> usdExtra\n");
+    expectSameChart(MermaidParser::parseContent(doc.text()), doc.chart(), "append");
+    if (doc.rebuildCount() != 0) {
+        throw std::runtime_error("Line-local edits should not rebuild the document");
+    }
+    if (doc.chart().fingerprint() != doc.chart().computeFingerprint()) {
+        throw std::runtime_error("Edits did not keep the fingerprint up to date");
+    }
+    if (doc.chart().nodes.at("usdCore").label != "\"usd.core.renamed\"") {
+        throw std::runtime_error("Relabel was not applied");
+    }
+
+    // Opening a subgraph changes the context of every later line
+    replaceText("    usd2505[", "    subgraph Late\n    usd2505[");
+    if (doc.rebuildCount() != 1) {
+        throw std::runtime_error("Structural edit should rebuild the document");
+    }
+
+    // A failed edit leaves the document untouched
+    std::string before = doc.text();
+    bool threw = false;
+    try {
+        doc.edit(0, doc.text().find('\n'), "%% no header");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw || doc.text() != before) {
+        throw std::runtime_error("Edit removing the flowchart declaration should fail cleanly");
+    }
+
+    // Random edits below the header, with several between reads so that
+    // in-place and structural connection changes pile up before chart()
+    // materializes them
+    const char* snippets[] = {"", "x", "\n", " --> ", "A --> B", "[\"lbl\"]", " & C", "-->|yes| D",
+                              "\n    class A hot\n", "\n    classDef hot fill:#f00\n", "\n    E --> A\n"};
+    std::mt19937 random(11);
+    MermaidDocument fuzzed("flowchart TD\n    A --> B\n    B[\"b\"] --> C & D\n    C --> A\n");
+    std::string expected = fuzzed.text();
+    for (int i = 0; i < 400; ++i) {
+        size_t header = expected.find('\n') + 1;
+        size_t offset = header + random() % (expected.size() - header + 1);
+        size_t length = std::min<size_t>(random() % 4, expected.size() - offset);
+        const char* replacement = snippets[random() % (sizeof(snippets) / sizeof(snippets[0]))];
+        fuzzed.edit(offset, length, replacement);
+        expected.replace(offset, length, replacement);
+        if (fuzzed.size() != expected.size()) {
+            throw std::runtime_error("Document size is off after random edit " + std::to_string(i));
+        }
+        if (i % 3 == 2) {
+            if (fuzzed.text() != expected) {
+                throw std::runtime_error("Document text is off after random edit " + std::to_string(i));
+            }
+            expectSameChart(MermaidParser::parseContent(expected), fuzzed.chart(), "random edit " + std::to_string(i));
+            if (fuzzed.chart().fingerprint() != fuzzed.chart().computeFingerprint()) {
+                throw std::runtime_error("Random edits broke the fingerprint");
+            }
+        }
+    }
+}
+
+void testSequenceTree() {
+    // Random positional edits against std::vector, with string lengths as
+    // weights
+    SequenceTree<std::string> tree;
+    std::vector<std::string> reference;
+    std::mt19937 random(5);
+    for (int i = 0; i < 3000; ++i) {
+        if (!reference.empty() && random() % 3 == 0) {
+            size_t index = random() % reference.size();
+            tree.erase(index);
+            reference.erase(reference.begin() + index);
+        } else {
+            size_t index = random() % (reference.size() + 1);
+            std::string item(random() % 5, 'a' + i % 26);
+            tree.insert(index, item, item.size());
+            reference.insert(reference.begin() + index, item);
+        }
+        if (i % 100 != 0) continue;
+
+        uint64_t offset = 0;
+        for (size_t j = 0; j < reference.size(); ++j) {
+            if (tree[j] != reference[j] || tree.offsetOf(j) != offset) {
+                throw std::runtime_error("SequenceTree differs from std::vector at " + std::to_string(j));
+            }
+            if (!reference[j].empty() && tree.indexAt(offset) != j) {
+                throw std::runtime_error("SequenceTree found the wrong item by offset");
+            }
+            offset += reference[j].size();
+        }
+        if (tree.size() != reference.size() || tree.totalWeight() != offset || tree.indexAt(offset) != tree.size()) {
+            throw std::runtime_error("SequenceTree totals are off");
+        }
+    }
+
+    // Bulk assignment, and lookups over sorted items
+    std::vector<int> sorted;
+    for (int i = 0; i < 1000; ++i) sorted.push_back(2 * i);
+    SequenceTree<int> numbers;
+    numbers.assign(sorted, [](int) { return 1; });
+    std::vector<int> visited;
+    numbers.forEach([&](int n) { visited.push_back(n); });
+    if (visited != sorted || numbers.partitionPoint([](int n) { return n < 501; }) != 251 ||
+        numbers.offsetOf(300) != 300) {
+        throw std::runtime_error("SequenceTree assign or partitionPoint failed");
+    }
+}
+
+void testSemanticEquals() {
+    Chart a;
+    a.direction = Direction::TD;
+    a.addNode(Node("A", "\"Start\""));
+    a.addNode(Node("B", "End"));
+    a.addConnection(Connection("A", "B", "", "-->"));
+    a.addConnection(Connection("A", "B", "", "-->"));
+    a.addConnection(Connection("B", "A", "back", "-->"));
+    a.addClass("hot", "fill:#f96,stroke:#333");
+    a.addNodeClass("A", "hot");
+    a.addNodeClass("A", "cold");
+
+    // Reordered edges, other arrow styles, quoting, CSS spacing and class order
+    Chart b;
+    b.direction = Direction::TD;
+    b.addNode(Node("A", "Start"));
+    b.addNode(Node("B", "\"End\""));
+    b.addConnection(Connection("B", "A", "back", "==>"));
+    b.addConnection(Connection("A", "B", "", "--->"));
+    b.addConnection(Connection("A", "B", "", "-->"));
+    b.addClass("hot", " fill : #f96 ,\tstroke:#333 ");
+    b.addNodeClass("A", "cold");
+    b.addNodeClass("A", "hot");
+    b.addNodeClass("A", "hot");
+    if (!a.semanticEquals(b) || !b.semanticEquals(a)) {
+        throw std::runtime_error("Equivalent charts compare unequal");
+    }
+
+    // Edges are a multiset: a repeated edge does not stand in for a missing one
+    Chart c = b;
+    c.connections[1].to = "A";
+    if (a.semanticEquals(c) || c.semanticEquals(a)) {
+        throw std::runtime_error("Charts with different edge multiplicities compare equal");
+    }
+
+    Chart d = b;
+    d.classDefinitions["hot"] = "fill:#f96;stroke:#333";
+    if (a.semanticEquals(d)) {
+        throw std::runtime_error("Different class definitions compare equal");
+    }
+}
+
+void testFingerprint() {
+    std::ifstream file("sample.mermaid");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    Chart chart = MermaidParser::parseContent(buffer.str());
+    if (chart.fingerprint() != chart.computeFingerprint()) {
+        throw std::runtime_error("Maintained fingerprint differs from a full recomputation");
+    }
+    if (chart.fingerprint().toString().size() != 32) {
+        throw std::runtime_error("Fingerprint string should be 32 hex digits");
+    }
+
+    // Semantically equal after a round trip through the writer
+    Chart rewritten = MermaidParser::parseContent(MermaidWriter::generateContent(chart));
+    if (!chart.semanticEquals(rewritten) || chart.fingerprint() != rewritten.fingerprint()) {
+        throw std::runtime_error("Round-tripped chart has a different fingerprint");
+    }
+
+    // Reordered connections, quoted labels and respaced CSS do not matter
+    Chart a;
+    a.addNode(Node("A", "Start"));
+    a.addConnection(Connection("A", "B", "", "-->"));
+    a.addConnection(Connection("B", "A", "", "-->"));
+    a.addClass("hot", "fill:#f96,stroke:#333");
+    Chart b;
+    b.addClass("hot", "fill : #f96, stroke:#333");
+    b.addConnection(Connection("B", "A", "", "==>"));
+    b.addConnection(Connection("A", "B", "", "-->"));
+    b.addNode(Node("A", "\"Start\""));
+    if (!a.semanticEquals(b) || a.fingerprint() != b.fingerprint()) {
+        throw std::runtime_error("Equivalent charts have different fingerprints");
+    }
+
+    // Any semantic change moves it, and undoing the change restores it
+    Fingerprint before = a.fingerprint();
+    a.addNode(Node("A", "Begin"));
+    if (a.fingerprint() == before) {
+        throw std::runtime_error("Relabel did not change the fingerprint");
+    }
+    a.addNode(Node("A", "Start"));
+    a.addConnection(Connection("A", "B", "", "-->"));
+    if (a.fingerprint() == before) {
+        throw std::runtime_error("Duplicate edge did not change the fingerprint");
+    }
+    a.direction = Direction::TD;
+    a.connections.pop_back();
+    a.refreshFingerprint();
+    if (a.fingerprint() == before) {
+        throw std::runtime_error("Direction did not change the fingerprint");
+    }
+    a.direction = Direction::LR;
+    if (a.fingerprint() != before) {
+        throw std::runtime_error("Undoing changes did not restore the fingerprint");
+    }
+}
+
+void testWriterSubgraphBuckets() {
+    // A and B sit in both subgraphs, so A --> B is written under each
+    Chart chart;
+    chart.direction = Direction::TD;
+    chart.addNode(Node("A", "a"));
+    chart.addNode(Node("B", "\"b\""));
+    chart.addNode(Node("C"));
+    chart.addNode(Node("D", "d"));
+    chart.addSubgraph(SubGraph("S1", "one"));
+    chart.addSubgraph(SubGraph("S2"));
+    chart.addNodeToSubgraph("A", "S1");
+    chart.addNodeToSubgraph("B", "S1");
+    chart.addNodeToSubgraph("A", "S2");
+    chart.addNodeToSubgraph("B", "S2");
+    chart.addNodeToSubgraph("D", "S2");
+    chart.addConnection(Connection("A", "B"));
+    chart.addConnection(Connection("C", "A", "", "==>"));
+    chart.addConnection(Connection("D", "A"));
+    chart.addConnection(Connection("B", "D", "", "-.->"));
+    chart.addClass("k", "fill:#fff");
+    chart.addNodeClass("A", "k");
+    chart.addNodeClass("C", "k");
+
+    std::string expected =
+        "flowchart TD\n"
+        "    C\n"
+        "\n"
+        "    subgraph S1[one]\n"
+        "        A[\"a\"]\n"
+        "        B[\"b\"]\n"
+        "        A --> B\n"
+        "    end\n"
+        "    subgraph S2\n"
+        "        A[\"a\"]\n"
+        "        B[\"b\"]\n"
+        "        D[\"d\"]\n"
+        "        A --> B\n"
+        "        D --> A\n"
+        "        B -.-> D\n"
+        "    end\n"
+        "\n"
+        "    %% Cross-subgraph connections\n"
+        "    C ==> A\n"
+        "\n"
+        "    classDef k fill:#fff\n"
+        "\n"
+        "    class A,C k\n";
+    std::string content = MermaidWriter::generateContent(chart);
+    if (content != expected) {
+        throw std::runtime_error("Unexpected writer output:\n" + content);
+    }
+
+    // The appending overload leaves existing text alone
+    std::string out = "%% header\n";
+    MermaidWriter::generateContent(chart, out);
+    if (out != "%% header\n" + expected) {
+        throw std::runtime_error("generateContent did not append to the caller's buffer");
+    }
+}
+
+void testStreamingWriter() {
+    Chart chart = MermaidParser::parseFile("sample.mermaid");
+    std::string expected = MermaidWriter::generateContent(chart);
+
+    // A tiny buffer forces flushes mid-token, and labels longer than the
+    // buffer go straight through; the pieces must still add up
+    std::string streamed;
+    size_t chunks = 0;
+    {
+        CallbackSink sink([&](std::string_view piece) {
+            streamed += piece;
+            ++chunks;
+        }, 7);
+        MermaidWriter::write(chart, sink);
+        if (sink.bytesWritten() != expected.size()) {
+            throw std::runtime_error("Sink byte count does not match the output");
+        }
+    }
+    if (streamed != expected || chunks < expected.size() / 16) {
+        throw std::runtime_error("Streamed output differs from generateContent");
+    }
+
+    // Through stdio and a raw descriptor
+    FILE* file = std::tmpfile();
+    if (!file) throw std::runtime_error("Cannot create temporary file");
+    {
+        FileSink sink(file, 64);
+        MermaidWriter::write(chart, sink);
+    }
+    std::string readBack(expected.size() + 1, '\0');
+    std::rewind(file);
+    readBack.resize(std::fread(&readBack[0], 1, readBack.size(), file));
+    std::fclose(file);
+    if (readBack != expected) {
+        throw std::runtime_error("FileSink output differs from generateContent");
+    }
+
+    MermaidWriter::writeToFile(chart, "test_stream_output.mermaid", 16);
+    if (MappedFile("test_stream_output.mermaid").contents() != expected) {
+        throw std::runtime_error("writeToFile output differs from generateContent");
+    }
+    std::remove("test_stream_output.mermaid");
+}
+
+void testChartSnapshot() {
+    auto sameChart = [](const Chart& a, const Chart& b) {
+        return a == b && a.nameToId == b.nameToId && a.successors == b.successors &&
+               a.predecessors == b.predecessors && a.fingerprint() == b.fingerprint() &&
+               b.fingerprint() == b.computeFingerprint();
+    };
+
+    Chart chart = MermaidParser::parseFile("sample.mermaid");
+    MermaidWriter::writeSnapshotFile(chart, "test_snapshot.bin");
+    {
+        ChartSnapshot snapshot("test_snapshot.bin");
+        if (!sameChart(chart, snapshot.toChart()) || snapshot.fingerprint() != chart.fingerprint()) {
+            throw std::runtime_error("Snapshot does not load back to the chart");
+        }
+        if (snapshot.nodeCount() != chart.nodes.size() || snapshot.edgeCount() != chart.connections.size()) {
+            throw std::runtime_error("Snapshot has the wrong node or edge count");
+        }
+        for (const auto& [id, targets] : chart.successors) {
+            ChartSnapshot::NodeHandle node = snapshot.find(id);
+            if (node == ChartSnapshot::npos || snapshot.id(node) != id) {
+                throw std::runtime_error("Snapshot cannot find " + id);
+            }
+            std::vector<std::string> ids;
+            for (auto target : snapshot.successors(node)) ids.emplace_back(snapshot.id(target));
+            if (ids != targets) throw std::runtime_error("Snapshot successors differ for " + id);
+        }
+        if (snapshot.find("noSuchNode") != ChartSnapshot::npos) {
+            throw std::runtime_error("Snapshot found a missing node");
+        }
+    }
+    std::remove("test_snapshot.bin");
+
+    // Endpoints that are not nodes, an empty id, styles and nested subgraphs
+    Chart odd;
+    odd.direction = Direction::TD;
+    odd.addNode(Node("", "empty"));
+    odd.addNode(Node("m", "\"quoted\"", "fill:red"));
+    odd.addConnection(Connection("m", "ghost", "lbl", "-.->"));
+    odd.addConnection(Connection("", "m"));
+    odd.addConnection(Connection("zed", ""));
+    SubGraph outer("outer", "Outer");
+    outer.style = "s";
+    outer.subgraphIds.insert("inner");
+    odd.addSubgraph(outer);
+    odd.addSubgraph(SubGraph("inner"));
+    odd.addNodeToSubgraph("m", "inner");
+    odd.addClass("k", "fill:#fff");
+    odd.addNodeClass("m", "k");
+    odd.addNodeClass("m", "k");
+    std::string bytes;
+    {
+        CallbackSink sink([&](std::string_view piece) { bytes += piece; });
+        MermaidWriter::writeSnapshot(odd, sink);
+    }
+    ChartSnapshot snapshot = ChartSnapshot::fromBytes(bytes);
+    if (!sameChart(odd, snapshot.toChart())) {
+        throw std::runtime_error("Snapshot does not round-trip unusual charts");
+    }
+    ChartSnapshot::NodeHandle ghost = snapshot.find("ghost");
+    if (ghost == ChartSnapshot::npos || snapshot.isNode(ghost) || snapshot.predecessors(ghost).size() != 1) {
+        throw std::runtime_error("Snapshot lost a dangling endpoint");
+    }
+
+    // Damaged input is rejected rather than read out of bounds
+    auto rejects = [](const std::string& damaged) {
+        try {
+            ChartSnapshot::fromBytes(damaged);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    std::string badMagic = bytes;
+    badMagic[0] = 'X';
+    std::string badIndex = bytes;
+    badIndex[badIndex.size() - 8] = '\x7f';
+    if (!rejects(bytes.substr(0, bytes.size() - 8)) || !rejects(badMagic) || !rejects(std::string(16, '\0')) ||
+        !rejects(badIndex)) {
+        throw std::runtime_error("Damaged snapshot was accepted");
+    }
+
+    // A chart edited directly, without refreshFingerprint(), still gets its
+    // true fingerprint stored
+    Chart stale = odd;
+    stale.nodes.at("m").label = "changed";
+    std::string staleBytes;
+    {
+        CallbackSink sink([&](std::string_view piece) { staleBytes += piece; });
+        MermaidWriter::writeSnapshot(stale, sink);
+    }
+    if (ChartSnapshot::fromBytes(staleBytes).fingerprint() != stale.computeFingerprint() ||
+        stale.fingerprint() == stale.computeFingerprint()) {
+        throw std::runtime_error("Snapshot stored a stale fingerprint");
+    }
+}
+
 int main() {
     try {
         TEST(testBasicChart);
         TEST(testParseMermaidString);
         TEST(testParseSample);
         TEST(testSubgraphParsing);
+        TEST(testLexerMatchesRegex);
+        TEST(testEdgeSyntax);
+        TEST(testMappedFile);
+        TEST(testChartGraph);
+        TEST(testConnectionDedup);
+        TEST(testChartBuilder);
+        TEST(testArenaChart);
+        TEST(testLazyChart);
+        TEST(testChartDiff);
+        TEST(testChartPatch);
+        TEST(testPersistentMap);
+        TEST(testPersistentChart);
+        TEST(testChartStore);
+        TEST(testGraphAlgorithms);
+        TEST(testParallelFor);
+        TEST(testParallelBfs);
+        TEST(testReachabilityIndex);
+        TEST(testParallelParse);
+        TEST(testStreamingReader);
+        TEST(testStreamingParse);
+        TEST(testIncrementalEdit);
+        TEST(testSequenceTree);
+        TEST(testSemanticEquals);
+        TEST(testFingerprint);
+        TEST(testWriterSubgraphBuckets);
+        TEST(testStreamingWriter);
+        TEST(testChartSnapshot);
         
         std::cout << "All tests passed!" << std::endl;
         return 0;
@@ -0,0 +1,118 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A fixed set of threads for loops that need a parallel step on every
+// iteration. run(fn) calls fn(i) for every i in [0, size()) and returns once
+// all of them have finished, rethrowing the first exception thrown. At most
+// hardware_concurrency() threads take part, the calling thread among them,
+// and they claim indices in increasing order, so size() may exceed the core
+// count. The helper threads start on the first run and then wait between
+// runs, so a step costs a wakeup rather than a thread creation.
+class WorkerTeam {
+public:
+    explicit WorkerTeam(size_t size) : count(size) {}
+    ~WorkerTeam() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    WorkerTeam(const WorkerTeam&) = delete;
+    WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+    size_t size() const { return count; }
+
+    template <typename Fn>
+    void run(Fn&& fn) {
+        std::function<void(size_t)> step(std::ref(fn));
+        if (threads.empty()) {
+            size_t helpers = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+            for (size_t t = 1; t < helpers; ++t) {
+                threads.emplace_back([this] { work(); });
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &step;
+            nextIndex.store(0, std::memory_order_relaxed);
+            busy = threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+        claim();
+
+        std::exception_ptr failed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [&] { return busy == 0; });
+            task = nullptr;
+            failed = std::exchange(error, nullptr);
+        }
+        if (failed) std::rethrow_exception(failed);
+    }
+
+private:
+    void work() {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            claim();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) idle.notify_one();
+        }
+    }
+
+    void claim() {
+        for (size_t i; (i = nextIndex.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            try {
+                (*task)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+            }
+        }
+    }
+
+    const size_t count;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake; // a run started, or the team is stopping
+    std::condition_variable idle; // the last helper finished its share
+    const std::function<void(size_t)>* task = nullptr;
+    uint64_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    std::atomic<size_t> nextIndex{0};
+    std::exception_ptr error;
+};
+
+// Runs fn(i) for every i in [0, count) as a single WorkerTeam step: on at
+// most hardware_concurrency() threads, the calling thread among them, with
+// the first exception thrown rethrown after every thread has finished.
+template <typename Fn>
+void parallelFor(size_t count, Fn&& fn) {
+    WorkerTeam(count).run(std::forward<Fn>(fn));
+}
+
+#endif // PARALLEL_FOR_H
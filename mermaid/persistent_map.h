@@ -0,0 +1,174 @@
+#ifndef PERSISTENT_MAP_H
+#define PERSISTENT_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+// An ordered map whose copies share structure. Copying is O(1); set and
+// erase copy only the O(log n) nodes on the path to the key, so every other
+// copy keeps seeing the entries it had. Nodes are immutable once built and
+// owned through shared_ptr, which makes a copy safe to read from any number
+// of threads while another thread edits its own copy.
+//
+// The tree is a treap whose priorities are hashes of the keys, so its shape
+// depends only on the set of keys, not on the order they were added in.
+template <typename Key, typename Value, typename Compare = std::less<>>
+class PersistentMap {
+public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Null when absent. The pointer stays valid while any copy that has the
+    // entry is alive.
+    template <typename K>
+    const Value* find(const K& key) const {
+        const Node* node = root.get();
+        while (node) {
+            if (less(key, node->entry->first)) {
+                node = node->left.get();
+            } else if (less(node->entry->first, key)) {
+                node = node->right.get();
+            } else {
+                return &node->entry->second;
+            }
+        }
+        return nullptr;
+    }
+
+    // Inserts key or replaces its value
+    void set(Key key, Value value) {
+        uint64_t priority = priorityOf(key);
+        std::shared_ptr<const Entry> entry = std::make_shared<Entry>(std::move(key), std::move(value));
+        bool added = false;
+        root = insert(root, entry, priority, added);
+        if (added) ++count;
+    }
+
+    // Returns false, sharing everything, when key is absent
+    template <typename K>
+    bool erase(const K& key) {
+        bool removed = false;
+        root = remove(root, key, removed);
+        if (removed) --count;
+        return removed;
+    }
+
+    // Calls fn(key, value) for every entry in key order
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        visit(root.get(), fn);
+    }
+
+private:
+    using Entry = std::pair<const Key, Value>;
+    struct Node;
+    using Link = std::shared_ptr<const Node>;
+    // The entry is held separately, so copying a node on a path shares the
+    // key and value instead of copying them
+    struct Node {
+        std::shared_ptr<const Entry> entry;
+        uint64_t priority;
+        Link left;
+        Link right;
+    };
+
+    static Link make(std::shared_ptr<const Entry> entry, uint64_t priority, Link left, Link right) {
+        return std::make_shared<Node>(Node{std::move(entry), priority, std::move(left), std::move(right)});
+    }
+
+    static Link withChildren(const Link& node, Link left, Link right) {
+        return make(node->entry, node->priority, std::move(left), std::move(right));
+    }
+
+    // MurmurHash3 finalizer over std::hash, which is the identity for
+    // integers on common standard libraries
+    static uint64_t priorityOf(const Key& key) {
+        uint64_t k = std::hash<Key>()(key);
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    template <typename A, typename B>
+    static bool less(const A& a, const B& b) {
+        return Compare()(a, b);
+    }
+
+    // Keys below key on the left, the rest on the right
+    static std::pair<Link, Link> split(const Link& node, const Key& key) {
+        if (!node) return {};
+        if (less(node->entry->first, key)) {
+            auto [left, right] = split(node->right, key);
+            return {withChildren(node, node->left, std::move(left)), std::move(right)};
+        }
+        auto [left, right] = split(node->left, key);
+        return {std::move(left), withChildren(node, std::move(right), node->right)};
+    }
+
+    // Every key in left is below every key in right
+    static Link merge(const Link& left, const Link& right) {
+        if (!left) return right;
+        if (!right) return left;
+        if (left->priority >= right->priority) {
+            return withChildren(left, left->left, merge(left->right, right));
+        }
+        return withChildren(right, merge(left, right->left), right->right);
+    }
+
+    static Link insert(const Link& node, const std::shared_ptr<const Entry>& entry, uint64_t priority, bool& added) {
+        const Key& key = entry->first;
+        if (!node) {
+            added = true;
+            return make(entry, priority, nullptr, nullptr);
+        }
+        // Equal keys have equal priorities, so key is not in this subtree
+        // when it outranks the node: it becomes the subtree's root
+        if (priority > node->priority) {
+            auto [left, right] = split(node, key);
+            added = true;
+            return make(entry, priority, std::move(left), std::move(right));
+        }
+        if (less(key, node->entry->first)) {
+            return withChildren(node, insert(node->left, entry, priority, added), node->right);
+        }
+        if (less(node->entry->first, key)) {
+            return withChildren(node, node->left, insert(node->right, entry, priority, added));
+        }
+        return make(entry, node->priority, node->left, node->right);
+    }
+
+    template <typename K>
+    static Link remove(const Link& node, const K& key, bool& removed) {
+        if (!node) return node;
+        if (less(key, node->entry->first)) {
+            Link left = remove(node->left, key, removed);
+            return removed ? withChildren(node, std::move(left), node->right) : node;
+        }
+        if (less(node->entry->first, key)) {
+            Link right = remove(node->right, key, removed);
+            return removed ? withChildren(node, node->left, std::move(right)) : node;
+        }
+        removed = true;
+        return merge(node->left, node->right);
+    }
+
+    template <typename Fn>
+    static void visit(const Node* node, Fn& fn) {
+        while (node) {
+            visit(node->left.get(), fn);
+            fn(node->entry->first, node->entry->second);
+            node = node->right.get();
+        }
+    }
+
+    Link root;
+    size_t count = 0;
+};
+
+#endif // PERSISTENT_MAP_H
@@ -0,0 +1,133 @@
+#include "reachability_index.h"
+#include "chart_algorithms.h"
+#include <algorithm>
+#include <stdexcept>
+
+ReachabilityIndex::ReachabilityIndex(const ChartGraph& graph, size_t maxIntervals) {
+    const size_t n = graph.nodeCount();
+    StronglyConnected scc = GraphAlgorithms::stronglyConnectedComponents(graph);
+    component = std::move(scc.component);
+    const uint32_t count = scc.count;
+
+    // Condensation in CSR form, without duplicate edges. Tarjan numbers
+    // components sinks first, so every edge goes to a lower number.
+    std::vector<uint32_t> memberStart(count + 1, 0);
+    for (NodeHandle node = 0; node < n; ++node) ++memberStart[component[node] + 1];
+    for (uint32_t c = 0; c < count; ++c) memberStart[c + 1] += memberStart[c];
+    std::vector<NodeHandle> members(n);
+    {
+        std::vector<uint32_t> fill(memberStart.begin(), memberStart.end() - 1);
+        for (NodeHandle node = 0; node < n; ++node) members[fill[component[node]]++] = node;
+    }
+    std::vector<uint32_t> dagStart(count + 1, 0);
+    std::vector<uint32_t> dagTargets;
+    std::vector<uint32_t> indegree(count, 0);
+    {
+        constexpr uint32_t none = UINT32_MAX;
+        std::vector<uint32_t> lastSource(count, none);
+        for (uint32_t c = 0; c < count; ++c) {
+            for (uint32_t m = memberStart[c]; m < memberStart[c + 1]; ++m) {
+                for (NodeHandle next : graph.successors(members[m])) {
+                    uint32_t target = component[next];
+                    if (target == c || lastSource[target] == c) continue;
+                    lastSource[target] = c;
+                    dagTargets.push_back(target);
+                    ++indegree[target];
+                }
+            }
+            dagStart[c + 1] = static_cast<uint32_t>(dagTargets.size());
+        }
+    }
+
+    // Spanning forest from the sources, numbered in post-order: a subtree
+    // covers the contiguous range [treeLow, post]
+    post.assign(count, 0);
+    treeLow.assign(count, 0);
+    {
+        struct Frame {
+            uint32_t component;
+            uint32_t next;
+        };
+        std::vector<Frame> stack;
+        std::vector<bool> visited(count, false);
+        uint32_t counter = 0;
+        for (uint32_t root = count; root-- > 0;) {
+            if (indegree[root] != 0 || visited[root]) continue;
+            visited[root] = true;
+            treeLow[root] = counter;
+            stack.push_back(Frame{root, dagStart[root]});
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                if (frame.next < dagStart[frame.component + 1]) {
+                    uint32_t child = dagTargets[frame.next++];
+                    if (!visited[child]) {
+                        visited[child] = true;
+                        treeLow[child] = counter;
+                        stack.push_back(Frame{child, dagStart[child]});
+                    }
+                    continue;
+                }
+                post[frame.component] = counter++;
+                stack.pop_back();
+            }
+        }
+    }
+
+    // Closure, sinks first so every successor's list is ready: the own
+    // subtree plus the successors' lists, sorted and coalesced
+    intervalStart.assign(count + 1, 0);
+    std::vector<Interval> scratch;
+    for (uint32_t c = 0; c < count; ++c) {
+        scratch.clear();
+        scratch.push_back(Interval{treeLow[c], post[c]});
+        for (uint32_t e = dagStart[c]; e < dagStart[c + 1]; ++e) {
+            uint32_t target = dagTargets[e];
+            // Most successors reach nothing outside the own subtree
+            const Interval& only = intervals[intervalStart[target]];
+            if (intervalStart[target + 1] - intervalStart[target] == 1 && only.low >= treeLow[c] &&
+                only.high <= post[c]) {
+                continue;
+            }
+            scratch.insert(scratch.end(), intervals.begin() + intervalStart[target],
+                           intervals.begin() + intervalStart[target + 1]);
+        }
+        std::sort(scratch.begin(), scratch.end(),
+                  [](const Interval& a, const Interval& b) { return a.low < b.low; });
+        Interval current = scratch[0];
+        for (size_t i = 1; i < scratch.size(); ++i) {
+            if (scratch[i].low <= current.high + 1) {
+                current.high = std::max(current.high, scratch[i].high);
+            } else {
+                intervals.push_back(current);
+                current = scratch[i];
+            }
+        }
+        intervals.push_back(current);
+        if (intervals.size() > maxIntervals) {
+            throw std::runtime_error("Reachability index exceeds its interval budget");
+        }
+        intervalStart[c + 1] = static_cast<uint32_t>(intervals.size());
+    }
+    intervals.shrink_to_fit();
+}
+
+bool ReachabilityIndex::reaches(NodeHandle from, NodeHandle to) const {
+    uint32_t source = component[from];
+    uint32_t target = component[to];
+    if (source == target) return true;
+    // Post-order is a reverse topological order
+    uint32_t position = post[target];
+    if (position > post[source]) return false;
+    if (position >= treeLow[source]) return true;
+
+    const Interval* first = intervals.data() + intervalStart[source];
+    const Interval* last = intervals.data() + intervalStart[source + 1];
+    const Interval* it = std::upper_bound(first, last, position,
+                                          [](uint32_t value, const Interval& interval) { return value < interval.low; });
+    return it != first && (it - 1)->high >= position;
+}
+
+size_t ReachabilityIndex::memoryUsage() const {
+    auto bytes = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+    return bytes(component) + bytes(post) + bytes(treeLow) + bytes(intervalStart) + bytes(intervals);
+}
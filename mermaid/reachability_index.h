@@ -0,0 +1,50 @@
+#ifndef REACHABILITY_INDEX_H
+#define REACHABILITY_INDEX_H
+
+#include "chart_graph.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Precomputed answers to "does A reach B" for a graph that rarely changes.
+//
+// Strongly connected components are collapsed, a spanning forest of the
+// resulting DAG is numbered in post-order, and every component stores the
+// post-order numbers it reaches as a sorted list of disjoint intervals (the
+// closure of Agrawal, Borgida and Jagadish). The first interval is the
+// component's own subtree; the rest are the exceptions reached through
+// non-tree edges. A query is a topological-order check, a tree interval
+// check and, only for exception reachability, a binary search over a list
+// that is a single interval for tree-shaped charts.
+class ReachabilityIndex {
+public:
+    using NodeHandle = ChartGraph::NodeHandle;
+    static constexpr size_t defaultMaxIntervals = size_t(1) << 24;
+
+    // Throws std::runtime_error if the closure needs more than maxIntervals
+    // intervals, which only happens for large, densely cross-linked DAGs;
+    // use GraphAlgorithms::downstream for those.
+    explicit ReachabilityIndex(const ChartGraph& graph, size_t maxIntervals = defaultMaxIntervals);
+
+    // True if there is a path from one node to the other; every node
+    // reaches itself
+    bool reaches(NodeHandle from, NodeHandle to) const;
+
+    size_t componentCount() const { return post.size(); }
+    size_t intervalCount() const { return intervals.size(); }
+    size_t memoryUsage() const;
+
+private:
+    struct Interval {
+        uint32_t low;
+        uint32_t high;
+    };
+
+    std::vector<uint32_t> component;     // per node
+    std::vector<uint32_t> post;          // per component, post-order number
+    std::vector<uint32_t> treeLow;       // per component, lowest post-order number in its subtree
+    std::vector<uint32_t> intervalStart; // per component + 1, into intervals
+    std::vector<Interval> intervals;
+};
+
+#endif // REACHABILITY_INDEX_H
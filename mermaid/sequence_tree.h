@@ -0,0 +1,244 @@
+#ifndef SEQUENCE_TREE_H
+#define SEQUENCE_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// A sequence kept as an implicit treap, so that access, insertion and
+// removal at a position cost O(log n). Each item carries a weight, and every
+// subtree knows the total weight of its items, so positions can also be
+// looked up by running weight: with byte lengths as weights the tree is an
+// index of offsets that need no shifting when an item is inserted before
+// them.
+//
+// Nodes live in one pool and refer to each other by 32-bit index, so copying
+// a SequenceTree copies the pool and moving it moves the pool. The pool is a
+// deque, so growing it never relocates the nodes already there.
+template <typename Item>
+class SequenceTree {
+public:
+    size_t size() const { return root == kNone ? 0 : pool[root].count; }
+    bool empty() const { return root == kNone; }
+    uint64_t totalWeight() const { return root == kNone ? 0 : pool[root].sum; }
+
+    const Item& operator[](size_t index) const { return pool[find(index)].item; }
+    Item& operator[](size_t index) { return pool[find(index)].item; }
+
+    // Total weight of the items before index
+    uint64_t offsetOf(size_t index) const {
+        uint64_t offset = 0;
+        for (uint32_t node = root; node != kNone;) {
+            const Node& n = pool[node];
+            size_t left = countOf(n.left);
+            if (index < left) {
+                node = n.left;
+            } else {
+                offset += sumOf(n.left);
+                if (index == left) break;
+                offset += n.weight;
+                index -= left + 1;
+                node = n.right;
+            }
+        }
+        return offset;
+    }
+
+    // Index of the item whose weight covers offset, or size() if offset is
+    // not below totalWeight()
+    size_t indexAt(uint64_t offset) const {
+        size_t index = 0;
+        for (uint32_t node = root; node != kNone;) {
+            const Node& n = pool[node];
+            if (offset < sumOf(n.left)) {
+                node = n.left;
+                continue;
+            }
+            offset -= sumOf(n.left);
+            index += countOf(n.left);
+            if (offset < n.weight) return index;
+            offset -= n.weight;
+            ++index;
+            node = n.right;
+        }
+        return index;
+    }
+
+    // For a sequence partitioned by before (true for a prefix of the items,
+    // false for the rest), the index of the first item it is false for
+    template <typename Before>
+    size_t partitionPoint(Before&& before) const {
+        size_t index = 0;
+        for (uint32_t node = root; node != kNone;) {
+            const Node& n = pool[node];
+            if (before(n.item)) {
+                index += countOf(n.left) + 1;
+                node = n.right;
+            } else {
+                node = n.left;
+            }
+        }
+        return index;
+    }
+
+    void insert(size_t index, Item item, uint64_t weight) {
+        uint32_t node = allocate(std::move(item), weight);
+        auto [left, right] = split(root, index);
+        root = merge(merge(left, node), right);
+    }
+
+    void erase(size_t index) {
+        auto [left, rest] = split(root, index);
+        auto [removed, right] = split(rest, 1);
+        release(removed);
+        root = merge(left, right);
+    }
+
+    // Replaces the contents in O(n)
+    template <typename Weigh>
+    void assign(std::vector<Item> items, Weigh&& weigh) {
+        clear();
+        // Cartesian tree construction: the right spine holds the nodes that
+        // may still take a right child
+        std::vector<uint32_t> spine;
+        for (auto& item : items) {
+            uint64_t weight = weigh(item);
+            uint32_t node = allocate(std::move(item), weight);
+            uint32_t last = kNone;
+            while (!spine.empty() && pool[spine.back()].priority < pool[node].priority) {
+                last = spine.back();
+                spine.pop_back();
+            }
+            pool[node].left = last;
+            if (!spine.empty()) pool[spine.back()].right = node;
+            spine.push_back(node);
+        }
+        if (spine.empty()) return;
+        root = spine.front();
+        update(root, true);
+    }
+
+    void clear() {
+        pool.clear();
+        unused.clear();
+        root = kNone;
+    }
+
+    // Calls fn(item) for every item in order
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        visit(root, fn);
+    }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Node {
+        Item item;
+        uint64_t weight;
+        uint64_t sum; // of the weights in this subtree
+        uint32_t count;
+        uint32_t priority;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    size_t countOf(uint32_t node) const { return node == kNone ? 0 : pool[node].count; }
+    uint64_t sumOf(uint32_t node) const { return node == kNone ? 0 : pool[node].sum; }
+
+    uint32_t find(size_t index) const {
+        uint32_t node = root;
+        for (;;) {
+            const Node& n = pool[node];
+            size_t left = countOf(n.left);
+            if (index == left) return node;
+            if (index < left) {
+                node = n.left;
+            } else {
+                index -= left + 1;
+                node = n.right;
+            }
+        }
+    }
+
+    // Recomputes count and sum from the children, after they have been
+    // brought up to date themselves if deep is set
+    void update(uint32_t node, bool deep = false) {
+        Node& n = pool[node];
+        if (deep) {
+            if (n.left != kNone) update(n.left, true);
+            if (n.right != kNone) update(n.right, true);
+        }
+        n.count = static_cast<uint32_t>(1 + countOf(n.left) + countOf(n.right));
+        n.sum = n.weight + sumOf(n.left) + sumOf(n.right);
+    }
+
+    uint32_t allocate(Item item, uint64_t weight) {
+        // xorshift32: priorities only need to be independent of the items
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        Node node{std::move(item), weight, weight, 1, random, kNone, kNone};
+        if (!unused.empty()) {
+            uint32_t index = unused.back();
+            unused.pop_back();
+            pool[index] = std::move(node);
+            return index;
+        }
+        pool.push_back(std::move(node));
+        return static_cast<uint32_t>(pool.size() - 1);
+    }
+
+    void release(uint32_t node) {
+        pool[node].item = Item();
+        unused.push_back(node);
+    }
+
+    // The first count items on the left, the rest on the right
+    std::pair<uint32_t, uint32_t> split(uint32_t node, size_t count) {
+        if (node == kNone) return {kNone, kNone};
+        Node& n = pool[node];
+        size_t left = countOf(n.left);
+        if (count <= left) {
+            auto [first, second] = split(n.left, count);
+            pool[node].left = second;
+            update(node);
+            return {first, node};
+        }
+        auto [first, second] = split(n.right, count - left - 1);
+        pool[node].right = first;
+        update(node);
+        return {node, second};
+    }
+
+    uint32_t merge(uint32_t left, uint32_t right) {
+        if (left == kNone) return right;
+        if (right == kNone) return left;
+        if (pool[left].priority > pool[right].priority) {
+            pool[left].right = merge(pool[left].right, right);
+            update(left);
+            return left;
+        }
+        pool[right].left = merge(left, pool[right].left);
+        update(right);
+        return right;
+    }
+
+    template <typename Fn>
+    void visit(uint32_t node, Fn& fn) const {
+        while (node != kNone) {
+            visit(pool[node].left, fn);
+            fn(pool[node].item);
+            node = pool[node].right;
+        }
+    }
+
+    std::deque<Node> pool;
+    std::vector<uint32_t> unused;
+    uint32_t root = kNone;
+    uint32_t random = 2463534242u;
+};
+
+#endif // SEQUENCE_TREE_H